@@ -5,17 +5,20 @@
 void Packet::copyParams(const Packet& src, Packet& dst) {
   dst.is_flush = src.is_flush;
   dst.is_eof = src.is_eof;
+  dst.is_stream_change = src.is_stream_change;
 }
 
 void Packet::clear() {
   av_packet_unref(m_pkt);
-  is_flush = is_eof = false;
+  is_flush = is_eof = is_stream_change = false;
 }
 
 bool Packet::isFlush() const { return is_flush; }
 
 bool Packet::isEOF() const { return is_eof; }
 
+bool Packet::isStreamChange() const { return is_stream_change; }
+
 int Packet::size() const { return m_pkt->size; }
 
 int64_t Packet::duration() const { return m_pkt->duration; }
@@ -30,6 +33,8 @@ void Packet::setFlush(bool flush) { is_flush = flush; }
 
 void Packet::setEOF(bool eof) { is_eof = eof; }
 
+void Packet::setStreamChange(bool change) { is_stream_change = change; }
+
 int Packet::streamIndex() const { return m_pkt->stream_index; }
 
 int64_t Packet::bytePos() const { return m_pkt->pos; }
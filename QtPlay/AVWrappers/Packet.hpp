@@ -9,7 +9,7 @@ extern "C" {
 class Packet final {
  private:
   AVPacket* m_pkt = nullptr;
-  bool is_flush = false, is_eof = false;
+  bool is_flush = false, is_eof = false, is_stream_change = false;
 
  public:
   Packet();
@@ -25,11 +25,14 @@ class Packet final {
   const AVPacket* constAvData() const;
   bool isFlush() const;
   bool isEOF() const;
+  // The decoder is drained and replaced by the next playlist item's one
+  bool isStreamChange() const;
   int size() const;
   int64_t duration() const;
   int sizePlusSizeof() const;
   void setFlush(bool flush = true);
   void setEOF(bool eof = true);
+  void setStreamChange(bool change = true);
   int streamIndex() const;
   int64_t bytePos() const;
 
@@ -223,7 +223,7 @@ static int audio_open(PlayerContext& ctx,
 void AudioThread::run() {
   bool reopen_audio = true, step_pending = true, local_paused = false,
        local_eof = false;
-  double swr_delay = 0.0, audio_clock = 0.0;
+  double swr_delay = 0.0, audio_clock = 0.0, clock_speed = 1.0;
 
   Packet pkt;
   std::deque<Frame> filtered_frames;
@@ -376,6 +376,9 @@ void AudioThread::run() {
           if (ctx.audioq.get(pkt)) {
             ctx.auddec.decode_audio_packet(pkt, filtered_frames,
                                            audio_filter_src, audio_tgt);
+            // Gapless: the drained frames stay queued ahead of the new ones
+            if (pkt.isStreamChange())
+              ctx.switchToNextDecoder(AVMEDIA_TYPE_AUDIO);
             pkt.clear();
           } else {
             ctx.continue_read_thread.notify_one();
@@ -415,6 +418,7 @@ void AudioThread::run() {
           static_cast<std::size_t>(ctx.audio_rbuf.getAvailableWrite()));
       if (to_write > 0) {
         if (ctx.audio_rbuf.write(resampled_data.data(), to_write)) {
+          ctx.reportFirstAudio();
           const auto alatency = get_latency(paused);
           for (auto vis : ctx.audio_viss) {
             vis->bufferAudio(std::span(resampled_data.begin(),
@@ -430,7 +434,12 @@ void AudioThread::run() {
             resampled_data = std::move(remaining_data);
           }
 
-          if (!std::isnan(audio_clock)) ctx.audclk.set(audio_clock - alatency);
+          if (!std::isnan(audio_clock)) {
+            // The buffered output plays faster than real time at tempo > 1
+            const auto tempo = ctx.auddec.graph_tempo;
+            if (clock_speed != tempo) ctx.audclk.set_speed(clock_speed = tempo);
+            ctx.audclk.set(audio_clock - alatency * tempo);
+          }
 
           step_pending = false;
         }
@@ -0,0 +1,189 @@
+#include "WaveformOverview.hpp"
+
+#include "../Common/CachePaths.hpp"
+#include "../Common/QtPlayCommon.hpp"
+
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+#include <cmath>
+
+using qtplay::logMsg;
+
+namespace {
+struct Accumulator {
+  float min = INFINITY, max = -INFINITY;
+  double sum_sq = 0.0;
+  int64_t count = 0;
+
+  void merge(const Accumulator& other) {
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    sum_sq += other.sum_sq;
+    count += other.count;
+  }
+};
+
+/* Every segment accumulates into the run of buckets it covers, and the runs
+ * are folded into the whole as the segments are merged */
+class PeakTask final : public ParallelScanner::Task {
+ public:
+  explicit PeakTask(int rate) : sample_rate(rate) {}
+
+  AVMediaType mediaType() const override { return AVMEDIA_TYPE_AUDIO; }
+
+  AudioParams audioTarget() const override {
+    AudioParams params;
+    av_channel_layout_default(params.ch_layout.rawPtr(), 1);
+    params.fmt = AV_SAMPLE_FMT_FLT;
+    params.freq = sample_rate;
+    return params;
+  }
+
+  void begin(int segments, double start, double duration) override {
+    input_start = start;
+    buckets_per_second =
+        duration > 0.0 ? WaveformOverview::buckets / duration : 0.0;
+    parts.assign(segments, {});
+    total.assign(WaveformOverview::buckets, {});
+  }
+
+  void frame(int segment, const Frame& fr) override {
+    const auto av = fr.av();
+    const auto rate = fr.sampleRate();
+    if (std::isnan(fr.pts) || buckets_per_second <= 0.0 || rate <= 0 ||
+        av->format != AV_SAMPLE_FMT_FLT)
+      return;
+
+    auto& part = parts[segment];
+    const auto samples = reinterpret_cast<const float*>(av->data[0]);
+    const auto count = fr.nbSamples();
+    const auto offset = (fr.pts - input_start) * buckets_per_second;
+    const auto step = buckets_per_second / rate;
+    auto bucket = [&](int i) {
+      return std::clamp(int(offset + i * step), 0,
+                        WaveformOverview::buckets - 1);
+    };
+    for (auto i = 0; i < count;) {
+      // The samples of one bucket are accumulated in a run
+      const auto idx = bucket(i);
+      if (part.first < 0) part.first = idx;
+      if (idx < part.first) {
+        ++i;
+        continue;
+      }
+      if (idx - part.first >= (int)part.sums.size())
+        part.sums.resize(idx - part.first + 1);
+
+      auto& acc = part.sums[idx - part.first];
+      for (; i < count && bucket(i) == idx; ++i) {
+        const auto s = samples[i];
+        acc.min = std::min(acc.min, s);
+        acc.max = std::max(acc.max, s);
+        acc.sum_sq += double(s) * s;
+        ++acc.count;
+      }
+    }
+  }
+
+  void merge(int segment) override {
+    auto& part = parts[segment];
+    for (auto i = 0; i < (int)part.sums.size(); ++i)
+      total[part.first + i].merge(part.sums[i]);
+    part = {};
+  }
+
+  std::vector<WaveformOverview::Peak> peaks() const {
+    std::vector<WaveformOverview::Peak> out(total.size());
+    for (auto i = 0; i < (int)total.size(); ++i) {
+      const auto& acc = total[i];
+      if (!acc.count) continue;
+      out[i] = {acc.min, acc.max, float(std::sqrt(acc.sum_sq / acc.count))};
+    }
+    return out;
+  }
+
+ private:
+  struct Part {
+    int first = -1;  // Bucket of sums[0]
+    std::vector<Accumulator> sums;
+  };
+
+  const int sample_rate;
+  double input_start = 0.0, buckets_per_second = 0.0;
+  std::vector<Part> parts;
+  std::vector<Accumulator> total;
+};
+}  // namespace
+
+WaveformOverview::WaveformOverview(const std::string& url)
+    : QThread(nullptr),
+      input_url(url),
+      cache_file(qtplay::mediaCachePath(url, "Waveform", "peaks")),
+      scanner(url) {
+  // Scanning a network input would take the bandwidth of the playback
+  if (!cache_file.isEmpty()) start(QThread::LowPriority);
+}
+
+WaveformOverview::~WaveformOverview() {
+  scanner.cancel();
+  wait();
+}
+
+std::vector<WaveformOverview::Peak> WaveformOverview::peaks() {
+  std::scoped_lock lck(mtx);
+  return result;
+}
+
+void WaveformOverview::run() {
+  if (!load()) {
+    /* A single reader: audio decoding is cheap next to the I/O, which
+     * playback must keep having first */
+    PeakTask task(sample_rate);
+    scanner.setReadRate(max_read_rate);
+    if (!scanner.run(task, 1)) return;
+
+    auto peaks = task.peaks();
+    save(peaks);
+    std::scoped_lock lck(mtx);
+    result = std::move(peaks);
+  }
+
+  emit sigReady();
+}
+
+bool WaveformOverview::load() {
+  QFile file(cache_file);
+  if (!file.open(QIODevice::ReadOnly)) return false;
+
+  QDataStream in(&file);
+  in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+  quint32 magic = 0, version = 0;
+  qint32 count = 0;
+  in >> magic >> version >> count;
+  if (magic != file_magic || version != file_version || count != buckets)
+    return false;
+
+  std::vector<Peak> peaks(count);
+  for (auto& peak : peaks) in >> peak.min >> peak.max >> peak.rms;
+  if (in.status() != QDataStream::Ok) return false;
+
+  std::scoped_lock lck(mtx);
+  result = std::move(peaks);
+  logMsg("Waveform overview loaded from the cache");
+
+  return true;
+}
+
+void WaveformOverview::save(const std::vector<Peak>& peaks) {
+  QSaveFile file(cache_file);
+  if (!file.open(QIODevice::WriteOnly)) return;
+
+  QDataStream out(&file);
+  out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+  out << file_magic << file_version << (qint32)peaks.size();
+  for (const auto& peak : peaks) out << peak.min << peak.max << peak.rms;
+
+  file.commit();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../Demux/ParallelScanner.hpp"
+
+#include <QString>
+#include <QThread>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Min/max/RMS overview of the audio of a whole local file, drawn behind the
+ * seek slider. Only the audio is decoded, mono at a low rate, by a
+ * ParallelScanner with a single reader, below the playback priority and at
+ * a capped read rate, and the result is decimated to a fixed number of
+ * buckets. The peaks are kept in the cache directory, so a file is only
+ * scanned the first time it is played. */
+class WaveformOverview final : public QThread {
+  Q_OBJECT;
+  Q_DISABLE_COPY_MOVE(WaveformOverview);
+
+ public:
+  struct Peak {
+    float min = 0.0f, max = 0.0f, rms = 0.0f;  // Of samples in [-1, 1]
+  };
+  static constexpr int buckets = 2000;
+
+  explicit WaveformOverview(const std::string& url);
+  ~WaveformOverview();
+
+  const std::string& url() const { return input_url; }
+  // Empty until sigReady
+  std::vector<Peak> peaks();
+
+  Q_SIGNAL void sigReady();
+
+ private:
+  static constexpr quint32 file_magic = 0x51505746;  // "QPWF"
+  static constexpr quint32 file_version = 1;
+  static constexpr int sample_rate = 8000;  // Plenty for peaks
+  // Leaves most of a spinning or network disk to the playback
+  static constexpr int64_t max_read_rate = 8LL * 1024 * 1024;
+
+  const std::string input_url;
+  const QString cache_file;  // Empty for inputs that are not local files
+  ParallelScanner scanner;
+
+  std::mutex mtx;
+  std::vector<Peak> result;  // Protected by the mtx
+
+  void run() override;
+  bool load();
+  void save(const std::vector<Peak>& peaks);
+};
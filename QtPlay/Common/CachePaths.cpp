@@ -0,0 +1,35 @@
+#include "CachePaths.hpp"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+
+QString qtplay::mediaCachePath(const std::string& url, const QString& subdir,
+                               const QString& ext) {
+  auto path = QString::fromStdString(url);
+  if (path.startsWith("file:")) {
+    path.remove(0, 5);
+  } else if (path.contains("://")) {
+    return {};
+  }
+
+  const QFileInfo info(path);
+  if (!info.isFile()) return {};
+
+  const auto identity = QString("%1|%2|%3")
+                            .arg(info.absoluteFilePath())
+                            .arg(info.size())
+                            .arg(info.lastModified().toMSecsSinceEpoch());
+  const auto hash =
+      QCryptographicHash::hash(identity.toUtf8(), QCryptographicHash::Sha1)
+          .toHex();
+
+  const QDir dir(
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/" +
+      subdir);
+  if (!dir.mkpath(".")) return {};
+
+  return dir.filePath(QString::fromLatin1(hash) + "." + ext);
+}
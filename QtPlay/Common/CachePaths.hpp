@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QString>
+#include <string>
+
+namespace qtplay {
+/* Path of a cache file derived from a media file, e.g. its keyframe index.
+ * The name is a hash of the file's absolute path, size and modification
+ * time, so a changed file gets a fresh entry. Returns an empty string for
+ * inputs that are not local files, or if the cache directory is not
+ * writable. */
+QString mediaCachePath(const std::string& url, const QString& subdir,
+                       const QString& ext);
+}  // namespace qtplay
@@ -1,7 +1,10 @@
 #include "Decoder.hpp"
 
 #include "../Video/SupportedPixFmts.hpp"
+#include "HWDecoderCache.hpp"
+#include "PlayerSettings.hpp"
 #include "QtPlayCommon.hpp"
+#include "ThreadingPolicy.hpp"
 
 extern "C" {
 #include <libavfilter/buffersink.h>
@@ -11,6 +14,9 @@ extern "C" {
 #include <libavutil/opt.h>
 }
 
+#include <algorithm>
+#include <vector>
+
 Decoder::Decoder() {}
 
 Decoder::~Decoder() { destroy(); }
@@ -62,6 +68,7 @@ fail:
 
 int configure_video_filters(AVFilterGraph*& graph, const Stream& video_st,
                             const char* vfilters, const AVFrame* const frame,
+                            int scale_w, int scale_h, int nb_threads,
                             AVFilterContext*& in_video_filter,
                             AVFilterContext*& out_video_filter) {
   auto pix_fmts = supported_pix_fmts;
@@ -76,7 +83,7 @@ int configure_video_filters(AVFilterGraph*& graph, const Stream& video_st,
     return AVERROR(ENOMEM);
   }
 
-  graph->nb_threads = 0;
+  graph->nb_threads = nb_threads;
 
   AVDictionary* sws_dict = nullptr;
   while ((e = av_dict_get(sws_dict, "", e, AV_DICT_IGNORE_SUFFIX))) {
@@ -162,6 +169,15 @@ int configure_video_filters(AVFilterGraph*& graph, const Stream& video_st,
     }
   }
 
+  /* Downscale after deinterlacing, but before rotating, so the scaled size
+   * is always expressed in the source orientation */
+  if (scale_w > 0 && scale_h > 0) {
+    char scale_buf[64] = {};
+    snprintf(scale_buf, sizeof(scale_buf), "%d:%d:flags=bilinear:threads=%d",
+             scale_w, scale_h, nb_threads);
+    INSERT_FILT("scale", scale_buf);
+  }
+
   if (frame->interlaced_frame)  // Auto-deinterlace
   {
     INSERT_FILT("yadif", nullptr);
@@ -256,9 +272,13 @@ end:
 void Decoder::filter_decoded_videoframe(AVFrame* frame,
                                         std::deque<Frame>& filtered_frames) {
   if (frame) {
+    const auto shift = wanted_reduction(frame->width, frame->height);
     if (!graph || (last_w != frame->width) || (last_h != frame->height) ||
-        (last_format != frame->format)) {
-      if (configure_video_filters(graph, stream, nullptr, frame, filt_in,
+        (last_format != frame->format) || (scale_shift != shift)) {
+      const auto scale_w = shift ? ((frame->width >> shift) & ~1) : 0;
+      const auto scale_h = shift ? ((frame->height >> shift) & ~1) : 0;
+      if (configure_video_filters(graph, stream, nullptr, frame, scale_w,
+                                  scale_h, filter_threads, filt_in,
                                   filt_out) < 0) {
         return;
       }
@@ -266,6 +286,7 @@ void Decoder::filter_decoded_videoframe(AVFrame* frame,
       last_w = frame->width;
       last_h = frame->height;
       last_format = (AVPixelFormat)frame->format;
+      scale_shift = shift;
     }
   }
 
@@ -316,7 +337,8 @@ void Decoder::filter_decoded_audioframe(AVFrame* frame,
               (AVSampleFormat)frame->format, frame->ch_layout.nb_channels) ||
           av_channel_layout_compare(audio_filter_src.ch_layout.readPtr(),
                                     &frame->ch_layout) ||
-          (audio_filter_src.freq != frame->sample_rate)) {
+          (audio_filter_src.freq != frame->sample_rate) ||
+          graph_tempo != tempo) {
         // if(graph) - flush out all potentially remaining frames from the
         // filter
 
@@ -324,8 +346,14 @@ void Decoder::filter_decoded_audioframe(AVFrame* frame,
         audio_filter_src.fmt = (AVSampleFormat)frame->format;
         audio_filter_src.freq = frame->sample_rate;
 
-        if (configure_audio_filters(nullptr, graph, filt_in, filt_out,
-                                    audio_tgt, audio_filter_src) < 0)
+        graph_tempo = tempo;
+        tempo_origin = NAN;
+        char afilters[32] = {};
+        if (graph_tempo != 1.0)
+          snprintf(afilters, sizeof(afilters), "atempo=%.3f", graph_tempo);
+        if (configure_audio_filters(graph_tempo != 1.0 ? afilters : nullptr,
+                                    graph, filt_in, filt_out, audio_tgt,
+                                    audio_filter_src) < 0)
           return;
       }
     }
@@ -345,12 +373,199 @@ void Decoder::filter_decoded_audioframe(AVFrame* frame,
                      : filtered_fr->pts * av_q2d(tb);
         fr.duration =
             av_q2d({filtered_fr->nb_samples, filtered_fr->sample_rate});
+        if (graph_tempo != 1.0) {
+          if (std::isnan(tempo_origin)) tempo_origin = fr.pts;
+          fr.pts = tempo_origin + (fr.pts - tempo_origin) * graph_tempo;
+          fr.duration *= graph_tempo;
+        }
         av_frame_move_ref(fr.av(), filtered.av());
       }
     }
   }
 };
 
+void Decoder::setMinFrameInterval(double interval) {
+  min_frame_interval = interval;
+}
+
+/* Returns true if the frame should be dropped. Kept frames are spaced by at
+ * least min_frame_interval, so a 120/144 fps source shown on a 60 Hz display
+ * only costs filtering and upload for the frames that will be presented. */
+bool Decoder::decimate_videoframe(const AVFrame* frame) {
+  if (frame->pts == AV_NOPTS_VALUE || stream.isAttachedPic()) return false;
+
+  const auto pts = frame->pts * av_q2d(avctx->pkt_timebase);
+
+  /* The frame duration of the stream, not the spacing of the frames that
+   * come out: once non-reference frames are skipped, those are further
+   * apart, and the skipping would be switched off and on every few frames */
+  auto frame_dur = 0.0;
+  if (const auto rate = stream.avgFrameRateR(); rate.num > 0 && rate.den > 0) {
+    frame_dur = av_q2d(av_inv_q(rate));
+  } else if (frame->duration > 0) {
+    frame_dur = frame->duration * av_q2d(avctx->pkt_timebase);
+  }
+  if (!(frame_dur < 1.0)) frame_dur = 0.0;
+
+  const auto interval = min_frame_interval;
+  if (interval <= 0.0 || frame_dur <= 0.0 || frame_dur * 1.1 >= interval) {
+    next_kept_pts = NAN;
+    avctx->skip_frame = AVDISCARD_DEFAULT;
+    return false;
+  }
+
+  /* If at least every other frame is dropped anyway, let the decoder skip
+   * non-reference frames altogether */
+  avctx->skip_frame =
+      (interval >= frame_dur * 2.0) ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+
+  // Timestamp discontinuity or the first frame: restart the cadence
+  if (std::isnan(next_kept_pts) || pts < next_kept_pts - 2.0 * interval ||
+      pts > next_kept_pts + interval) {
+    next_kept_pts = pts + interval;
+    return false;
+  }
+
+  if (pts + frame_dur * 0.5 < next_kept_pts) return true;
+
+  next_kept_pts += interval;
+  return false;
+}
+
+void Decoder::setDisplaySize(int w, int h) {
+  display_w = w;
+  display_h = h;
+}
+
+void Decoder::setLowLatency(bool enable) { low_latency = enable; }
+
+void Decoder::setSeekTarget(int64_t target) { seek_target = target; }
+
+// Taken into account by the audio filtergraph with the next frame
+void Decoder::setTempo(double value) { tempo = std::clamp(value, 0.5, 2.0); }
+
+// The whole packet is displayed before the seek target
+bool Decoder::packet_before_seek_target(const Packet& pkt) const {
+  const auto target = seek_target.load();
+  if (target == AV_NOPTS_VALUE || pkt.isFlush()) return false;
+
+  const auto av_pkt = pkt.constAvData();
+  if (av_pkt->pts == AV_NOPTS_VALUE) return false;
+  const auto end =
+      av_rescale_q(av_pkt->pts + std::max<int64_t>(av_pkt->duration, 0),
+                   avctx->pkt_timebase, {1, AV_TIME_BASE});
+  return end <= target;
+}
+
+bool Decoder::videoframe_before_seek_target(const AVFrame* frame) {
+  const auto target = seek_target.load();
+  if (target == AV_NOPTS_VALUE) return false;
+
+  if (frame->pts != AV_NOPTS_VALUE && !stream.isAttachedPic()) {
+    const auto end =
+        av_rescale_q(frame->pts + std::max<int64_t>(frame->duration, 0),
+                     avctx->pkt_timebase, {1, AV_TIME_BASE});
+    if (end <= target) return true;
+  }
+
+  // Reached (or the timestamps cannot tell)
+  seek_target = AV_NOPTS_VALUE;
+  avctx->skip_frame = AVDISCARD_DEFAULT;
+  return false;
+}
+
+/* Drops the samples before the seek target, so that audio starts exactly at
+ * it. The frame's pts must be in 1/sample_rate units. Returns true if the
+ * whole frame is to be dropped. */
+bool Decoder::trim_audioframe_to_seek_target(AVFrame* frame) {
+  const auto target = seek_target.load();
+  if (target == AV_NOPTS_VALUE) return false;
+  if (frame->pts == AV_NOPTS_VALUE || frame->sample_rate <= 0) {
+    seek_target = AV_NOPTS_VALUE;
+    return false;
+  }
+
+  const AVRational tb{1, frame->sample_rate};
+  const auto target_pts = av_rescale_q(target, {1, AV_TIME_BASE}, tb);
+  if (frame->pts + frame->nb_samples <= target_pts) return true;
+
+  seek_target = AV_NOPTS_VALUE;
+  const auto skip = (int)(target_pts - frame->pts);
+  if (skip <= 0) return false;
+
+  /* The rest goes to a frame of its own: moving the data pointers would
+   * leave buffers that are not aligned for the SIMD code of swr and the
+   * filters. The frame is kept whole if that fails. */
+  const auto tail = av_frame_alloc();
+  if (!tail) return false;
+  tail->format = frame->format;
+  tail->sample_rate = frame->sample_rate;
+  tail->nb_samples = frame->nb_samples - skip;
+  if (av_channel_layout_copy(&tail->ch_layout, &frame->ch_layout) < 0 ||
+      av_frame_get_buffer(tail, 0) < 0 ||
+      av_frame_copy_props(tail, frame) < 0) {
+    av_frame_free(&tail);
+    return false;
+  }
+  av_samples_copy(tail->extended_data, frame->extended_data, 0, skip,
+                  tail->nb_samples, frame->ch_layout.nb_channels,
+                  (AVSampleFormat)frame->format);
+  tail->pts = frame->pts + skip;
+  av_frame_unref(frame);
+  av_frame_move_ref(frame, tail);
+  av_frame_free(&tail);
+
+  return false;
+}
+
+/* Power-of-two reduction factor such that the picture is still at least as
+ * large as the display area. Zero if the display is not much smaller than
+ * the source. */
+int Decoder::wanted_reduction(int src_w, int src_h) const {
+  constexpr auto max_shift = 3;
+  if (!PlayerSettings::get().reduced_resolution || stream.isAttachedPic())
+    return 0;
+
+  auto dst_w = display_w, dst_h = display_h;
+  if (dst_w <= 0 || dst_h <= 0) return 0;
+
+  // The picture is rotated after scaling
+  if (std::fabs(std::fmod(stream.rotation(), 180.0) - 90.0) < 1.0)
+    std::swap(dst_w, dst_h);
+
+  auto shift = 0;
+  while (shift < max_shift && (src_w >> (shift + 1)) >= dst_w &&
+         (src_h >> (shift + 1)) >= dst_h)
+    ++shift;
+
+  return shift;
+}
+
+/* lowres can only be changed by reopening the codec, so do it on a keyframe
+ * after draining what the old instance still holds */
+void Decoder::update_lowres(const Packet& vpkt,
+                            std::deque<Frame>& decoded_frames) {
+  if (isHW || !avctx || !avctx->codec || !avctx->codec->max_lowres ||
+      vpkt.isFlush() || !(vpkt.constAvData()->flags & AV_PKT_FLAG_KEY))
+    return;
+
+  const auto codecpar = stream.codecpar();
+  const auto wanted =
+      std::min<int>(wanted_reduction(codecpar->width, codecpar->height),
+                    avctx->codec->max_lowres);
+  if (wanted == lowres) return;
+
+  Packet flush_pkt;
+  flush_pkt.setFlush(true);
+  decode_video_packet(flush_pkt, decoded_frames);
+  eof_state = false;
+
+  avcodec_free_context(&avctx);
+  if (!open_swcodec(wanted) && !open_swcodec(0)) {
+    qtplay::logMsg("Failed to reopen the video decoder");
+  }
+}
+
 void Decoder::destroy() {
   flush();
   stream.reset();
@@ -362,6 +577,12 @@ void Decoder::destroy() {
   use_hwframes = false;
   hw_pix_fmt = AV_PIX_FMT_NONE;
   sw_pix_fmt = AV_PIX_FMT_NONE;
+  lowres = scale_shift = 0;
+  seek_target = AV_NOPTS_VALUE;
+  tempo = 1.0;
+  graph_tempo = 1.0;
+  filter_threads = 0;
+  session.release();
   filt_in = filt_out = nullptr;
   graph = nullptr;
 
@@ -375,10 +596,52 @@ void Decoder::destroy() {
   }
 }
 
-bool Decoder::init_swdec(const Stream& st) {
-  destroy();
-  stream = st;
+/* Exchanges the decoding state with a decoder primed for the next playlist
+ * item. The threading leases stay where they are, as both sessions are live
+ * until the replaced decoder is destroyed. */
+void Decoder::swapWith(Decoder& other) {
+  using std::swap;
+  swap(stream, other.stream);
+  swap(buf_frame, other.buf_frame);
+  swap(downloaded_frame, other.downloaded_frame);
+  swap(filtered, other.filtered);
+  swap(avctx, other.avctx);
+  swap(eof_state, other.eof_state);
+  swap(isHW, other.isHW);
+  swap(use_hwdevice, other.use_hwdevice);
+  swap(use_hwframes, other.use_hwframes);
+  swap(cached_fctx, other.cached_fctx);
+  swap(hw_pix_fmt, other.hw_pix_fmt);
+  swap(sw_pix_fmt, other.sw_pix_fmt);
+  swap(start_pts, other.start_pts);
+  swap(next_pts, other.next_pts);
+  swap(start_pts_tb, other.start_pts_tb);
+  swap(next_pts_tb, other.next_pts_tb);
+  swap(min_frame_interval, other.min_frame_interval);
+  swap(next_kept_pts, other.next_kept_pts);
+  swap(display_w, other.display_w);
+  swap(display_h, other.display_h);
+  swap(lowres, other.lowres);
+  swap(scale_shift, other.scale_shift);
+  swap(low_latency, other.low_latency);
+  swap(filter_threads, other.filter_threads);
+  swap(last_w, other.last_w);
+  swap(last_h, other.last_h);
+  swap(last_format, other.last_format);
+  swap(graph, other.graph);
+  swap(filt_out, other.filt_out);
+  swap(filt_in, other.filt_in);
+  seek_target = other.seek_target.exchange(seek_target);
+  tempo = other.tempo.exchange(tempo);
+  swap(graph_tempo, other.graph_tempo);
+  swap(tempo_origin, other.tempo_origin);
+
+  // The get_format callback finds its decoder through the opaque pointer
+  if (avctx) avctx->opaque = this;
+  if (other.avctx) other.avctx->opaque = &other;
+}
 
+bool Decoder::open_swcodec(int lowres_factor) {
   const auto codecpar = stream.codecpar();
   const auto codec_id = codecpar->codec_id;
   const auto codec = avcodec_find_decoder(codec_id);
@@ -395,13 +658,20 @@ bool Decoder::init_swdec(const Stream& st) {
   avctx->pkt_timebase = stream.tbR();
   avctx->codec_id = codec->id;
   avctx->codec_type = codec->type;
-  avctx->lowres = 0;
+  avctx->lowres = std::clamp(lowres_factor, 0, (int)codec->max_lowres);
   avctx->err_recognition = 0;
   avctx->workaround_bugs = FF_BUG_AUTODETECT;
 
-  if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-    avctx->thread_count = 0;
-    avctx->thread_type = FF_THREAD_FRAME;
+  if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO && single_thread) {
+    avctx->thread_count = 1;
+    filter_threads = 1;
+  } else if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+    session.acquire();
+    const auto plan = ThreadingPolicy::choose(codec, codecpar, low_latency);
+    avctx->thread_count = plan.thread_count;
+    avctx->thread_type = plan.thread_type;
+    filter_threads = plan.filter_threads;
+    if (low_latency) avctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
   } else {
     avctx->thread_count = 1;
     avctx->flags |= AV_CODEC_FLAG_BITEXACT;
@@ -412,6 +682,35 @@ bool Decoder::init_swdec(const Stream& st) {
   }
 
   if (avcodec_open2(avctx, codec, nullptr) < 0) {
+    avcodec_free_context(&avctx);
+    return false;
+  }
+
+  if (avctx->lowres != lowres) {
+    qtplay::logMsg("Video decoder: lowres %d", avctx->lowres);
+  }
+  if (codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+    qtplay::logMsg("Video decoder: %d %s thread(s), %d filter thread(s)",
+                   avctx->thread_count,
+                   (avctx->active_thread_type & FF_THREAD_FRAME) ? "frame"
+                                                                : "slice",
+                   filter_threads);
+  }
+  lowres = avctx->lowres;
+
+  return true;
+}
+
+bool Decoder::init_swdec(const Stream& st) {
+  destroy();
+  stream = st;
+
+  const auto codecpar = stream.codecpar();
+  const auto lowres_factor =
+      (codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+          ? wanted_reduction(codecpar->width, codecpar->height)
+          : 0;
+  if (!open_swcodec(lowres_factor)) {
     return false;
   }
 
@@ -493,9 +792,27 @@ bool Decoder::init_hwdec(const Stream& st) {
   if (!st.isValid() || st.isAttachedPic()) return false;
 
   const auto codec = st.codec();
+  const auto profile = st.codecpar()->profile;
+  auto& cache = HWDecoderCache::instance();
+
+  // Skip the device types that are known not to work and try the one that
+  // worked before first
+  std::vector<AVHWDeviceType> types;
+  for (auto type = av_hwdevice_iterate_types(AV_HWDEVICE_TYPE_NONE);
+       type != AV_HWDEVICE_TYPE_NONE; type = av_hwdevice_iterate_types(type)) {
+    const auto res = cache.lookup(codec->id, profile, type);
+    if (cache.deviceUnusable(type) || res == HWDecoderCache::Result::FAILS) {
+      continue;
+    }
+    if (res == HWDecoderCache::Result::WORKS) {
+      types.insert(types.begin(), type);
+    } else {
+      types.push_back(type);
+    }
+  }
+
   bool success = false;
-  auto type = AV_HWDEVICE_TYPE_NONE;
-  while ((type = av_hwdevice_iterate_types(type)) != AV_HWDEVICE_TYPE_NONE) {
+  for (const auto type : types) {
     destroy();
 
     bool hwconfig_found = false;
@@ -544,13 +861,20 @@ bool Decoder::init_hwdec(const Stream& st) {
 
     if (av_hwdevice_ctx_create(&avctx->hw_device_ctx, type, nullptr, nullptr,
                                0) < 0) {
+      cache.setDeviceUnusable(type);
       continue;
     }
 
     if (avcodec_open2(avctx, codec, nullptr) < 0) {
+      cache.store(codec->id, profile, type, false);
       continue;
     }
 
+    cache.store(codec->id, profile, type, true);
+    session.acquire();
+    filter_threads =
+        ThreadingPolicy::choose(codec, st.codecpar(), low_latency)
+            .filter_threads;
     success = true;
     break;
   }
@@ -593,6 +917,7 @@ void Decoder::flush() {
   filt_in = filt_out = nullptr;
 
   eof_state = false;
+  next_kept_pts = NAN;
 }
 
 int Decoder::decode_audio_packet(const Packet& apkt,
@@ -620,6 +945,8 @@ int Decoder::decode_audio_packet(const Packet& apkt,
         next_pts_tb = tb;
       }
 
+      if (trim_audioframe_to_seek_target(frame)) continue;
+
       filter_decoded_audioframe(frame, decoded_frames, audio_filter_src,
                                 audio_tgt);
     } else {
@@ -637,6 +964,16 @@ int Decoder::decode_audio_packet(const Packet& apkt,
 
 int Decoder::decode_video_packet(const Packet& vpkt,
                                  std::deque<Frame>& decoded_frames) {
+  update_lowres(vpkt, decoded_frames);
+  if (!avctx) return decoded_frames.size();
+
+  /* Non-reference frames that would be dropped anyway need not be decoded.
+   * Reference frames are still needed to reach the seek target. */
+  if (seek_target != AV_NOPTS_VALUE) {
+    avctx->skip_frame = packet_before_seek_target(vpkt) ? AVDISCARD_NONREF
+                                                        : AVDISCARD_DEFAULT;
+  }
+
   auto ret =
       avcodec_send_packet(avctx, vpkt.isFlush() ? nullptr : vpkt.constAvData());
   ret = 0;
@@ -652,6 +989,10 @@ int Decoder::decode_video_packet(const Packet& vpkt,
         frame->pts = frame->best_effort_timestamp;
       }
 
+      // Before download, filtering and upload
+      if (videoframe_before_seek_target(frame)) continue;
+      if (decimate_videoframe(frame)) continue;
+
       if (isHW) {
         ScopeManager<Frame> dm(downloaded_frame);
         auto const dst = downloaded_frame.av();
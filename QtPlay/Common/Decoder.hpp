@@ -6,6 +6,7 @@
 #include "../AVWrappers/Subtitle.hpp"
 #include "../Widgets/LoggerWidget.hpp"
 #include "AudioParams.hpp"
+#include "ThreadingPolicy.hpp"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -14,6 +15,7 @@ extern "C" {
 }
 
 #include <QtGlobal>
+#include <atomic>
 #include <deque>
 
 struct Decoder {
@@ -30,6 +32,32 @@ struct Decoder {
   AVRational start_pts_tb = {}, next_pts_tb = {};
   static constexpr int extra_hwframes = 1;
 
+  // Video frame decimation: frames that would never reach the screen are
+  // dropped right after decoding, before download, filtering and upload
+  double min_frame_interval = 0.0, next_kept_pts = NAN;
+
+  // Reduced resolution output: lowres decoding where the codec supports it,
+  // otherwise a scaler in the filtergraph. Both use power-of-two factors.
+  int display_w = 0, display_h = 0, lowres = 0, scale_shift = 0;
+
+  /* Accurate seeking: output before this pts (AV_TIME_BASE units) is dropped
+   * as early as possible. Survives flush(), as it is set before the decoding
+   * thread flushes after a seek. */
+  std::atomic<int64_t> seek_target = AV_NOPTS_VALUE;
+
+  /* Audio tempo, e.g. to catch up with a live stream. The filtergraph runs
+   * atempo at graph_tempo; its output timestamps, which advance in real time
+   * from tempo_origin, are mapped back to media time. */
+  std::atomic<double> tempo = 1.0;
+  double graph_tempo = 1.0, tempo_origin = NAN;
+
+  // Threading, see ThreadingPolicy
+  bool low_latency = false;
+  // One thread, outside of the shared sessions, e.g. for a scanning worker
+  bool single_thread = false;
+  int filter_threads = 0;  // 0 lets libavfilter decide
+  ThreadingPolicy::SessionLease session;
+
   // Filtering context
   int last_w = 0, last_h = 0;
   AVPixelFormat last_format = (AVPixelFormat)-2;
@@ -46,6 +74,19 @@ struct Decoder {
                                  AudioParams& audio_filter_src,
                                  const AudioParams& audio_tgt);
   void destroy();
+  void swapWith(Decoder& other);
+  void setMinFrameInterval(double interval);
+  void setDisplaySize(int w, int h);
+  void setLowLatency(bool enable);
+  void setSeekTarget(int64_t target);
+  void setTempo(double value);
+  bool packet_before_seek_target(const Packet& pkt) const;
+  bool videoframe_before_seek_target(const AVFrame* frame);
+  bool trim_audioframe_to_seek_target(AVFrame* frame);
+  int wanted_reduction(int src_w, int src_h) const;
+  void update_lowres(const Packet& vpkt, std::deque<Frame>& decoded_frames);
+  bool decimate_videoframe(const AVFrame* frame);
+  bool open_swcodec(int lowres_factor);
   bool init_swdec(const Stream& st);
   bool init_hwdec(const Stream& st);
   bool init(const Stream& st);
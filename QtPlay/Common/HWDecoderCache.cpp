@@ -0,0 +1,95 @@
+#include "HWDecoderCache.hpp"
+
+#include "PlayerSettings.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <QSettings>
+
+static constexpr auto cache_path = "Settings/HWDecoderCache.ini";
+
+static QString versionGroup() {
+  return QString("avcodec_%1").arg(avcodec_version());
+}
+
+static QString entryName(AVCodecID codec, int profile, AVHWDeviceType type) {
+  return QString("%1_%2_%3")
+      .arg(avcodec_get_name(codec))
+      .arg(profile)
+      .arg(av_hwdevice_get_type_name(type));
+}
+
+HWDecoderCache::HWDecoderCache()
+    : persistent(PlayerSettings::get().hwdec_persistent_cache) {
+  if (persistent) load();
+}
+
+HWDecoderCache& HWDecoderCache::instance() {
+  static HWDecoderCache inst;
+  return inst;
+}
+
+void HWDecoderCache::load() {
+  QSettings sets(cache_path, QSettings::IniFormat);
+  // Drop the results gathered with other library versions
+  for (const auto& grp : sets.childGroups()) {
+    if (grp != versionGroup()) sets.remove(grp);
+  }
+
+  sets.beginGroup(versionGroup());
+  // Device failures are probed again in every run, none are loaded
+  sets.remove("Devices");
+
+  sets.beginGroup("Decoders");
+  const auto keys = sets.childKeys();
+  for (auto type = av_hwdevice_iterate_types(AV_HWDEVICE_TYPE_NONE);
+       type != AV_HWDEVICE_TYPE_NONE; type = av_hwdevice_iterate_types(type)) {
+    const QString suffix = QString("_") + av_hwdevice_get_type_name(type);
+    for (const auto& key : keys) {
+      if (!key.endsWith(suffix)) continue;
+      const auto parts = key.chopped(suffix.size()).split('_');
+      if (parts.size() < 2) continue;
+      const auto codec_name = parts.mid(0, parts.size() - 1).join('_');
+      const auto desc =
+          avcodec_descriptor_get_by_name(codec_name.toUtf8().constData());
+      bool profile_ok = false;
+      const auto profile = parts.back().toInt(&profile_ok);
+      if (!desc || !profile_ok) continue;
+      results[{desc->id, profile, type}] = sets.value(key, false).toBool();
+    }
+  }
+  sets.endGroup();
+  sets.endGroup();
+}
+
+HWDecoderCache::Result HWDecoderCache::lookup(AVCodecID codec, int profile,
+                                              AVHWDeviceType type) const {
+  std::scoped_lock lck(mtx);
+  const auto it = results.find({codec, profile, type});
+  if (it == results.end()) return Result::UNKNOWN;
+  return it->second ? Result::WORKS : Result::FAILS;
+}
+
+void HWDecoderCache::store(AVCodecID codec, int profile, AVHWDeviceType type,
+                           bool works) {
+  std::scoped_lock lck(mtx);
+  results[{codec, profile, type}] = works;
+  if (persistent) {
+    QSettings sets(cache_path, QSettings::IniFormat);
+    sets.setValue(versionGroup() + "/Decoders/" +
+                      entryName(codec, profile, type),
+                  works);
+  }
+}
+
+bool HWDecoderCache::deviceUnusable(AVHWDeviceType type) const {
+  std::scoped_lock lck(mtx);
+  return unusable_devices.contains(type);
+}
+
+void HWDecoderCache::setDeviceUnusable(AVHWDeviceType type) {
+  std::scoped_lock lck(mtx);
+  unusable_devices.insert(type);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/codec_id.h>
+#include <libavutil/hwcontext.h>
+}
+
+#include <QtGlobal>
+#include <map>
+#include <mutex>
+#include <set>
+#include <tuple>
+
+/* Remembers which (codec, profile, device type) combinations could be opened
+ * as hardware decoders, so that hopeless devices are not probed on every
+ * stream open. Results live for the process lifetime and, if enabled in
+ * PlayerSettings, are persisted in Settings/HWDecoderCache.ini. The on-disk
+ * entries are keyed by the libavcodec version, so a library upgrade starts
+ * from scratch. Device creation failures are only kept for the process
+ * lifetime: they may be transient, or fixed by a driver installed later,
+ * neither of which the library version would tell. Thread-safe. */
+class HWDecoderCache final {
+  Q_DISABLE_COPY_MOVE(HWDecoderCache);
+  HWDecoderCache();
+
+ public:
+  enum class Result { UNKNOWN, WORKS, FAILS };
+
+  static HWDecoderCache& instance();
+
+  Result lookup(AVCodecID codec, int profile, AVHWDeviceType type) const;
+  void store(AVCodecID codec, int profile, AVHWDeviceType type, bool works);
+  // Device creation failures do not depend on the codec; not persisted
+  bool deviceUnusable(AVHWDeviceType type) const;
+  void setDeviceUnusable(AVHWDeviceType type);
+
+ private:
+  using Key = std::tuple<int, int, int>;
+
+  mutable std::mutex mtx;
+  std::map<Key, bool> results;
+  std::set<int> unusable_devices;
+  const bool persistent = false;
+
+  void load();
+};
@@ -53,6 +53,16 @@ bool PacketQueue::put_nullpacket(int stream_index, bool eof) {
   return put(pkt);
 }
 
+/* Drains the decoder, which is then replaced by the pending one */
+bool PacketQueue::put_stream_change(int stream_index) {
+  if (stream_index < 0) return false;
+  Packet pkt;
+  pkt.setFlush(true);
+  pkt.setStreamChange(true);
+  pkt.avData()->stream_index = stream_index;
+  return put(pkt);
+}
+
 bool PacketQueue::get(Packet& dst) {
   dst.clear();
   std::unique_lock lck(mtx);
@@ -28,8 +28,10 @@ class PacketQueue final {
   ~PacketQueue();
   inline bool isFullNolock() const { return state.nb_packets == m_data.size(); }
   inline bool isEmptyNolock() const { return state.nb_packets == 0; }
+  inline int capacity() const { return (int)m_data.size(); }
   bool put(Packet& packet);
   bool put_nullpacket(int stream_index, bool eof = false);
+  bool put_stream_change(int stream_index);
   bool get(Packet& dst);
   void flush();
   QueueState getState() const;
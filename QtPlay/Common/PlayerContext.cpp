@@ -1,16 +1,24 @@
 #include "PlayerContext.hpp"
 
 #include "../Demux/DemuxThread.hpp"
+#include "../Video/Scrubber.hpp"
+#include "../Widgets/VideoDisplayWidget.hpp"
 #include "../Widgets/QtPlayGUI.hpp"
 #include "../Widgets/Playlist.hpp"
 
+#include <algorithm>
+#include <utility>
+
 PlayerContext::PlayerContext(const std::string& url, std::float_t audio_volume,
                              std::vector<VisCommon*> aviss)
     : filename(url), volume_percent(audio_volume), audio_viss(aviss) {
   (read_tid = std::make_unique<DemuxThread>(*this))->start(false);
 }
 
-PlayerContext::~PlayerContext() { read_tid = nullptr; }
+PlayerContext::~PlayerContext() {
+  read_tid = nullptr;
+  scrubber = nullptr;
+}
 
 double PlayerContext::best_clkval() const {
   const auto vidclk_val = vidclk.get();
@@ -22,21 +30,56 @@ double PlayerContext::best_clkval() const {
   return vidclk_val;
 }
 
-void PlayerContext::request_seek(bool by_incr, double val) {
-  std::unique_lock lck(seek_mutex, std::try_to_lock);
-  if (lck.owns_lock()) {
+/* The demux thread only holds seek_mutex to take the pending request, so
+ * requests are never dropped. Relative seeks that arrive before the pending
+ * one is taken add up, anything else replaces it. */
+void PlayerContext::request_seek(bool by_incr, double val, bool fast) {
+  std::scoped_lock lck(seek_mutex);
+  if (by_incr && seek_req && seek_info.seek_type == SeekInfo::SEEK_INCR) {
+    seek_info.incr_or_percent += val;
+    seek_info.fast = seek_info.fast && fast;
+  } else {
     seek_info.set_seek(by_incr ? SeekInfo::SEEK_INCR : SeekInfo::SEEK_PERCENT,
-                       val);
-    seek_req = true;
+                       val, 0, fast);
   }
+  seek_req = true;
+  if (seek_in_progress) seek_interrupt = true;
+  trick_request = 0;
+  continue_read_thread.notify_one();
+}
+
+void PlayerContext::request_seek_to(double pos, bool fast) {
+  std::scoped_lock lck(seek_mutex);
+  seek_info.set_seek(SeekInfo::SEEK_TIME, pos, 0, fast);
+  seek_req = true;
+  if (seek_in_progress) seek_interrupt = true;
+  trick_request = 0;
+  continue_read_thread.notify_one();
 }
 
 void PlayerContext::request_stream_cycle(AVMediaType type) {
-  std::unique_lock lck(seek_mutex, std::try_to_lock);
-  if (lck.owns_lock()) {
-    seek_info.set_stream_switch(type, -1);
-    seek_req = true;
+  std::scoped_lock lck(seek_mutex);
+  seek_info.set_stream_switch(type, -1);
+  seek_req = true;
+  trick_request = 0;
+  continue_read_thread.notify_one();
+}
+
+// One step along -64x ... -8x, normal playback, 8x ... 64x
+void PlayerContext::step_trick_speed(bool faster) {
+  // Slowing down is the same as speeding up in the other direction
+  const auto dir = faster ? 1 : -1;
+  const auto speed = trick_request * dir;
+  auto next = 0;
+  if (speed > 0) {
+    next = std::min(speed * 2, max_trick_speed);
+  } else if (speed == 0) {
+    next = min_trick_speed;
+  } else if (speed < -min_trick_speed) {
+    next = speed / 2;
   }
+  trick_request = next * dir;
+  continue_read_thread.notify_one();
 }
 
 void PlayerContext::toggle_pause() {
@@ -45,8 +88,80 @@ void PlayerContext::toggle_pause() {
   }
 }
 
+void PlayerContext::step_frame(bool backward) {
+  if (!read_tid || !read_tid->isRunning()) return;
+  if (!read_tid->getPauseStatus()) read_tid->trySetPause(true);
+  reverse_playback = false;
+  frame_steps += backward ? -1 : 1;
+}
+
+// Reverse playback runs while paused, so it pauses the playback too
+void PlayerContext::toggle_reverse() {
+  if (!read_tid || !read_tid->isRunning()) return;
+  reverse_playback = !reverse_playback;
+  frame_steps = 0;
+  if (reverse_playback && !read_tid->getPauseStatus())
+    read_tid->trySetPause(true);
+}
+
+bool PlayerContext::scrub_to(double percent) {
+  if (!read_tid || !read_tid->isRunning() || trick_speed) return false;
+
+  // The scrubber is kept for the next drag, unless the input changed
+  const auto url = currentURL();
+  if (!scrubber || scrubber->url() != url) {
+    scrubber = std::make_unique<Scrubber>(
+        url, video_stream, playerGUI.videoWidget()->getVideoOutput());
+  }
+  if (scrubber->failed()) return false;
+
+  if (!scrubbing) {
+    scrubbing = true;
+    resume_after_scrub = !read_tid->getPauseStatus();
+    if (resume_after_scrub) read_tid->trySetPause(true);
+  }
+  scrubber->show(percent);
+
+  return true;
+}
+
+bool PlayerContext::end_scrub(double percent) {
+  if (!scrubbing) return false;
+  scrubbing = false;
+  if (scrubber) scrubber->stop();
+
+  seek_by_percent(percent, false);
+  if (resume_after_scrub && read_tid && read_tid->isRunning())
+    read_tid->trySetPause(false);
+
+  return true;
+}
+
 void PlayerContext::toggle_mute() { muted = !muted; }
 
+void PlayerContext::toggle_recording() {
+  recording_wanted = !recording_wanted;
+  continue_read_thread.notify_one();
+}
+
+double PlayerContext::msSinceOpen() const {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - open_time)
+      .count();
+}
+
+void PlayerContext::reportFirstAudio() {
+  if (!first_audio_reported.exchange(true)) {
+    qtplay::logMsg("Time to first audio: %.1f ms", msSinceOpen());
+  }
+}
+
+void PlayerContext::reportFirstFrame() {
+  if (!first_frame_reported.exchange(true)) {
+    qtplay::logMsg("Time to first frame: %.1f ms", msSinceOpen());
+  }
+}
+
 void PlayerContext::seek_by_incr(double incr) {
   if (std::fabs(incr) < 0.1)  // Avoid meaningless seeking
     return;
@@ -54,10 +169,55 @@ void PlayerContext::seek_by_incr(double incr) {
   request_seek(true, incr);
 }
 
-void PlayerContext::seek_by_percent(double percent) {
-  request_seek(false, percent);
+void PlayerContext::seek_by_percent(double percent, bool fast) {
+  request_seek(false, percent, fast);
+}
+
+void PlayerContext::notifyEOF() {
+  // Called on every demuxer iteration once the threads are done
+  if (!eof_notified.exchange(true)) playerGUI.playlist()->playNext();
+}
+
+void PlayerContext::setNextURL(const std::string& url) {
+  std::scoped_lock lck(next_url_mutex);
+  next_url = url;
+}
+
+std::string PlayerContext::takeNextURL() {
+  std::scoped_lock lck(next_url_mutex);
+  return std::exchange(next_url, std::string());
+}
+
+// The demux thread changes the filename when it chains to the next item
+std::string PlayerContext::currentURL() {
+  std::scoped_lock lck(next_url_mutex);
+  return filename;
+}
+
+/* Called by a decoding thread on the marker packet, once the decoder has been
+ * drained */
+void PlayerContext::switchToNextDecoder(AVMediaType type) {
+  const auto audio = type == AVMEDIA_TYPE_AUDIO;
+  auto& pending = audio ? pending_audio_switch : pending_video_switch;
+  if (!pending) return;
+
+  auto& dec = audio ? auddec : viddec;
+  auto& next = audio ? next_auddec : next_viddec;
+  dec.swapWith(next);
+  next.destroy();
+  pending = false;
+
+  // Whichever stream gets there first moves the timeline to the new item
+  if (!item_switched.exchange(true)) {
+    timeline_offset = next_timeline_offset.load();
+    stream_duration = next_duration.load();
+    playerGUI.playlist()->advanceToNext();
+  }
 }
 
-void PlayerContext::notifyEOF(){ 
-    playerGUI.playlist()->playNext();
+/* A seek flushes the queues along with the markers still in them. The
+ * decoding threads must be paused. */
+void PlayerContext::completePendingSwitches() {
+  switchToNextDecoder(AVMEDIA_TYPE_AUDIO);
+  switchToNextDecoder(AVMEDIA_TYPE_VIDEO);
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "../AVWrappers/Stream.hpp"
 #include "../AVWrappers/Subtitle.hpp"
 #include "../Audio/AudioBuffer.hpp"
+#include "../Demux/BufferingController.hpp"
 #include "../Demux/SeekInfo.hpp"
 #include "../VideoOutput/GLWindow.hpp"
 #include "../Visualizations/VisCommon.hpp"
@@ -17,7 +18,9 @@
 #include "QtPlayCommon.hpp"
 
 #include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
 
 struct PlayerContext final {
   Q_DISABLE_COPY_MOVE(PlayerContext);
@@ -25,7 +28,7 @@ struct PlayerContext final {
 
   std::unique_ptr<CThread> read_tid = nullptr;
   std::vector<Stream> m_streams;
-  std::string filename;
+  std::string filename;  // Changed under next_url_mutex, see currentURL()
   int last_video_stream = -1, last_audio_stream = -1, last_subtitle_stream = -1;
   std::condition_variable continue_read_thread;
 
@@ -33,10 +36,50 @@ struct PlayerContext final {
   std::mutex seek_mutex;
   bool seek_req = false;
   SeekInfo seek_info;
+  /* A new request while a seek is in progress interrupts it through the
+   * demuxer's interrupt callback. Both are only changed under seek_mutex. */
+  std::atomic_bool seek_in_progress = false, seek_interrupt = false;
   int64_t last_seek_pos = 0LL, last_seek_rel = 0LL;
   std::atomic<double> stream_duration = NAN;
   int seek_by_bytes = -1;
   std::atomic_bool demuxer_eof = false;
+  // Set from the UI, the demux thread starts or stops the recorder to match
+  std::atomic_bool recording_wanted = false;
+  BufferingController buffering;  // Fed by the demux thread
+
+  /* Trick play: only video keyframes are shown, at this multiple of the
+   * normal speed, backwards if negative; 0 is normal playback. The UI sets
+   * the request, which the demux thread applies to trick_speed. */
+  static constexpr int min_trick_speed = 8, max_trick_speed = 64;
+  std::atomic_int trick_request = 0, trick_speed = 0;
+  /* Frame steps for the video thread to take while paused, backwards if
+   * negative. Under reverse playback, it steps back at the frame rate. */
+  std::atomic_int frame_steps = 0;
+  std::atomic_bool reverse_playback = false;
+
+  /* Live scrubbing with the seek slider, UI thread only. The playback is
+   * paused while the slider is dragged and resumed once it is released. */
+  std::unique_ptr<class Scrubber> scrubber;
+  bool scrubbing = false, resume_after_scrub = false;
+
+  // Startup latency, measured from the creation of the context
+  const std::chrono::steady_clock::time_point open_time =
+      std::chrono::steady_clock::now();
+  std::atomic_bool first_audio_reported = false, first_frame_reported = false;
+
+  /* Gapless playback: the next playlist item is opened and its decoders are
+   * primed by the demux thread ahead of time. The decoding threads switch
+   * over when they reach the marker packet queued at the end of the current
+   * item. pts_offset keeps the timestamps of the chained inputs continuous,
+   * timeline_offset is subtracted from the clock for display. */
+  std::mutex next_url_mutex;
+  std::string next_url;
+  Decoder next_auddec, next_viddec;
+  std::atomic_bool pending_audio_switch = false, pending_video_switch = false,
+                   item_switched = true, eof_notified = false;
+  std::atomic<double> timeline_offset = 0.0, next_timeline_offset = 0.0,
+                      next_duration = NAN;
+  int64_t pts_offset = 0LL;  // AV_TIME_BASE units, demux thread only
 
   Clock audclk;
   Clock vidclk;
@@ -73,14 +116,34 @@ struct PlayerContext final {
   ~PlayerContext();
 
   double best_clkval() const;
-  void request_seek(bool by_incr, double val);
+  void request_seek(bool by_incr, double val, bool fast = false);
+  // AVMEDIA_TYPE_UNKNOWN switches to the next program
   void request_stream_cycle(AVMediaType type);
+  // To a clock value, landing on the keyframe at or before it if 'fast'
+  void request_seek_to(double pos, bool fast);
+  void step_trick_speed(bool faster);
+  // Pauses the playback if needed, then shows the next or previous frame
+  void step_frame(bool backward);
+  void toggle_reverse();
+  // Returns false if the input cannot be scrubbed
+  bool scrub_to(double percent);
+  // Seeks precisely to where the slider was released; false if not scrubbing
+  bool end_scrub(double percent);
   void seek_by_incr(double incr);
-  void seek_by_percent(double percent);
+  void seek_by_percent(double percent, bool fast = false);
   void toggle_pause();
   void toggle_mute();
+  void toggle_recording();
 
   void notifyEOF();
+  void setNextURL(const std::string& url);
+  std::string takeNextURL();
+  std::string currentURL();
+  void switchToNextDecoder(AVMediaType type);
+  void completePendingSwitches();
+  double msSinceOpen() const;
+  void reportFirstAudio();
+  void reportFirstFrame();
   bool demuxerEOF() const { return demuxer_eof.load(std::memory_order_acquire); }
   void setDemuxerEOF(bool eof) { demuxer_eof.store(eof, std::memory_order_release); }
 };
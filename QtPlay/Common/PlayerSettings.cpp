@@ -0,0 +1,50 @@
+#include "PlayerSettings.hpp"
+
+#include <QSettings>
+
+PlayerSettings::PlayerSettings() {
+  QSettings sets("Settings/Player.ini", QSettings::IniFormat);
+  reduced_resolution =
+      sets.value("Video/ReducedResolution", reduced_resolution).toBool();
+  buffer_max_mb = sets.value("Input/BufferMaxMB", buffer_max_mb).toInt();
+  dual_demuxer = sets.value("Input/DualDemuxer", dual_demuxer).toInt();
+  abr = sets.value("Input/Abr", abr).toBool();
+  http_cache_mb = sets.value("Input/HttpCacheMB", http_cache_mb).toInt();
+  memory_map = sets.value("Input/MemoryMap", memory_map).toBool();
+  readahead_kb = sets.value("Input/ReadAheadKB", readahead_kb).toInt();
+  readahead_back_kb =
+      sets.value("Input/BackBufferKB", readahead_back_kb).toInt();
+  gapless = sets.value("Playback/Gapless", gapless).toBool();
+  keyframe_index =
+      sets.value("Seeking/KeyframeIndex", keyframe_index).toBool();
+  accurate_seek = sets.value("Seeking/Accurate", accurate_seek).toBool();
+  fast_scrubbing =
+      sets.value("Seeking/FastScrubbing", fast_scrubbing).toBool();
+  live_scrubbing =
+      sets.value("Seeking/LiveScrubbing", live_scrubbing).toBool();
+  history_seconds =
+      sets.value("Seeking/HistorySeconds", history_seconds).toInt();
+  history_alt_tracks =
+      sets.value("Seeking/HistoryAltTracks", history_alt_tracks).toBool();
+  gop_cache_mb = sets.value("Seeking/GopCacheMB", gop_cache_mb).toInt();
+  thumbnails = sets.value("Thumbnails/Enabled", thumbnails).toBool();
+  thumbnail_width = sets.value("Thumbnails/Width", thumbnail_width).toInt();
+  thumbnail_disk_cache =
+      sets.value("Thumbnails/DiskCache", thumbnail_disk_cache).toBool();
+  waveform_overview =
+      sets.value("Thumbnails/WaveformOverview", waveform_overview).toBool();
+  timeshift_minutes =
+      sets.value("Timeshift/Minutes", timeshift_minutes).toInt();
+  timeshift_catchup =
+      sets.value("Timeshift/CatchUpSpeed", timeshift_catchup).toDouble();
+  record_dir = sets.value("Recording/Directory", record_dir).toString();
+  low_latency = sets.value("Decoding/LowLatency", low_latency).toBool();
+  hwdec_persistent_cache =
+      sets.value("HWDecoding/PersistentProbeCache", hwdec_persistent_cache)
+          .toBool();
+}
+
+const PlayerSettings& PlayerSettings::get() {
+  static const PlayerSettings inst;
+  return inst;
+}
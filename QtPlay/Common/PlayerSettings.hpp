@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+
+/* Playback tuning options. Loaded once from Settings/Player.ini, read-only
+ * afterwards, so it is safe to access from any thread. */
+struct PlayerSettings final {
+  Q_DISABLE_COPY_MOVE(PlayerSettings);
+
+  // Video
+  bool reduced_resolution = true;  // Decode/scale down to the display size
+
+  // Input
+  bool memory_map = true;            // Map local files instead of reading
+  int readahead_kb = 16 * 1024;      // Read-ahead buffer, 0 disables it
+  int readahead_back_kb = 2 * 1024;  // Part of it kept behind for seeks
+  int buffer_max_mb = 200;           // Upper bound of the packet queues
+  int dual_demuxer = 1;              // Audio demuxer: 0 off, 1 auto, 2 on
+  bool abr = true;                   // Adapt HLS/DASH variants to bandwidth
+  int http_cache_mb = 0;             // Disk cache of HTTP inputs, 0 disables
+
+  // Playback
+  bool gapless = true;  // Pre-open the next playlist item and chain to it
+
+  // Seeking
+  bool keyframe_index = true;       // Build/use keyframe indexes where useful
+  bool accurate_seek = true;        // Decode up to the exact seek target
+  bool fast_scrubbing = true;       // Keyframe seeks while dragging the slider
+  bool live_scrubbing = true;       // Show keyframes decoded apart instead
+  int history_seconds = 30;         // Played packets kept for short seeks
+  bool history_alt_tracks = false;  // And unplayed audio/subtitles
+  int gop_cache_mb = 512;           // Decoded frames kept for stepping back
+
+  // Seek slider
+  bool thumbnails = true;            // Shown when hovering the slider
+  int thumbnail_width = 160;         // In pixels
+  bool thumbnail_disk_cache = true;  // Kept for local files
+  bool waveform_overview = true;     // Audio peaks behind it, local files
+
+  // Timeshift (live inputs)
+  int timeshift_minutes = 0;       // Recorded on disk, 0 disables timeshift
+  double timeshift_catchup = 1.5;  // Speed back to the live edge, up to 2
+
+  // Recording
+  QString record_dir;  // Where recordings go, the videos folder if empty
+
+  // Decoding
+  bool low_latency = false;  // Prefer slice threading, no frame delay
+
+  // Hardware decoding
+  bool hwdec_persistent_cache = false;  // Keep probe results across runs
+
+  static const PlayerSettings& get();
+
+ private:
+  PlayerSettings();
+};
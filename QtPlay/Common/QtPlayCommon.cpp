@@ -1,7 +1,13 @@
 #include "QtPlayCommon.hpp"
 
+#include <atomic>
+
 double qtplay::gettime() noexcept {
   using namespace std::chrono;
   return duration<double>(high_resolution_clock::now().time_since_epoch())
       .count();
 }
+
+int qtplay::interrupt_on_flag(void* opaque) {
+  return static_cast<int>(ptr_cast<std::atomic_bool>(opaque)->load());
+}
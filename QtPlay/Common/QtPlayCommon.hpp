@@ -23,4 +23,7 @@ inline void sleep_ms(int ms) { std::this_thread::sleep_for(time_ms(ms)); }
 inline auto clk_now() { return steady_clock::now(); }
 void logMsg(QAnyStringView fmt, ...);
 double gettime() noexcept;
+/* Interrupt callback of the inputs opened on background threads: 'opaque'
+ * is the std::atomic_bool that cancels their I/O */
+int interrupt_on_flag(void* opaque);
 }  // namespace qtplay
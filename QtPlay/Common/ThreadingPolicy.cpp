@@ -0,0 +1,69 @@
+#include "ThreadingPolicy.hpp"
+
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+
+static std::atomic_int active_sessions = 0;
+
+void ThreadingPolicy::SessionLease::acquire() {
+  if (!held) {
+    ++active_sessions;
+    held = true;
+  }
+}
+
+void ThreadingPolicy::SessionLease::release() {
+  if (held) {
+    --active_sessions;
+    held = false;
+  }
+}
+
+int ThreadingPolicy::activeSessions() { return active_sessions; }
+
+// More threads than this stop paying off for the given frame size, as
+// slices/frames become too small to split further
+static int useful_threads(int w, int h) {
+  const auto pixels = (long long)w * h;
+  if (pixels <= 0) return 4;
+  if (pixels <= 720 * 576) return 2;
+  if (pixels <= 1280 * 720) return 4;
+  if (pixels <= 1920 * 1080) return 8;
+  return 16;
+}
+
+ThreadingPolicy::Plan ThreadingPolicy::choose(const AVCodec* codec,
+                                              const AVCodecParameters* par,
+                                              bool low_latency) {
+  Plan plan;
+  if (!codec || !par || par->codec_type != AVMEDIA_TYPE_VIDEO) return plan;
+
+  const auto cores = std::max(QThread::idealThreadCount(), 1);
+  const auto budget = std::max(cores / std::max(activeSessions(), 1), 1);
+
+  // Leave about a quarter of the share to the filtergraph
+  plan.filter_threads = std::max(budget / 4, 1);
+  const auto dec_budget = std::max(budget - plan.filter_threads, 1);
+  const auto wanted =
+      std::min(dec_budget, useful_threads(par->width, par->height));
+
+  const bool can_frame = codec->capabilities & AV_CODEC_CAP_FRAME_THREADS;
+  const bool can_slice = codec->capabilities & AV_CODEC_CAP_SLICE_THREADS;
+  if (low_latency && can_slice) {
+    plan.thread_type = FF_THREAD_SLICE;
+  } else if (can_frame) {
+    // Slice threading remains available to the codec as a fallback
+    plan.thread_type = FF_THREAD_FRAME | (can_slice ? FF_THREAD_SLICE : 0);
+  } else if (can_slice) {
+    plan.thread_type = FF_THREAD_SLICE;
+  }
+
+  plan.thread_count = plan.thread_type ? wanted : 1;
+  if (low_latency && !(plan.thread_type & FF_THREAD_SLICE)) {
+    // Frame threading only: keep the delay short
+    plan.thread_count = std::min(plan.thread_count, 2);
+  }
+
+  return plan;
+}
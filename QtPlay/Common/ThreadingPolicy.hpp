@@ -0,0 +1,39 @@
+#pragma once
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <QtGlobal>
+
+/* Chooses the decoder threading type and the thread counts of a decoder and
+ * its filtergraph. The cores are shared between all active video decoding
+ * sessions of the process, and a part of each share is reserved for the
+ * filtergraph. */
+namespace ThreadingPolicy {
+struct Plan {
+  int thread_count = 1;
+  int thread_type = 0;     // FF_THREAD_FRAME and/or FF_THREAD_SLICE
+  int filter_threads = 1;  // Filtergraph/scaler threads
+};
+
+/* A video decoding session counted for sharing the cores. Holding the lease
+ * is idempotent, so a decoder can just acquire it each time it (re)opens. */
+class SessionLease final {
+  Q_DISABLE_COPY_MOVE(SessionLease);
+  bool held = false;
+
+ public:
+  SessionLease() = default;
+  ~SessionLease() { release(); }
+  void acquire();
+  void release();
+};
+
+int activeSessions();
+
+// Frame threading delays output by one frame per thread, so low latency mode
+// prefers slice threading
+Plan choose(const AVCodec* codec, const AVCodecParameters* par,
+            bool low_latency);
+}  // namespace ThreadingPolicy
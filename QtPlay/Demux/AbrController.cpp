@@ -0,0 +1,222 @@
+#include "AbrController.hpp"
+
+#include "../Common/QtPlayCommon.hpp"
+
+extern "C" {
+#include <libavutil/dict.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+#include <algorithm>
+#include <cstdlib>
+
+struct AbrController::MeteredIO {
+  AbrController* abr = nullptr;
+  AVIOContext* inner = nullptr;
+  int64_t bytes = 0;     // Not sampled yet
+  double seconds = 0.0;  // Spent waiting for them
+};
+
+void AbrController::attach(AVFormatContext* ic) {
+  default_io_open = ic->io_open;
+  default_io_close = ic->io_close2;
+  ic->opaque = this;
+  ic->io_open = io_open;
+  ic->io_close2 = io_close;
+}
+
+bool AbrController::init(AVFormatContext* ic) {
+  variants.clear();
+  cur = -1;
+
+  auto bitrate_of = [](const AVDictionary* metadata) -> int64_t {
+    const auto e = av_dict_get(metadata, "variant_bitrate", nullptr, 0);
+    return e ? std::strtoll(e->value, nullptr, 10) : 0;
+  };
+
+  // HLS: a program per variant, which may share its audio with others
+  for (auto i = 0u; i < ic->nb_programs; ++i) {
+    const auto program = ic->programs[i];
+    Variant v;
+    if ((v.bitrate = bitrate_of(program->metadata)) <= 0) continue;
+
+    auto first_audio = -1;
+    for (auto j = 0u; j < program->nb_stream_indexes; ++j) {
+      const int idx = program->stream_index[j];
+      const auto st = ic->streams[idx];
+      v.streams.push_back(idx);
+      if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && v.video < 0 &&
+          !(st->disposition & AV_DISPOSITION_ATTACHED_PIC))
+        v.video = idx;
+      if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO && first_audio < 0)
+        first_audio = idx;
+    }
+    v.audio = v.video >= 0 ? av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO, -1,
+                                                 v.video, nullptr, 0)
+                           : first_audio;
+    if (v.audio < 0) v.audio = -1;
+    if (v.video >= 0 || v.audio >= 0) variants.push_back(std::move(v));
+  }
+
+  // DASH: a stream per video representation, audio is left as it is
+  if (variants.size() < 2) {
+    variants.clear();
+    for (auto i = 0; i < (int)ic->nb_streams; ++i) {
+      const auto st = ic->streams[i];
+      Variant v;
+      if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO ||
+          (st->disposition & AV_DISPOSITION_ATTACHED_PIC) ||
+          (v.bitrate = bitrate_of(st->metadata)) <= 0)
+        continue;
+      v.video = i;
+      v.streams.push_back(i);
+      variants.push_back(std::move(v));
+    }
+  }
+
+  if (variants.size() < 2) {
+    variants.clear();
+    return false;
+  }
+
+  std::stable_sort(
+      variants.begin(), variants.end(),
+      [](const Variant& a, const Variant& b) { return a.bitrate < b.bitrate; });
+
+  return true;
+}
+
+int AbrController::find(int stream_index) const {
+  if (stream_index < 0) return -1;
+  for (auto i = 0; i < (int)variants.size(); ++i) {
+    const auto& v = variants[i];
+    if (v.video >= 0 ? v.video == stream_index : v.audio == stream_index)
+      return i;
+  }
+
+  return -1;
+}
+
+void AbrController::setCurrent(int index) {
+  cur = index;
+  last_switch = qtplay::gettime();
+}
+
+void AbrController::add_sample(int64_t bytes, double seconds) {
+  if (bytes < min_sample_bytes || seconds <= 0.0) return;
+
+  // Exponentially weighted by the time each sample took
+  const auto bits_per_s = bytes * 8.0 / seconds;
+  auto ewma = [&](double& estimate, double half_life) {
+    const auto alpha = std::pow(0.5, seconds / half_life);
+    estimate = alpha * estimate + (1.0 - alpha) * bits_per_s;
+  };
+  ewma(fast_estimate, fast_half_life);
+  ewma(slow_estimate, slow_half_life);
+  sampled_seconds += seconds;
+}
+
+double AbrController::throughput() const {
+  if (sampled_seconds <= 0.0) return 0.0;
+
+  // Both averages start at zero, which the first samples must not drag down
+  auto unbiased = [this](double estimate, double half_life) {
+    return estimate / (1.0 - std::pow(0.5, sampled_seconds / half_life));
+  };
+  return std::min(unbiased(fast_estimate, fast_half_life),
+                  unbiased(slow_estimate, slow_half_life));
+}
+
+int AbrController::pick(double buffered_seconds) {
+  const auto estimate = throughput();
+  if (variants.empty() || estimate <= 0.0) return cur;
+
+  // The highest variant the throughput sustains with a margin
+  constexpr auto safety = 0.8;
+  auto target = 0;
+  for (auto i = 0; i < (int)variants.size(); ++i) {
+    if (variants[i].bitrate <= estimate * safety) target = i;
+  }
+  if (cur < 0 || std::isnan(buffered_seconds)) return target;
+
+  // Buffer health, in seconds queued ahead of playback
+  constexpr auto low_buffer = 5.0, healthy_buffer = 8.0, high_buffer = 20.0;
+  constexpr auto down_interval = 2.0, up_interval = 10.0;
+  const auto since_switch = qtplay::gettime() - last_switch;
+  if (target < cur && since_switch >= down_interval) {
+    // A large buffer rides out a dip, a small one must not run dry
+    const auto sustained = variants[cur].bitrate <= estimate;
+    if (buffered_seconds < low_buffer ||
+        (!sustained && buffered_seconds < high_buffer))
+      return target;
+  } else if (target > cur && since_switch >= up_interval &&
+             buffered_seconds >= healthy_buffer) {
+    return cur + 1;  // One step at a time
+  }
+
+  return cur;
+}
+
+int AbrController::io_open(AVFormatContext* s, AVIOContext** pb,
+                           const char* url, int flags,
+                           AVDictionary** options) {
+  const auto abr = static_cast<AbrController*>(s->opaque);
+  const auto ret = abr->default_io_open(s, pb, url, flags, options);
+  if (ret < 0 || (flags & AVIO_FLAG_WRITE)) return ret;
+
+  // Reads go through a context of ours, which times them
+  constexpr int avio_buf_size = 32 * 1024;
+  const auto metered = new MeteredIO{abr, *pb};
+  const auto avio_buf = static_cast<unsigned char*>(av_malloc(avio_buf_size));
+  const auto outer = avio_buf ? avio_alloc_context(avio_buf, avio_buf_size, 0,
+                                                   metered, read, nullptr, seek)
+                              : nullptr;
+  if (!outer) {
+    av_free(avio_buf);
+    delete metered;
+    return ret;
+  }
+
+  outer->seekable = metered->inner->seekable;
+  *pb = outer;
+
+  return ret;
+}
+
+int AbrController::io_close(AVFormatContext* s, AVIOContext* pb) {
+  const auto abr = static_cast<AbrController*>(s->opaque);
+  if (!pb || pb->read_packet != read) return abr->default_io_close(s, pb);
+
+  const auto metered = static_cast<MeteredIO*>(pb->opaque);
+  abr->add_sample(metered->bytes, metered->seconds);
+  const auto ret = abr->default_io_close(s, metered->inner);
+  av_freep(&pb->buffer);
+  avio_context_free(&pb);
+  delete metered;
+
+  return ret;
+}
+
+int AbrController::read(void* opaque, uint8_t* buf, int size) {
+  const auto metered = static_cast<MeteredIO*>(opaque);
+  const auto start = qtplay::gettime();
+  const auto ret = avio_read_partial(metered->inner, buf, size);
+  metered->seconds += qtplay::gettime() - start;
+  if (ret > 0) metered->bytes += ret;
+
+  // Long segments are sampled as they go
+  if (metered->bytes >= max_sample_bytes) {
+    metered->abr->add_sample(metered->bytes, metered->seconds);
+    metered->bytes = 0;
+    metered->seconds = 0.0;
+  }
+
+  return ret == 0 ? AVERROR_EOF : ret;
+}
+
+int64_t AbrController::seek(void* opaque, int64_t offset, int whence) {
+  const auto metered = static_cast<MeteredIO*>(opaque);
+  if (whence == AVSEEK_SIZE) return avio_size(metered->inner);
+  return avio_seek(metered->inner, offset, whence & ~AVSEEK_FORCE);
+}
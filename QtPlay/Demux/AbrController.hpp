@@ -0,0 +1,78 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QtGlobal>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* Adaptive bitrate selection among the variants of an HLS or DASH input.
+ * libavformat exposes HLS variants as programs and DASH representations as
+ * streams, tagged with their "variant_bitrate"; only those whose streams are
+ * not discarded are downloaded.
+ *
+ * The segments the demuxer opens through io_open are metered. Only the time
+ * spent waiting in reads counts, so that a demuxer held back by full queues
+ * does not pass for a slow network. Throughput is averaged over a short and
+ * a long half-life, and the lower of the two is trusted. The controller
+ * switches down as soon as the current variant is not sustained and the
+ * buffer is not large enough to ride it out. It switches up only with a
+ * healthy buffer and not sooner than a while after the last switch.
+ * Demux thread only. */
+class AbrController final {
+  Q_DISABLE_COPY_MOVE(AbrController);
+
+ public:
+  struct Variant {
+    int64_t bitrate = 0;  // bits/s
+    int video = -1, audio = -1;  // Streams to play, -1 keeps the current one
+    std::vector<int> streams;    // All the streams of the variant
+  };
+
+  AbrController() = default;
+  ~AbrController() = default;
+
+  // Meters the nested I/O of 'ic'. Must be called before avformat_open_input
+  void attach(AVFormatContext* ic);
+  /* Collects the variants once the input is open. Returns false if there is
+   * nothing to choose from. */
+  bool init(AVFormatContext* ic);
+
+  /* The variant that should play, given the seconds of media buffered ahead
+   * of playback; NAN while starting, when there is no hysteresis. */
+  int pick(double buffered_seconds);
+  // Index of the variant that holds 'stream_index', or -1
+  int find(int stream_index) const;
+  void setCurrent(int index);
+
+  int current() const { return cur; }
+  const Variant& variant(int index) const { return variants[index]; }
+  double throughput() const;  // bits/s, 0 if unknown
+
+ private:
+  struct MeteredIO;
+
+  // Less than this is not worth a sample (playlists); more makes several
+  static constexpr int64_t min_sample_bytes = 64 * 1024,
+                           max_sample_bytes = 512 * 1024;
+  static constexpr double fast_half_life = 2.0, slow_half_life = 8.0;
+
+  std::vector<Variant> variants;
+  int cur = -1;
+  double fast_estimate = 0.0, slow_estimate = 0.0, sampled_seconds = 0.0;
+  double last_switch = 0.0;  // qtplay::gettime()
+
+  decltype(AVFormatContext::io_open) default_io_open = nullptr;
+  decltype(AVFormatContext::io_close2) default_io_close = nullptr;
+
+  void add_sample(int64_t bytes, double seconds);
+
+  static int io_open(AVFormatContext* s, AVIOContext** pb, const char* url,
+                     int flags, AVDictionary** options);
+  static int io_close(AVFormatContext* s, AVIOContext* pb);
+  static int read(void* opaque, uint8_t* buf, int size);
+  static int64_t seek(void* opaque, int64_t offset, int whence);
+};
@@ -0,0 +1,161 @@
+#include "BufferingController.hpp"
+
+#include "../Common/PlayerSettings.hpp"
+#include "../Common/QtPlayCommon.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using qtplay::logMsg;
+
+BufferingController::SourceType BufferingController::classify(
+    const std::string& url, bool realtime) {
+  if (realtime) return SourceType::REALTIME;
+  if (url.starts_with("file:") || url.find("://") == std::string::npos)
+    return SourceType::LOCAL;
+  return SourceType::NETWORK;
+}
+
+const char* BufferingController::sourceName(SourceType type) {
+  switch (type) {
+    case SourceType::LOCAL:
+      return "local";
+    case SourceType::NETWORK:
+      return "network";
+    case SourceType::REALTIME:
+      return "realtime";
+  }
+  return "unknown";
+}
+
+void BufferingController::reset(SourceType source) {
+  std::scoped_lock lck(mtx);
+  st = State();
+  st.source = source;
+  window_bytes = 0;
+  window_read_s = 0.0;
+  first_media_time = last_media_time = NAN;
+  mean_latency_ms = 0.0;
+  was_starving = false;
+  logged_target = 0.0;
+  update_targets();
+}
+
+void BufferingController::onRead(
+    int size, double media_time,
+    std::chrono::steady_clock::duration read_time) {
+  std::scoped_lock lck(mtx);
+  const auto latency_ms =
+      std::chrono::duration<double, std::milli>(read_time).count();
+
+  // Exponential moving averages, roughly over the last 100 reads
+  constexpr auto alpha = 0.01;
+  mean_latency_ms += alpha * (latency_ms - mean_latency_ms);
+  st.jitter_ms += alpha * (std::fabs(latency_ms - mean_latency_ms) -
+                           st.jitter_ms);
+
+  window_read_s += latency_ms / 1000.0;
+  count_media(size, media_time);
+  if (window_read_s > 0.0) st.throughput = window_bytes / window_read_s;
+
+  update_targets();
+}
+
+void BufferingController::onBufferedRead(int size, double media_time,
+                                         double source_throughput) {
+  std::scoped_lock lck(mtx);
+  count_media(size, media_time);
+  st.throughput = std::max(source_throughput, 0.0);
+
+  update_targets();
+}
+
+void BufferingController::count_media(int size, double media_time) {
+  window_bytes += std::max(size, 0);
+  if (!std::isnan(media_time)) {
+    if (std::isnan(first_media_time)) first_media_time = media_time;
+    last_media_time = std::max(media_time, std::isnan(last_media_time)
+                                               ? media_time
+                                               : last_media_time);
+    const auto span = last_media_time - first_media_time;
+    if (span > 1.0) st.consumption = window_bytes / span;
+  }
+}
+
+void BufferingController::onSeek() {
+  std::scoped_lock lck(mtx);
+  // The rates are kept, only the windows restart
+  window_bytes = 0;
+  window_read_s = 0.0;
+  first_media_time = last_media_time = NAN;
+}
+
+void BufferingController::update_targets() {
+  const auto max_mb = std::max(PlayerSettings::get().buffer_max_mb, 1);
+  const auto max_bytes_cap = int64_t(max_mb) * 1024 * 1024;
+  constexpr auto max_duration = 30.0;
+
+  auto target = 1.0;
+  switch (st.source) {
+    case SourceType::LOCAL:
+      target = 1.0;
+      break;
+    case SourceType::NETWORK:
+      target = 3.0;
+      break;
+    case SourceType::REALTIME:
+      target = 0.5;  // Buffering more only adds latency
+      break;
+  }
+
+  // The closer the input is to the media bitrate, the longer a stall can
+  // last before it is caught up with
+  if (st.source != SourceType::REALTIME && st.throughput > 0.0 &&
+      st.consumption > 0.0) {
+    const auto ratio = st.throughput / st.consumption;
+    target = ratio < 1.2 ? max_duration
+                         : target + 2.0 / (ratio - 1.0);
+  }
+  // Reads that take unpredictably long need a margin
+  if (st.source != SourceType::LOCAL) target += st.jitter_ms / 1000.0 * 20.0;
+
+  st.target_duration = std::clamp(target, 0.5, max_duration);
+  st.max_bytes =
+      st.consumption > 0.0
+          ? std::clamp(int64_t(st.target_duration * st.consumption * 2.0),
+                       int64_t(8) * 1024 * 1024, max_bytes_cap)
+          : std::min(int64_t(50) * 1024 * 1024, max_bytes_cap);
+  max_bytes.store(st.max_bytes, std::memory_order_relaxed);
+
+  if (std::fabs(st.target_duration - logged_target) >
+      std::max(0.2 * logged_target, 0.5)) {
+    logged_target = st.target_duration;
+    logMsg(
+        "Buffering (%s): target %.1f s / %lld MiB, input %.0f KiB/s, media "
+        "%.0f KiB/s, jitter %.1f ms",
+        sourceName(st.source), st.target_duration, st.max_bytes >> 20,
+        st.throughput / 1024.0, st.consumption / 1024.0, st.jitter_ms);
+  }
+}
+
+bool BufferingController::update(double audio_buffered, double video_buffered,
+                                 int64_t bytes_buffered, bool audio_starving,
+                                 bool video_starving) {
+  std::scoped_lock lck(mtx);
+  st.audio_buffered = audio_buffered;
+  st.video_buffered = video_buffered;
+  st.bytes_buffered = bytes_buffered;
+
+  const auto starving = audio_starving || video_starving;
+  if (starving && !was_starving) ++st.underruns;
+  was_starving = starving;
+
+  return bytes_buffered > st.max_bytes ||
+         (audio_buffered >= st.target_duration &&
+          video_buffered >= st.target_duration);
+}
+
+BufferingController::State BufferingController::state() const {
+  std::scoped_lock lck(mtx);
+  return st;
+}
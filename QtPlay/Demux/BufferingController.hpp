@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QtGlobal>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/* Decides how much the demuxer buffers ahead, from the measured input
+ * throughput against the rate at which the media consumes data. Fast local
+ * inputs get a short buffer, slow or jittery network inputs a long one.
+ *
+ * Measurements are fed by the demux thread; the state may be read from any
+ * thread. */
+class BufferingController final {
+  Q_DISABLE_COPY_MOVE(BufferingController);
+
+ public:
+  enum class SourceType { LOCAL, NETWORK, REALTIME };
+
+  struct State {
+    SourceType source = SourceType::LOCAL;
+    // Targets
+    double target_duration = 2.0;  // Per queue, seconds
+    int64_t max_bytes = 50LL * 1024 * 1024;
+    // Measurements
+    double throughput = 0.0;   // Input delivery, bytes/s; 0 if unknown
+    double consumption = 0.0;  // Media bitrate, bytes/s; 0 if unknown
+    double jitter_ms = 0.0;    // Mean deviation of the read latency
+    // Current state
+    double audio_buffered = 0.0, video_buffered = 0.0;  // Seconds
+    int64_t bytes_buffered = 0;
+    int underruns = 0;
+  };
+
+  BufferingController() = default;
+  ~BufferingController() = default;
+
+  static SourceType classify(const std::string& url, bool realtime);
+  static const char* sourceName(SourceType type);
+
+  void reset(SourceType source);
+  // A packet of 'size' bytes ending at 'media_time' (seconds, NAN if
+  // unknown) was read in 'read_time'
+  void onRead(int size, double media_time,
+              std::chrono::steady_clock::duration read_time);
+  /* The same, for custom I/O that measures its source by itself: a read
+   * is then mostly a copy, and the time spent in it tells nothing about the
+   * source. 'source_throughput' is 0 if unknown. */
+  void onBufferedRead(int size, double media_time, double source_throughput);
+  void onSeek();
+  // Updates the buffered amounts; returns true if reading should pause
+  bool update(double audio_buffered, double video_buffered,
+              int64_t bytes_buffered, bool audio_starving,
+              bool video_starving);
+  State state() const;
+  // State::max_bytes without taking the lock, for every packet read
+  int64_t maxBytes() const { return max_bytes.load(std::memory_order_relaxed); }
+
+ private:
+  mutable std::mutex mtx;
+  State st;
+  std::atomic<int64_t> max_bytes = st.max_bytes;
+
+  // Accumulated since the last seek
+  int64_t window_bytes = 0;
+  double window_read_s = 0.0, first_media_time = NAN, last_media_time = NAN;
+  double mean_latency_ms = 0.0;
+  bool was_starving = false;
+  double logged_target = 0.0;
+
+  void count_media(int size, double media_time);
+  void update_targets();
+};
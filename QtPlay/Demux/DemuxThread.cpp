@@ -4,12 +4,31 @@
 
 #include "../Audio/AudioThread.hpp"
 #include "../Common/PlayerContext.hpp"
+#include "../Common/PlayerSettings.hpp"
+#include "DualDemuxer.hpp"
+#include "GaplessChain.hpp"
+#include "InputOpen.hpp"
+#include "KeyframeIndex.hpp"
+#include "KeyframeReader.hpp"
+#include "PacketHistory.hpp"
+#include "StreamRecorder.hpp"
+#include "TimeshiftBuffer.hpp"
+#include "TrickPlay.hpp"
+#include "VariantSwitcher.hpp"
 #include "../Video/VideoThread.hpp"
+#include "../VideoOutput/GLWindow.hpp"
+#include "../Widgets/QtPlayGUI.hpp"
+#include "../Widgets/VideoDisplayWidget.hpp"
 
 extern "C" {
 #include <libavformat/avformat.h>
 }
 
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <optional>
+
 using qtplay::logMsg;
 
 DemuxThread::DemuxThread(PlayerContext& _ctx) : CThread(_ctx) {}
@@ -60,51 +79,91 @@ static void stream_component_close(PlayerContext& ctx, AVFormatContext* ic,
   ic->streams[stream_index]->discard = AVDISCARD_ALL;
 }
 
-/* open a given stream. Return 0 if OK */
-static int stream_component_open(PlayerContext& ctx, AVFormatContext* ic,
-                                 int stream_index) {
-  if (stream_index < 0 || stream_index >= ic->nb_streams) return -1;
+/* Initialize the decoder of a given stream. This is the slow part of opening
+ * a stream (hardware probing, avcodec_open2), and it touches only the stream
+ * and its own decoder, so it may run concurrently for different stream types.
+ */
+static bool stream_component_init(PlayerContext& ctx, AVFormatContext* ic,
+                                  int stream_index) {
+  if (stream_index < 0 || stream_index >= ic->nb_streams) return false;
 
-  int ret = 0;
+  const auto start = std::chrono::steady_clock::now();
   auto st = ic->streams[stream_index];
-  const auto codecpar = st->codecpar;
+  const auto codec_type = st->codecpar->codec_type;
+  bool ok = false;
 
   st->discard = AVDISCARD_DEFAULT;
-  switch (codecpar->codec_type) {
-    case AVMEDIA_TYPE_AUDIO: {
+  switch (codec_type) {
+    case AVMEDIA_TYPE_AUDIO:
       ctx.last_audio_stream = stream_index;
-      if (!ctx.auddec.init(Stream(ic, stream_index))) goto fail;
+      ok = ctx.auddec.init(Stream(ic, stream_index));
+      break;
+    case AVMEDIA_TYPE_VIDEO: {
+      ctx.last_video_stream = stream_index;
+      // Lets the decoder pick a reduced resolution right away
+      const auto display_size =
+          QtPlayGUI::instance().videoWidget()->getVideoOutput()->displaySize();
+      ctx.viddec.setDisplaySize(display_size.width(), display_size.height());
+      ok = ctx.viddec.init(Stream(ic, stream_index));
+    } break;
+    case AVMEDIA_TYPE_SUBTITLE: {
+      std::scoped_lock lck(ctx.sub_stream_mutex);
+      ctx.last_subtitle_stream = stream_index;
+      ok = ctx.subdec.init(Stream(ic, stream_index));
+    } break;
+    default:
+      break;
+  }
+
+  logMsg("%s decoder init: %.1f ms", av_get_media_type_string(codec_type),
+         std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count());
+
+  return ok;
+}
+
+/* Start the queue and the thread of an initialized stream */
+static void stream_component_start(PlayerContext& ctx, AVFormatContext* ic,
+                                   int stream_index) {
+  switch (ic->streams[stream_index]->codecpar->codec_type) {
+    case AVMEDIA_TYPE_AUDIO:
       ctx.audioq.start();
       ctx.audio_stream = stream_index;
       ctx.audio_thr = std::make_unique<AudioThread>(ctx);
       ctx.audio_thr->start();
-    } break;
-    case AVMEDIA_TYPE_VIDEO: {
-      ctx.last_video_stream = stream_index;
-      if (!ctx.viddec.init(Stream(ic, stream_index))) goto fail;
+      break;
+    case AVMEDIA_TYPE_VIDEO:
       ctx.videoq.start();
       ctx.video_stream = stream_index;
       ctx.video_thr = std::make_unique<VideoThread>(ctx);
       ctx.video_thr->start();
-    } break;
+      break;
     case AVMEDIA_TYPE_SUBTITLE: {
       std::scoped_lock lck(ctx.sub_stream_mutex);
-      ctx.last_subtitle_stream = stream_index;
-      if (!ctx.subdec.init(Stream(ic, stream_index))) goto fail;
       ctx.subtitleq.start();
       ctx.subtitle_stream = stream_index;
     } break;
     default:
       break;
   }
+}
 
-fail:
+/* open a given stream. Return 0 if OK */
+static int stream_component_open(PlayerContext& ctx, AVFormatContext* ic,
+                                 int stream_index) {
+  if (stream_component_init(ctx, ic, stream_index)) {
+    stream_component_start(ctx, ic, stream_index);
+  }
 
-  return ret;
+  return 0;
 }
 
-static void stream_cycle_channel(PlayerContext& ctx, AVFormatContext* ic,
-                                 AVMediaType codec_type) {
+/* Returns the stream that follows the current one of 'codec_type', within
+ * the program of the video stream for audio and subtitles. Subtitles cycle
+ * through -1 (off). Returns the current stream if there is no other. */
+static int stream_cycle_channel(PlayerContext& ctx, AVFormatContext* ic,
+                                AVMediaType codec_type) {
   int start_index = 0, stream_index = 0, old_index = 0,
       nb_streams = ic->nb_streams;
 
@@ -139,10 +198,10 @@ static void stream_cycle_channel(PlayerContext& ctx, AVFormatContext* ic,
         ctx.last_subtitle_stream = -1;
         break;
       }
-      if (start_index == -1) return;
+      if (start_index == -1) return old_index;
       stream_index = 0;
     }
-    if (stream_index == start_index) return;
+    if (stream_index == start_index) return old_index;
 
     const auto st =
         ic->streams[p ? p->stream_index[stream_index] : stream_index];
@@ -162,36 +221,387 @@ static void stream_cycle_channel(PlayerContext& ctx, AVFormatContext* ic,
   }
 
   if (p && stream_index != -1) stream_index = p->stream_index[stream_index];
-  logMsg("Switch %s stream from #%d to #%d\n",
-         av_get_media_type_string(codec_type), old_index, stream_index);
+  return stream_index;
+}
 
-  stream_component_close(ctx, ic, old_index);
-  stream_component_open(ctx, ic, stream_index);
+/* Lets the audio and subtitle streams of the current program that are not
+ * played be read as well, so that the packet history holds them and a switch
+ * to one of them can take over at the current position. Opt-in: on a
+ * multi-language mux, every alternate track is then demuxed and kept all the
+ * time. */
+static void record_alternate_tracks(const PlayerContext& ctx,
+                                    AVFormatContext* ic, bool enable) {
+  enable = enable && PlayerSettings::get().history_alt_tracks;
+  // Adaptive inputs would download every stream that is not discarded
+  if (!std::strcmp(ic->iformat->name, "hls") ||
+      !std::strcmp(ic->iformat->name, "dash"))
+    enable = false;
+
+  const auto anchor =
+      ctx.video_stream >= 0 ? ctx.video_stream : ctx.audio_stream;
+  const auto program =
+      anchor >= 0 ? av_find_program_from_stream(ic, nullptr, anchor) : nullptr;
+  for (auto i = 0; i < (int)ic->nb_streams; ++i) {
+    const auto type = ic->streams[i]->codecpar->codec_type;
+    if ((type != AVMEDIA_TYPE_AUDIO && type != AVMEDIA_TYPE_SUBTITLE) ||
+        i == ctx.audio_stream || i == ctx.subtitle_stream)
+      continue;
+
+    auto in_program = !program;
+    for (auto j = 0u; program && j < program->nb_stream_indexes; ++j) {
+      in_program = in_program || (int)program->stream_index[j] == i;
+    }
+    ic->streams[i]->discard =
+        enable && in_program ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  }
 }
 
-void handle_seeking(PlayerContext& ctx, AVFormatContext* ic, bool& eof_flag,
-                    bool& attachments_req) {
-  /* Seeking below or to the start of the stream with backwards flag set may
-   * fail, so don't do that */
+/* Switches the stream of 'type' to 'stream_index' (-1 turns subtitles off)
+ * in place. The new decoder is opened while the old one keeps playing, and
+ * swapped in while the decoding thread is paused, so neither the thread nor
+ * the audio device is restarted. Packets of the new stream are then queued
+ * again from the history, if it has them. Returns true if the new stream
+ * takes over at the current position, false if it starts wherever the
+ * demuxer is. */
+static bool stream_component_switch(PlayerContext& ctx, AVFormatContext* ic,
+                                    AVMediaType type, int stream_index,
+                                    const PacketHistory* history) {
+  const auto old_index = type == AVMEDIA_TYPE_AUDIO   ? ctx.audio_stream
+                         : type == AVMEDIA_TYPE_VIDEO ? ctx.video_stream
+                                                      : ctx.subtitle_stream;
+  if (stream_index == old_index) return true;
+
+  // The queues still hold the end of the previous item
+  if (ctx.pending_audio_switch || ctx.pending_video_switch) {
+    logMsg("Cannot switch streams while changing items");
+    return true;
+  }
+  logMsg("Switch %s stream from #%d to #%d",
+         av_get_media_type_string(type), old_index, stream_index);
+
+  auto& thr = type == AVMEDIA_TYPE_AUDIO ? ctx.audio_thr : ctx.video_thr;
+  if (old_index < 0 || stream_index < 0 || !thr) {
+    stream_component_close(ctx, ic, old_index);
+    stream_component_open(ctx, ic, stream_index);
+    return false;
+  }
 
-  std::scoped_lock sl(ctx.seek_mutex);
+  const auto start = qtplay::clk_now();
+  Decoder next;
+  if (type == AVMEDIA_TYPE_VIDEO) {
+    const auto display_size =
+        QtPlayGUI::instance().videoWidget()->getVideoOutput()->displaySize();
+    next.setDisplaySize(display_size.width(), display_size.height());
+    next.setLowLatency(ctx.viddec.low_latency);
+  }
+  if (!next.init(Stream(ic, stream_index))) {
+    logMsg("Could not open stream #%d, keeping #%d", stream_index, old_index);
+    return true;
+  }
 
-  const auto& seek_info = ctx.seek_info;
-  if (!ctx.seek_req || seek_info.seek_type == SeekInfo::SEEK_NONE) {
-    return;
+  // The position the new stream takes over at, as queued
+  const auto clock = ctx.best_clkval();
+  const auto target =
+      !isnan(clock) ? int64_t(clock * AV_TIME_BASE) : AV_NOPTS_VALUE;
+  auto packets = history && target != AV_NOPTS_VALUE
+                     ? history->streamFrom(stream_index, target)
+                     : std::vector<Packet>();
+
+  auto& queue = type == AVMEDIA_TYPE_AUDIO   ? ctx.audioq
+                : type == AVMEDIA_TYPE_VIDEO ? ctx.videoq
+                                             : ctx.subtitleq;
+  if ((int)packets.size() > queue.capacity()) packets.clear();
+  auto swap_in = [&](Decoder& dec) {
+    next.setTempo(dec.tempo);
+    dec.swapWith(next);
+    queue.flush();
+    for (auto& pkt : packets) queue.put(pkt);
+    ic->streams[old_index]->discard = AVDISCARD_ALL;
+    ic->streams[stream_index]->discard = AVDISCARD_DEFAULT;
+    if (!packets.empty() && type != AVMEDIA_TYPE_SUBTITLE)
+      dec.setSeekTarget(target);
+  };
+
+  if (type == AVMEDIA_TYPE_SUBTITLE) {
+    // Subtitles have no thread of their own, the video thread decodes them
+    std::scoped_lock lck(ctx.sub_stream_mutex);
+    swap_in(ctx.subdec);
+    ctx.subtitle_stream = ctx.last_subtitle_stream = stream_index;
+  } else {
+    const CThread::ScopedLocker thr_l(thr);
+    if (type == AVMEDIA_TYPE_AUDIO) {
+      swap_in(ctx.auddec);
+      ctx.audio_stream = ctx.last_audio_stream = stream_index;
+    } else {
+      swap_in(ctx.viddec);
+      ctx.video_stream = ctx.last_video_stream = stream_index;
+    }
   }
 
+  logMsg("%s stream switched in place in %.1f ms (%zu packets from history)",
+         av_get_media_type_string(type),
+         std::chrono::duration<double, std::milli>(qtplay::clk_now() - start)
+             .count(),
+         packets.size());
+
+  return !packets.empty();
+}
+
+/* Time target of an incremental, percent or time seek in AV_TIME_BASE units,
+ * or AV_NOPTS_VALUE if it cannot be told */
+static int64_t seek_time_target(const PlayerContext& ctx,
+                                const SeekInfo& seek_info,
+                                const AVFormatContext* ic) {
+  const auto start_time =
+      ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0LL;
+  if (seek_info.seek_type == SeekInfo::SEEK_INCR) {
+    const auto pos =
+        ctx.best_clkval() - ctx.pts_offset / (double)AV_TIME_BASE;
+    if (isnan(pos)) return AV_NOPTS_VALUE;
+    return std::max(
+        std::int64_t((pos + seek_info.incr_or_percent) * AV_TIME_BASE),
+        start_time);
+  } else if (seek_info.seek_type == SeekInfo::SEEK_PERCENT &&
+             ic->duration > 0) {
+    return start_time +
+           std::int64_t(seek_info.incr_or_percent * double(ic->duration));
+  } else if (seek_info.seek_type == SeekInfo::SEEK_TIME) {
+    return std::max(
+        std::int64_t(seek_info.incr_or_percent * AV_TIME_BASE) - ctx.pts_offset,
+        start_time);
+  }
+
+  return AV_NOPTS_VALUE;
+}
+
+/* The stream whose keyframes the packet history resumes from */
+static int history_anchor(const PlayerContext& ctx, const AVFormatContext* ic) {
+  if (ctx.video_stream >= 0 && !(ic->streams[ctx.video_stream]->disposition &
+                                 AV_DISPOSITION_ATTACHED_PIC))
+    return ctx.video_stream;
+  return ctx.audio_stream;
+}
+
+/* Serves an incremental seek by queueing the packets again from the history,
+ * without touching the demuxer. The decoding threads must be paused. */
+static bool seek_in_history(PlayerContext& ctx, const PacketHistory& history,
+                            const SeekInfo& seek_info) {
+  const auto clock = ctx.best_clkval();
+  if (isnan(clock)) return false;
+
+  // The history holds packets as queued, so the target includes pts_offset
+  const auto target =
+      int64_t((clock + seek_info.incr_or_percent) * AV_TIME_BASE);
+  auto packets = history.replayFrom(target);
+  if (packets.empty()) return false;
+
+  auto audio_count = 0, video_count = 0, sub_count = 0;
+  for (const auto& pkt : packets) {
+    const auto idx = pkt.streamIndex();
+    audio_count += idx == ctx.audio_stream;
+    video_count += idx == ctx.video_stream;
+    sub_count += idx == ctx.subtitle_stream;
+  }
+  if (audio_count > ctx.audioq.capacity() ||
+      video_count > ctx.videoq.capacity() ||
+      sub_count > ctx.subtitleq.capacity())
+    return false;
+
+  ctx.completePendingSwitches();
+  if (ctx.audio_stream >= 0) ctx.audioq.flush();
+  if (ctx.video_stream >= 0) ctx.videoq.flush();
+  if (ctx.subtitle_stream >= 0) ctx.subtitleq.flush();
+  for (auto& pkt : packets) {
+    const auto idx = pkt.streamIndex();
+    if (idx == ctx.audio_stream) {
+      ctx.audioq.put(pkt);
+    } else if (idx == ctx.video_stream) {
+      ctx.videoq.put(pkt);
+    } else if (idx == ctx.subtitle_stream) {
+      ctx.subtitleq.put(pkt);
+    }
+  }
+
+  const auto accurate_target =
+      PlayerSettings::get().accurate_seek && !seek_info.fast ? target
+                                                             : AV_NOPTS_VALUE;
+  ctx.viddec.setSeekTarget(accurate_target);
+  ctx.auddec.setSeekTarget(accurate_target);
+  ctx.eof_notified = false;
+  logMsg("Seek served from the packet history (%zu packets)", packets.size());
+
+  return true;
+}
+
+/* Serves an incremental, percent or time seek from the timeshift recording,
+ * where percentages are of the recorded range. The decoding threads must be
+ * paused. */
+static bool seek_in_timeshift(PlayerContext& ctx, TimeshiftBuffer& timeshift,
+                              const SeekInfo& seek_info) {
+  const auto start = timeshift.startTime(), end = timeshift.endTime();
+  if (start == AV_NOPTS_VALUE || end == AV_NOPTS_VALUE) return false;
+
+  auto target = AV_NOPTS_VALUE;
+  if (seek_info.seek_type == SeekInfo::SEEK_INCR) {
+    const auto clock = ctx.best_clkval();
+    const auto pos = !isnan(clock) ? int64_t(clock * AV_TIME_BASE)
+                                   : timeshift.readTime();
+    if (pos == AV_NOPTS_VALUE) return false;
+    target = pos + int64_t(seek_info.incr_or_percent * AV_TIME_BASE);
+  } else if (seek_info.seek_type == SeekInfo::SEEK_PERCENT) {
+    target = start + int64_t(seek_info.incr_or_percent * (end - start));
+  } else if (seek_info.seek_type == SeekInfo::SEEK_TIME) {
+    target = int64_t(seek_info.incr_or_percent * AV_TIME_BASE);
+  } else {
+    return false;
+  }
+  target = std::clamp(target, start, end);
+
+  if (ctx.audio_stream >= 0) ctx.audioq.flush();
+  if (ctx.video_stream >= 0) ctx.videoq.flush();
+  if (ctx.subtitle_stream >= 0) ctx.subtitleq.flush();
+  timeshift.seek(target);
+
+  const auto accurate_target =
+      PlayerSettings::get().accurate_seek && !seek_info.fast ? target
+                                                             : AV_NOPTS_VALUE;
+  ctx.viddec.setSeekTarget(accurate_target);
+  ctx.auddec.setSeekTarget(accurate_target);
+  ctx.eof_notified = false;
+  logMsg("Timeshift: %.1f s behind live",
+         (end - target) / (double)AV_TIME_BASE);
+
+  return true;
+}
+
+/* Returns true if the input was repositioned */
+bool handle_seeking(PlayerContext& ctx, AVFormatContext* ic,
+                    const KeyframeIndex* kf_index, DualDemuxer& dual,
+                    PacketHistory* history, TimeshiftBuffer* timeshift,
+                    bool& eof_flag, bool& attachments_req) {
+  /* Seeking below or to the start of the stream with backwards flag set may
+   * fail, so don't do that */
+  // The clock runs pts_offset ahead of the timestamps of a chained input
+  const auto clk_offset = ctx.pts_offset / (double)AV_TIME_BASE;
+
+  // Take the request and let new ones come in while this one is handled
+  SeekInfo seek_info;
+  {
+    std::scoped_lock sl(ctx.seek_mutex);
+    if (!ctx.seek_req) return false;
+    seek_info = ctx.seek_info;
+    ctx.seek_info.reset();
+    ctx.seek_req = false;
+    ctx.seek_in_progress = seek_info.seek_type != SeekInfo::SEEK_NONE &&
+                           seek_info.seek_type != SeekInfo::SEEK_STREAM_SWITCH;
+  }
+  auto seek_done = [&ctx] {
+    std::scoped_lock sl(ctx.seek_mutex);
+    ctx.seek_in_progress = false;
+    ctx.seek_interrupt = false;
+  };
+  ON_SCOPE_EXIT(seek_done, seek_guard);
+  auto seeked = false;
+
+  if (seek_info.seek_type == SeekInfo::SEEK_NONE) return false;
+
   if (seek_info.seek_type == SeekInfo::SEEK_STREAM_SWITCH) {
+    // The switches to make, in order: a program switch starts with its video
+    std::vector<std::pair<AVMediaType, int>> switches;
     const auto c_type = seek_info.cycle_type;
-    if (c_type == AVMEDIA_TYPE_VIDEO || c_type == AVMEDIA_TYPE_AUDIO ||
-        c_type == AVMEDIA_TYPE_SUBTITLE) {
-      stream_cycle_channel(ctx, ic, c_type);
-    } else if (seek_info.st_idx_to_open >= 0) {
+    const auto open_idx = seek_info.st_idx_to_open;
+    if (open_idx >= 0 && open_idx < (int)ic->nb_streams) {
+      switches.emplace_back(ic->streams[open_idx]->codecpar->codec_type,
+                            open_idx);
+    } else if (c_type == AVMEDIA_TYPE_VIDEO || c_type == AVMEDIA_TYPE_AUDIO ||
+               c_type == AVMEDIA_TYPE_SUBTITLE) {
+      switches.emplace_back(c_type, stream_cycle_channel(ctx, ic, c_type));
+    } else if (c_type == AVMEDIA_TYPE_UNKNOWN && ic->nb_programs > 1 &&
+               ctx.video_stream >= 0) {
+      const auto video_idx = stream_cycle_channel(ctx, ic, AVMEDIA_TYPE_VIDEO);
+      switches.emplace_back(AVMEDIA_TYPE_VIDEO, video_idx);
+      switches.emplace_back(
+          AVMEDIA_TYPE_AUDIO,
+          std::max(av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO, -1, video_idx,
+                                       nullptr, 0),
+                   -1));
+      if (ctx.subtitle_stream >= 0) {
+        switches.emplace_back(
+            AVMEDIA_TYPE_SUBTITLE,
+            std::max(av_find_best_stream(ic, AVMEDIA_TYPE_SUBTITLE, -1,
+                                         video_idx, nullptr, 0),
+                     -1));
+      }
     }
-  } else {
+
+    // The recording has a single anchor stream, which must stay
+    const auto changes_video =
+        std::any_of(switches.begin(), switches.end(), [&](const auto& sw) {
+          return sw.first == AVMEDIA_TYPE_VIDEO &&
+                 sw.second != ctx.video_stream;
+        });
+    if (timeshift && changes_video) {
+      logMsg("Timeshift: only audio and subtitle streams can be switched");
+      return false;
+    }
+
+    const auto old_anchor = history_anchor(ctx, ic);
+    auto needs_seek = false;
+    for (const auto& [type, idx] : switches) {
+      const auto resumed = stream_component_switch(ctx, ic, type, idx, history);
+      needs_seek = needs_seek || (!resumed && idx >= 0 &&
+                                  type != AVMEDIA_TYPE_SUBTITLE);
+    }
+    record_alternate_tracks(ctx, ic, history || timeshift);
+    if (history && history_anchor(ctx, ic) != old_anchor)
+      history->reset(history_anchor(ctx, ic));
+    if (!needs_seek) {
+      eof_flag = false;
+      return false;
+    }
+
+    /* The new stream was not in the history: go back to the current position
+     * for it, which the other streams then skip up to */
+    if (timeshift) {
+      const CThread::ScopedLocker athr_l(ctx.audio_thr);
+      const CThread::ScopedLocker vthr_l(ctx.video_thr);
+      seek_info.set_seek(SeekInfo::SEEK_INCR, 0.0);
+      if (!seek_in_timeshift(ctx, *timeshift, seek_info)) return false;
+      attachments_req = true;
+      eof_flag = false;
+      return true;
+    }
+    if (ic->ctx_flags & AVFMTCTX_UNSEEKABLE) return false;
+    if (history) history->clear();
+    history = nullptr;
+    seek_info.set_seek(SeekInfo::SEEK_INCR, 0.0);
+  }
+
+  if (seek_info.seek_type != SeekInfo::SEEK_STREAM_SWITCH) {
+    // A live input is only seeked in its recording
+    if (timeshift) {
+      const CThread::ScopedLocker athr_l(ctx.audio_thr);
+      const CThread::ScopedLocker vthr_l(ctx.video_thr);
+      if (!seek_in_timeshift(ctx, *timeshift, seek_info)) return false;
+      attachments_req = true;
+      eof_flag = false;
+      return true;
+    }
+
+    // Short seeks within the packet history need no demuxer seek
+    if (history && seek_info.seek_type == SeekInfo::SEEK_INCR) {
+      const CThread::ScopedLocker athr_l(ctx.audio_thr);
+      const CThread::ScopedLocker vthr_l(ctx.video_thr);
+      if (seek_in_history(ctx, *history, seek_info)) {
+        attachments_req = true;
+        eof_flag = false;
+        return true;
+      }
+    }
+
     /*Don't bother to seek in an unseekable stream*/
     if ((ic->ctx_flags & AVFMTCTX_UNSEEKABLE)) {
-      return;
+      return false;
     }
     int seek_flags = 0;
     auto stream_seek = [&](int64_t pos, int64_t rel, bool by_bytes) {
@@ -203,8 +613,16 @@ void handle_seeking(PlayerContext& ctx, AVFormatContext* ic, bool& eof_flag,
     const CThread::ScopedLocker athr_l(ctx.audio_thr);
     const CThread::ScopedLocker vthr_l(ctx.video_thr);
 
-    if (ctx.seek_info.seek_type == SeekInfo::SEEK_INCR) {
-      auto incr = ctx.seek_info.incr_or_percent;
+    // A keyframe index turns the seek into a single jump to a byte position
+    std::optional<KeyframeIndex::Entry> keyframe;
+    const auto time_target =
+        kf_index ? seek_time_target(ctx, seek_info, ic) : AV_NOPTS_VALUE;
+    if (time_target != AV_NOPTS_VALUE) keyframe = kf_index->lookup(time_target);
+
+    if (keyframe) {
+      stream_seek(keyframe->pos, 0, true);
+    } else if (seek_info.seek_type == SeekInfo::SEEK_INCR) {
+      auto incr = seek_info.incr_or_percent;
       if (ctx.seek_by_bytes > 0 && !(ic->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
         long double pos = -1.0;
         if (pos < 0 && ctx.video_stream >= 0) pos = ctx.last_video_byte_pos;
@@ -217,7 +635,7 @@ void handle_seeking(PlayerContext& ctx, AVFormatContext* ic, bool& eof_flag,
         pos += incr;
         stream_seek(std::max(pos, 0.0L), incr, true);
       } else {
-        auto pos = ctx.best_clkval();
+        auto pos = ctx.best_clkval() - clk_offset;
         if (isnan(pos)) pos = (long double)ctx.last_seek_pos / AV_TIME_BASE;
         pos += incr;
         if ((ic->start_time != AV_NOPTS_VALUE) &&
@@ -226,8 +644,8 @@ void handle_seeking(PlayerContext& ctx, AVFormatContext* ic, bool& eof_flag,
         stream_seek(std::int64_t(pos * AV_TIME_BASE),
                     std::int64_t(incr * AV_TIME_BASE), false);
       }
-    } else if (ctx.seek_info.seek_type == SeekInfo::SEEK_PERCENT) {
-      const auto percent = ctx.seek_info.incr_or_percent;
+    } else if (seek_info.seek_type == SeekInfo::SEEK_PERCENT) {
+      const auto percent = seek_info.incr_or_percent;
       if (((ctx.seek_by_bytes > 0 || ic->duration <= 0) && ic->pb) &&
           !(ic->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
         const auto size = avio_size(ic->pb);
@@ -251,11 +669,18 @@ void handle_seeking(PlayerContext& ctx, AVFormatContext* ic, bool& eof_flag,
         // logMsg("Seek TS: %" PRId64, ts);
         stream_seek(ts, 0, false);
       }
-    } else if (ctx.seek_info.seek_type == SeekInfo::SEEK_CHAPTER) {
-      const int ch_incr = ctx.seek_info.chapter_incr;
-      if (!ch_incr || !ic->nb_chapters) return;
-
-      const std::int64_t pos = ctx.best_clkval() * AV_TIME_BASE;
+    } else if (seek_info.seek_type == SeekInfo::SEEK_TIME) {
+      auto pos = seek_info.incr_or_percent - clk_offset;
+      if ((ic->start_time != AV_NOPTS_VALUE) &&
+          (pos < ic->start_time / (double)AV_TIME_BASE))
+        pos = ic->start_time / (double)AV_TIME_BASE;
+      stream_seek(std::int64_t(pos * AV_TIME_BASE), 0, false);
+    } else if (seek_info.seek_type == SeekInfo::SEEK_CHAPTER) {
+      const int ch_incr = seek_info.chapter_incr;
+      if (!ch_incr || !ic->nb_chapters) return false;
+
+      const std::int64_t pos =
+          (ctx.best_clkval() - clk_offset) * AV_TIME_BASE;
 
 #define AV_TIME_BASE_Q \
   { 1, AV_TIME_BASE }
@@ -271,7 +696,7 @@ void handle_seeking(PlayerContext& ctx, AVFormatContext* ic, bool& eof_flag,
       }
 
       i = std::max(i + ch_incr, 0);
-      if (i >= ic->nb_chapters) return;
+      if (i >= ic->nb_chapters) return false;
 
       logMsg("Seeking to chapter %d", i);
       stream_seek(av_rescale_q(ic->chapters[i]->start,
@@ -285,12 +710,56 @@ void handle_seeking(PlayerContext& ctx, AVFormatContext* ic, bool& eof_flag,
     // in generation
     //      of the seek_pos/seek_rel variables
     const auto seek_min = seek_rel > 0 ? seek_target - seek_rel + 2 : INT64_MIN;
-    const auto seek_max = seek_rel < 0 ? seek_target - seek_rel - 2 : INT64_MAX;
+    auto seek_max = seek_rel < 0 ? seek_target - seek_rel - 2 : INT64_MAX;
+    // A time seek lands on the keyframe at or before the time
+    if (seek_info.seek_type == SeekInfo::SEEK_TIME &&
+        !(seek_flags & AVSEEK_FLAG_BYTE))
+      seek_max = seek_target;
+
+    /* Accurate seeking needs the timestamp to decode up to, and a keyframe
+     * at or before it */
+    auto accurate_target = AV_NOPTS_VALUE;
+    if (PlayerSettings::get().accurate_seek && !seek_info.fast) {
+      if (keyframe) {
+        accurate_target = time_target;
+      } else if (!(seek_flags & AVSEEK_FLAG_BYTE)) {
+        accurate_target = seek_target;
+        seek_max = seek_target;
+      }
+    }
+    // Seek latency, to compare inputs with and without a keyframe index
+    const auto seek_start = qtplay::clk_now();
     const auto ret =
         avformat_seek_file(ic, -1, seek_min, seek_target, seek_max, seek_flags);
-    if (ret < 0) {
+    logMsg("Seek (%s): %.1f ms",
+           keyframe   ? "keyframe index"
+           : kf_index ? "not in the keyframe index"
+                      : "no keyframe index",
+           std::chrono::duration<double, std::milli>(qtplay::clk_now() -
+                                                     seek_start)
+               .count());
+    if (ret < 0 && ctx.seek_interrupt) {
+      // Superseded by a newer request, which is handled next
+      if (ic->pb) ic->pb->error = 0;
+      logMsg("Seek interrupted by a newer request");
+    } else if (ret < 0) {
       logMsg("%s: error while seeking", ic->url);
     } else {
+      // Markers of a chained input would be flushed along with the queues
+      ctx.completePendingSwitches();
+      if (accurate_target != AV_NOPTS_VALUE) accurate_target += ctx.pts_offset;
+      ctx.viddec.setSeekTarget(accurate_target);
+      ctx.auddec.setSeekTarget(accurate_target);
+      ctx.buffering.onSeek();
+      ctx.eof_notified = false;
+      seeked = true;
+      if (history) history->clear();
+
+      dual.followSeek(ic, seek_min, seek_target, seek_max,
+                      seek_flags & AVSEEK_FLAG_BYTE,
+                      keyframe ? keyframe->pts
+                               : seek_time_target(ctx, seek_info, ic));
+
       if (ctx.audio_stream >= 0) {
         ctx.audioq.flush();
       }
@@ -303,10 +772,10 @@ void handle_seeking(PlayerContext& ctx, AVFormatContext* ic, bool& eof_flag,
     }
   }
 
-  ctx.seek_info.reset();
-  ctx.seek_req = false;
   attachments_req = true;
   eof_flag = false;
+
+  return seeked;
 }
 
 static bool is_realtime(AVFormatContext* s) {
@@ -319,51 +788,66 @@ static bool is_realtime(AVFormatContext* s) {
   return false;
 }
 
-bool demux_check_buffer_fullness(const PlayerContext& ctx,
-                                 const std::vector<Stream>& streams) {
-  if (ctx.audioq.isFull() || ctx.videoq.isFull() || ctx.subtitleq.isFull())
-    return true;
+/* End time of a packet in AV_TIME_BASE units, or AV_NOPTS_VALUE */
+static int64_t packet_end_time(const AVFormatContext* ic, const AVPacket* pkt) {
+  const auto ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+  if (ts == AV_NOPTS_VALUE || pkt->stream_index >= (int)ic->nb_streams)
+    return AV_NOPTS_VALUE;
+  return av_rescale_q(ts + std::max<int64_t>(pkt->duration, 0),
+                      ic->streams[pkt->stream_index]->time_base,
+                      AVRational{1, AV_TIME_BASE});
+}
 
-  auto videoq_nb_packets = 0, audioq_nb_packets = 0;
-  auto videoq_size = 0LL, audioq_size = 0LL, videoq_duration = 0LL,
-       audioq_duration = 0LL;
-  auto audio_has_enough_packets = false, video_has_enough_packets = false;
+/* With 'dual' set, audio has its own demuxer and a full queue only stops
+ * the demuxer that feeds it, which the caller takes care of */
+bool demux_check_buffer_fullness(PlayerContext& ctx,
+                                 const std::vector<Stream>& streams,
+                                 bool dual) {
+  if (!dual &&
+      (ctx.audioq.isFull() || ctx.videoq.isFull() || ctx.subtitleq.isFull()))
+    return true;
 
-  constexpr auto MAX_QUEUE_SIZE = (50LL * 1024LL * 1024LL);
+  // Packet count that stands for a full queue when durations are unknown
   constexpr auto MIN_FRAMES = 100;
 
-  auto queue_is_full = [](const Stream& st, int64_t nb_pkts,
-                          int64_t dur) -> bool {
-    return (nb_pkts > MIN_FRAMES) && (!dur || (st.tb() * dur > 2.0));
+  auto buffered_seconds = [](const Stream& st,
+                             const PacketQueue::QueueState& qs) -> double {
+    if (qs.abort_req) return INFINITY;
+    if (qs.duration > 0) return st.tb() * qs.duration;
+    return qs.nb_packets > MIN_FRAMES ? INFINITY : 0.0;
   };
 
   const auto aqparams = ctx.audioq.getState(), vqparams = ctx.videoq.getState();
-  const auto has_audio_st = !aqparams.abort_req,
-             has_video_st = !vqparams.abort_req;
-  if (has_audio_st) {
-    audioq_size = std::max(0LL, aqparams.size);
-    audioq_nb_packets = std::max(0, aqparams.nb_packets);
-    audioq_duration = std::max(0LL, aqparams.duration);
-    const auto& st = streams[ctx.audio_stream];
-    audio_has_enough_packets =
-        queue_is_full(st, audioq_nb_packets, audioq_duration);
-  } else
-    audio_has_enough_packets = true;
-
-  if (has_video_st) {
-    videoq_size = std::max(0LL, vqparams.size);
-    videoq_nb_packets = std::max(0, vqparams.nb_packets);
-    videoq_duration = std::max(0LL, vqparams.duration);
-    const auto& st = streams[ctx.video_stream];
-    video_has_enough_packets =
-        st.isAttachedPic()
-            ? true
-            : queue_is_full(st, videoq_nb_packets, videoq_duration);
-  } else
-    video_has_enough_packets = true;
-
-  return ((audioq_size + videoq_size) > MAX_QUEUE_SIZE) ||
-         (video_has_enough_packets && audio_has_enough_packets);
+  const auto audio_buffered =
+      ctx.audio_stream >= 0
+          ? buffered_seconds(streams[ctx.audio_stream], aqparams)
+          : INFINITY;
+  const auto video_buffered =
+      (ctx.video_stream >= 0 && !streams[ctx.video_stream].isAttachedPic())
+          ? buffered_seconds(streams[ctx.video_stream], vqparams)
+          : INFINITY;
+  const auto bytes_buffered = std::max(0LL, (long long)aqparams.size) +
+                              std::max(0LL, (long long)vqparams.size);
+  const auto eof = ctx.demuxerEOF();
+
+  return ctx.buffering.update(
+      audio_buffered, video_buffered, bytes_buffered,
+      !eof && !aqparams.abort_req && aqparams.nb_packets == 0,
+      !eof && std::isfinite(video_buffered) && vqparams.nb_packets == 0);
+}
+
+/* A queue filled up while the other one runs dry: the input is interleaved
+ * too coarsely to be read with a single demuxer */
+static bool interleave_stall(PlayerContext& ctx,
+                             const std::vector<Stream>& streams) {
+  if (ctx.audio_stream < 0 || ctx.video_stream < 0) return false;
+
+  constexpr auto low_water = 0.5;  // Seconds
+  const auto aq = ctx.audioq.getState(), vq = ctx.videoq.getState();
+  const auto audio_buffered = aq.duration * streams[ctx.audio_stream].tb(),
+             video_buffered = vq.duration * streams[ctx.video_stream].tb();
+  return std::min(audio_buffered, video_buffered) < low_water &&
+         std::max(audio_buffered, video_buffered) > 4 * low_water;
 }
 
 void DemuxThread::run() {
@@ -373,19 +857,80 @@ void DemuxThread::run() {
   auto loop = false, autoexit = false, realtime = false, last_paused = false,
        eof = false, queue_attachments_req = true, local_paused = false,
        cont = true;
-  auto estimated_duration = AV_NOPTS_VALUE;
   std::vector<Stream> streams;
   Packet pkt;
+  std::unique_ptr<InputIO> input_io;
+  std::unique_ptr<KeyframeIndex> kf_index;
+  PacketHistory history;
+  const auto history_window = PlayerSettings::get().history_seconds;
+  double input_duration = NAN;
+  // Where the queued audio and video end, pts_offset included
+  auto audio_end = AV_NOPTS_VALUE, video_end = AV_NOPTS_VALUE;
+
+  /* Timeshift: a live input is recorded to disk as it is read, and played
+   * back from the recording, so it can be paused and rewound */
+  std::unique_ptr<TimeshiftBuffer> timeshift;
+  auto input_eof = false;
+  auto catchup_tempo = 1.0;
+
+  /* Recording: the packets read are also handed to a muxer thread. It stops
+   * when the input changes, its streams are fixed at the start. */
+  std::unique_ptr<StreamRecorder> recorder;
+
+  /* The background reads of the I/O only stop with the demuxer: a source
+   * read cut short by a seek would be taken for an error of the input */
+  AVIOInterruptCB io_int_cb = {};
+  io_int_cb.callback = [](void* opaque) -> int {
+    return static_cast<int>(
+        qtplay::ptr_cast<DemuxThread>(opaque)->abort_demuxer.load());
+  };
+  io_int_cb.opaque = this;
+
+  VariantSwitcher variants(ctx);  // Outlives ic, it closes its I/O
+  DualDemuxer dual(ctx, io_int_cb);
+  GaplessChain gapless(ctx, io_int_cb);
+  TrickPlay trick(ctx);
 
   auto cleanup_func = [&] {
+    gapless.close();
+    dual.reset();
+    timeshift = nullptr;
+    recorder = nullptr;
     stream_component_close(ctx, ic, ctx.audio_stream);
     stream_component_close(ctx, ic, ctx.video_stream);
     stream_component_close(ctx, ic, ctx.subtitle_stream);
+    ctx.next_auddec.destroy();
+    ctx.next_viddec.destroy();
     avformat_close_input(&ic);
+    if (input_io) {
+      const auto st = input_io->stats();
+      logMsg("%s input: %lld KiB read at %.0f KiB/s, stalled for %.0f ms",
+             input_io->name(), st.bytes_read / 1024, st.throughput / 1024.0,
+             st.stall_ms);
+      const auto cached = st.cache_hit_bytes + st.cache_miss_bytes;
+      if (cached > 0) {
+        logMsg("HTTP cache: %.0f%% hits, %lld KiB not downloaded again",
+               100.0 * st.cache_hit_bytes / cached,
+               st.cache_hit_bytes / 1024);
+      }
+      input_io = nullptr;
+    }
   };
 
   ON_SCOPE_EXIT(cleanup_func, demthr_guard);
 
+  /* With custom I/O, av_read_frame() mostly copies from memory: the rate of
+   * the source is the one measured by the I/O while reading ahead */
+  auto on_read = [&](int size, double media_time,
+                     std::chrono::steady_clock::time_point start) {
+    if (input_io) {
+      ctx.buffering.onBufferedRead(size, media_time,
+                                   input_io->stats().throughput);
+    } else {
+      ctx.buffering.onRead(size, media_time, qtplay::clk_now() - start);
+    }
+  };
+
   auto wait_timeout = [&] {
     std::unique_lock lck(wait_mutex);
     ctx.continue_read_thread.wait_for(lck, std::chrono::milliseconds(10));
@@ -399,12 +944,20 @@ void DemuxThread::run() {
   ic->flags |= AVFMT_FLAG_GENPTS;
 
   /*Set up an interrupt callback*/
-  ic->interrupt_callback.callback = [](void* ctx) -> int {
-    return static_cast<int>(qtplay::ptr_cast<std::atomic_bool>(ctx)->load());
+  ic->interrupt_callback.callback = [](void* opaque) -> int {
+    const auto thr = qtplay::ptr_cast<DemuxThread>(opaque);
+    return static_cast<int>(thr->abort_demuxer.load() ||
+                            thr->ctx.seek_interrupt.load());
   };
-  ic->interrupt_callback.opaque = std::addressof(this->abort_demuxer);
+  ic->interrupt_callback.opaque = this;
 
-  av_dict_set(&format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
+  if ((input_io = qtplay::openInputIO(ctx.filename, &io_int_cb))) {
+    ic->pb = input_io->avio();
+    ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+
+  KeyframeReader::setFormatOptions(&format_opts);
+  variants.attach(ic, &format_opts);
   if (avformat_open_input(&ic, ctx.filename.c_str(), nullptr, &format_opts) <
       0) {
     return;
@@ -417,70 +970,239 @@ void DemuxThread::run() {
     return;
   }
 
-  if (ic->duration <= 0) {
-    for (int i = 0; i < ic->nb_streams; ++i) {
-      const auto st = ic->streams[i];
-      if (st->duration > 0 && st->duration > estimated_duration) {
-        estimated_duration = st->duration;
+  // Per-input state, also set up again when chaining to the next item
+  auto setup_input = [&] {
+    auto estimated_duration = AV_NOPTS_VALUE;
+    if (ic->duration <= 0) {
+      for (int i = 0; i < ic->nb_streams; ++i) {
+        const auto st = ic->streams[i];
+        if (st->duration > 0 && st->duration > estimated_duration) {
+          estimated_duration = st->duration;
+        }
       }
+    } else {
+      estimated_duration = ic->duration;
     }
-  } else {
-    estimated_duration = ic->duration;
-  }
 
-  ctx.stream_duration =
-      (estimated_duration <= 0LL
-           ? NAN
-           : (long double)estimated_duration / (double)AV_TIME_BASE);
+    input_duration =
+        (estimated_duration <= 0LL
+             ? NAN
+             : (long double)estimated_duration / (double)AV_TIME_BASE);
 
-  if (ic->pb)
-    ic->pb->eof_reached = 0;  // FIXME hack, ffplay maybe should not use
-                              // avio_feof() to test for the end
-  if (ctx.seek_by_bytes < 0)
+    if (ic->pb)
+      ic->pb->eof_reached = 0;  // FIXME hack, ffplay maybe should not use
+                                // avio_feof() to test for the end
     ctx.seek_by_bytes = !(ic->iformat->flags & AVFMT_NO_BYTE_SEEK) &&
                         !!(ic->iformat->flags & AVFMT_TS_DISCONT) &&
                         strcmp("ogg", ic->iformat->name);
-  ctx.max_frame_duration =
-      (ic->iformat->flags & AVFMT_TS_DISCONT) ? 10.0 : 3600.0;
-  realtime = is_realtime(ic);
+    ctx.max_frame_duration =
+        (ic->iformat->flags & AVFMT_TS_DISCONT) ? 10.0 : 3600.0;
+    realtime = is_realtime(ic);
+    ctx.buffering.reset(BufferingController::classify(ctx.filename, realtime));
+
+    streams.clear();
+    streams.reserve(ic->nb_streams);
+    for (auto i = 0; i < ic->nb_streams; ++i) {
+      streams.push_back(Stream(ic, i));
+    }
+    ctx.m_streams = streams;
+    kf_index = nullptr;
+  };
+
+  /* Indexes the keyframes of the stream played: the video, or the audio if
+   * there is no picture to show */
+  auto open_kf_index = [&] {
+    kf_index = nullptr;
+    if (!PlayerSettings::get().keyframe_index || realtime ||
+        !KeyframeIndex::isUseful(ic))
+      return;
+    const auto idx =
+        ctx.video_stream >= 0 && !streams[ctx.video_stream].isAttachedPic()
+            ? ctx.video_stream
+            : ctx.audio_stream;
+    if (idx < 0) return;
+    kf_index = std::make_unique<KeyframeIndex>(ctx.filename, idx);
+    // Scanning a remote input would download all of it
+    if (kf_index->persistent()) kf_index->startScan();
+  };
+
+  /* Gapless playback: continues with the pre-opened next item, whose
+   * decoders the decoding threads swap in when they reach the marker */
+  auto chain_next_input = [&](std::unique_ptr<PendingInput> next) {
+    // Continue the timestamps where the current input ends
+    const auto end_time = std::max(audio_end, video_end);
+    const auto next_start =
+        next->ic->start_time != AV_NOPTS_VALUE ? next->ic->start_time : 0LL;
+    if (end_time != AV_NOPTS_VALUE) ctx.pts_offset = end_time - next_start;
+
+    stream_component_close(ctx, ic, ctx.subtitle_stream);
 
-  streams.resize(ic->nb_streams);
+    ctx.next_timeline_offset = ctx.pts_offset / (double)AV_TIME_BASE;
+    ctx.item_switched = false;
+    if (ctx.audio_stream >= 0) {
+      ctx.pending_audio_switch = true;
+      ctx.audioq.put_stream_change(ctx.audio_stream);
+    }
+    if (ctx.video_stream >= 0) {
+      ctx.pending_video_switch = true;
+      ctx.videoq.put_stream_change(ctx.video_stream);
+    }
+
+    // Queued packets and decoders do not refer to the old input
+    recorder = nullptr;
+    ctx.recording_wanted = false;
+    avformat_close_input(&ic);
+    std::swap(ic, next->ic);
+    input_io = std::move(next->io);
+    {
+      std::scoped_lock lck(ctx.next_url_mutex);
+      ctx.filename = next->url;
+    }
+    ctx.audio_stream = ctx.last_audio_stream = next->audio_idx;
+    ctx.video_stream = ctx.last_video_stream = next->video_idx;
+    setup_input();
+    open_kf_index();
+    ctx.next_duration = input_duration;
+
+    audio_end = video_end = AV_NOPTS_VALUE;
+    gapless.reset();
+    variants.reset();
+    dual.reset();
+    dual.onInputOpened(ic, realtime);
+    queue_attachments_req = true;
+    history.reset(history_window > 0 ? history_anchor(ctx, ic) : -1);
+    record_alternate_tracks(ctx, ic, history_window > 0);
+    logMsg("Chained to '%s'", ctx.filename.c_str());
+  };
+
+  // Both demuxers are at the end: chain to the next item or signal EOF
+  auto finish_input = [&] {
+    if (auto next = gapless.take()) {
+      chain_next_input(std::move(next));
+      return;
+    }
+
+    eof = true;
+    ctx.setDemuxerEOF(eof);
+    ctx.videoq.put_nullpacket(ctx.video_stream, true);
+    ctx.audioq.put_nullpacket(ctx.audio_stream, true);
+    ctx.subtitleq.put_nullpacket(ctx.subtitle_stream, true);
+  };
+
+  setup_input();
+  ctx.stream_duration = input_duration;
+  ctx.viddec.setLowLatency(realtime || PlayerSettings::get().low_latency);
   for (auto i = 0; i < ic->nb_streams; ++i) {
-    streams.push_back(Stream(ic, i));
     ic->streams[i]->discard = AVDISCARD_ALL;
   }
 
-  ctx.m_streams = streams;
-
   int video_idx = -1, audio_idx = -1, sub_idx = -1;
-  for (const auto& st : streams) {
-    if (st.codecpar()->codec_type == AVMEDIA_TYPE_VIDEO) {
-      if (video_idx < 0 || streams[video_idx].isAttachedPic()) {
-        video_idx = st.index();
+  qtplay::findDefaultStreams(ic, video_idx, audio_idx, sub_idx);
+  variants.init(ic, video_idx, audio_idx);
+
+  /* Video (and then subtitle) decoders are initialized in the background, so
+   * that audio can start while hardware decoding is still being probed */
+  std::future<bool> video_init;
+  bool sub_ok = false;
+  if (video_idx >= 0) {
+    video_init = std::async(std::launch::async, [&] {
+      const auto video_ok = stream_component_init(ctx, ic, video_idx);
+      if (video_ok && sub_idx >= 0) {
+        sub_ok = stream_component_init(ctx, ic, sub_idx);
       }
-    } else if (st.codecpar()->codec_type == AVMEDIA_TYPE_AUDIO) {
-      audio_idx = st.index();
-    } else if (st.codecpar()->codec_type == AVMEDIA_TYPE_SUBTITLE) {
-      sub_idx = st.index();
-    }
+      return video_ok;
+    });
   }
 
-  if (audio_idx >= 0) {
-    stream_component_open(ctx, ic, audio_idx);
+  if (audio_idx >= 0 && stream_component_init(ctx, ic, audio_idx)) {
+    stream_component_start(ctx, ic, audio_idx);
   }
 
-  if (video_idx >= 0) {
-    stream_component_open(ctx, ic, video_idx);
-
-    if (ctx.video_stream >= 0 && sub_idx >= 0) {
-      stream_component_open(ctx, ic, sub_idx);
-    }
+  if (video_init.valid() && video_init.get()) {
+    stream_component_start(ctx, ic, video_idx);
+    if (sub_ok) stream_component_start(ctx, ic, sub_idx);
   }
 
   if (!ctx.video_thr && !ctx.audio_thr) {
     logMsg("Failed to open url: '%s'", ic->url);
     return;
   }
+  open_kf_index();
+
+  const auto& sets = PlayerSettings::get();
+  const auto live =
+      realtime || (ic->ctx_flags & AVFMTCTX_UNSEEKABLE) ||
+      (ic->duration <= 0 && ctx.buffering.state().source !=
+                                BufferingController::SourceType::LOCAL);
+  if (live && sets.timeshift_minutes > 0 &&
+      (timeshift = TimeshiftBuffer::create(history_anchor(ctx, ic),
+                                           sets.timeshift_minutes * 60.0))) {
+    logMsg("Timeshift: recording up to %d minutes", sets.timeshift_minutes);
+    kf_index = nullptr;
+  }
+
+  dual.onInputOpened(ic, realtime || timeshift);
+  history.reset(history_window > 0 && !timeshift ? history_anchor(ctx, ic)
+                                                 : -1);
+  record_alternate_tracks(ctx, ic, history_window > 0 || timeshift);
+
+  // Indexes, offsets and queues the packet just read into 'pkt'
+  auto queue_packet = [&] {
+    const auto pkt_st_idx = pkt.streamIndex();
+    // Only the keyframes of the indexed stream are taken
+    if (kf_index) kf_index->addPacket(ic, pkt.constAvData());
+    if (pkt_st_idx == ctx.audio_stream) {
+      const auto av_pkt = pkt.constAvData();
+      dual.onAudioPacket(
+          ic, av_pkt->pts != AV_NOPTS_VALUE ? av_pkt->pts : av_pkt->dts);
+    }
+    if (pkt_st_idx == ctx.audio_stream || pkt_st_idx == ctx.video_stream) {
+      const auto end_time = packet_end_time(ic, pkt.constAvData());
+      if (end_time != AV_NOPTS_VALUE) {
+        (pkt_st_idx == ctx.audio_stream ? audio_end : video_end) =
+            end_time + ctx.pts_offset;
+      }
+    }
+    if (ctx.pts_offset && pkt_st_idx >= 0 && pkt_st_idx < ic->nb_streams) {
+      const auto offset =
+          av_rescale_q(ctx.pts_offset, AVRational{1, AV_TIME_BASE},
+                       ic->streams[pkt_st_idx]->time_base);
+      auto av_pkt = pkt.avData();
+      if (av_pkt->pts != AV_NOPTS_VALUE) av_pkt->pts += offset;
+      if (av_pkt->dts != AV_NOPTS_VALUE) av_pkt->dts += offset;
+    }
+    if (pkt_st_idx >= 0 &&
+        pkt_st_idx < ic->nb_streams) {  // Avoid reading garbage if input is
+                                        // corrupted
+      // Along with the alternate tracks, which are not queued
+      if (history_window > 0 &&
+          (pkt_st_idx == ctx.audio_stream || pkt_st_idx == ctx.video_stream ||
+           pkt_st_idx == ctx.subtitle_stream ||
+           ic->streams[pkt_st_idx]->discard != AVDISCARD_ALL)) {
+        const auto av_pkt = pkt.constAvData();
+        const auto ts =
+            av_pkt->pts != AV_NOPTS_VALUE ? av_pkt->pts : av_pkt->dts;
+        history.add(pkt,
+                    ts != AV_NOPTS_VALUE
+                        ? av_rescale_q(ts, ic->streams[pkt_st_idx]->time_base,
+                                       AVRational{1, AV_TIME_BASE})
+                        : AV_NOPTS_VALUE,
+                    history_window, ctx.buffering.maxBytes());
+      }
+      if (pkt_st_idx == ctx.audio_stream) {
+        ctx.audioq.put(pkt);
+      } else if ((pkt_st_idx == ctx.video_stream) &&
+                 !streams[pkt_st_idx].isAttachedPic()) {
+        ctx.videoq.put(pkt);
+      } else if (pkt_st_idx == ctx.subtitle_stream) {
+        ctx.subtitleq.put(pkt);
+      } else {
+        pkt.clear();
+      }
+    } else {
+      pkt.clear();
+    }
+  };
 
   while (cont) {
     {
@@ -492,7 +1214,10 @@ void DemuxThread::run() {
       if (is_paused != local_paused) {
         local_paused = is_paused;
 
-        const auto res = local_paused ? av_read_pause(ic) : av_read_play(ic);
+        // A recorded live input keeps being read while paused
+        if (!timeshift) {
+          const auto res = local_paused ? av_read_pause(ic) : av_read_play(ic);
+        }
 
         if (ctx.audio_thr) {
           ctx.audio_thr->trySetPause(local_paused);
@@ -508,21 +1233,81 @@ void DemuxThread::run() {
     }
 
     if (local_paused) {
-      if (!std::strcmp(ic->iformat->name, "rtsp") ||
-          (ic->pb && !std::strncmp(ic->url, "mmsh:", 5))) {
+      if (!timeshift && (!std::strcmp(ic->iformat->name, "rtsp") ||
+                         (ic->pb && !std::strncmp(ic->url, "mmsh:", 5)))) {
         /* wait 10 ms to avoid trying to get another packet */
         /* XXX: horrible */
         qtplay::sleep_ms(10);
         continue;
       }
     } else {
-      if ((!ctx.audio_thr || ctx.audio_thr->eofReached()) &&
+      // In trick play the video decoder is drained after every keyframe
+      if (!ctx.trick_speed &&
+          (!ctx.audio_thr || ctx.audio_thr->eofReached()) &&
           (!ctx.video_thr || ctx.video_thr->eofReached())) {
           ctx.notifyEOF();
       }
     }
 
-    handle_seeking(ctx, ic, eof, queue_attachments_req);
+    // Trick play is requested from the UI, any seek ends it
+    if (const int speed = ctx.trick_request; speed != ctx.trick_speed) {
+      if (speed && !trick.eligible(ic, realtime || timeshift)) {
+        logMsg("Trick play is not available for this input");
+        ctx.trick_request = ctx.trick_speed.load();
+      } else {
+        if (!ctx.trick_speed) {
+          trick.start(ic);
+          history.clear();
+        } else if (!speed) {
+          trick.stop(ic, dual);
+          record_alternate_tracks(ctx, ic, history_window > 0);
+          if (recorder) recorder->onSeek();
+          history.clear();
+          eof = false;
+          ctx.setDemuxerEOF(eof);
+          queue_attachments_req = true;
+        } else if ((speed > 0) != (ctx.trick_speed > 0)) {
+          trick.reverse();
+        }
+        ctx.trick_speed = speed;
+        if (speed) {
+          logMsg("Trick play: %dx", speed);
+        } else {
+          logMsg("Trick play: off");
+        }
+      }
+    }
+
+    if (handle_seeking(ctx, ic, kf_index.get(), dual,
+                       history_window > 0 && !timeshift ? &history : nullptr,
+                       timeshift.get(), eof, queue_attachments_req)) {
+      if (recorder) recorder->onSeek();
+      dual.onRepositioned();
+    }
+    dual.onStreamsChanged();
+
+    // Pre-open the next item once the end of this one is near
+    if (!realtime && !timeshift) gapless.update(ic, input_duration, eof);
+
+    if (ctx.recording_wanted != (recorder != nullptr) ||
+        (recorder && recorder->failed())) {
+      if (recorder) {
+        recorder = nullptr;
+        ctx.recording_wanted = false;
+      } else if (!(recorder = StreamRecorder::create(
+                       ic, PlayerSettings::get().record_dir))) {
+        logMsg("Recording is not possible for '%s'", ic->url);
+        ctx.recording_wanted = false;
+      }
+    }
+
+    /* The variant stays while recording, the file has the streams it had. The
+     * pre-open of the next item primes the decoders a switch would use. */
+    if (variants.active() && !gapless.started() && !recorder && !timeshift &&
+        !ctx.trick_speed && !local_paused && !eof &&
+        variants.update(ic, audio_end, video_end)) {
+      history.reset(history_window > 0 ? history_anchor(ctx, ic) : -1);
+    }
 
     if (queue_attachments_req) {
       if ((ctx.video_stream >= 0) &&
@@ -539,13 +1324,129 @@ void DemuxThread::run() {
       queue_attachments_req = false;
     }
 
+    if (ctx.trick_speed) {
+      if (!trick.step(ic, kf_index.get(), local_paused)) wait_timeout();
+      continue;
+    }
+
+    if (timeshift) {
+      // Record whatever the input delivers, it is not waited for
+      const auto read_start = qtplay::clk_now();
+      const auto read_res =
+          input_eof ? AVERROR_EOF : av_read_frame(ic, pkt.avData());
+      if (read_res >= 0) {
+        on_read(pkt.size(), NAN, read_start);
+        if (recorder) recorder->write(pkt);
+        const auto idx = pkt.streamIndex();
+        const auto av_pkt = pkt.constAvData();
+        const auto ts =
+            av_pkt->pts != AV_NOPTS_VALUE ? av_pkt->pts : av_pkt->dts;
+        // Alternate tracks, when read, are recorded too for switches
+        if (idx >= 0 && idx < (int)ic->nb_streams &&
+            ic->streams[idx]->discard != AVDISCARD_ALL &&
+            ts != AV_NOPTS_VALUE) {
+          timeshift->write(pkt, av_rescale_q(ts, ic->streams[idx]->time_base,
+                                             AVRational{1, AV_TIME_BASE}));
+        }
+        pkt.clear();
+      } else if (read_res == AVERROR_EOF || (ic->pb && avio_feof(ic->pb))) {
+        input_eof = true;
+      }
+
+      // Play from the recording
+      for (auto i = 0; i < 64; ++i) {
+        if (demux_check_buffer_fullness(ctx, streams, false) ||
+            !timeshift->read(pkt)) {
+          break;
+        }
+        eof = false;
+        ctx.setDemuxerEOF(eof);
+        queue_packet();
+      }
+      if (input_eof && !eof && timeshift->atLiveEdge()) finish_input();
+
+      // The recorded range is what the position slider covers
+      const auto start = timeshift->startTime(), end = timeshift->endTime();
+      if (start != AV_NOPTS_VALUE && end != AV_NOPTS_VALUE) {
+        ctx.timeline_offset = start / (double)AV_TIME_BASE;
+        ctx.stream_duration = (end - start) / (double)AV_TIME_BASE;
+      }
+
+      /* Behind the live edge, audio plays faster until it is caught up. The
+       * hysteresis keeps the tempo from flapping. */
+      const auto clock = ctx.best_clkval();
+      if (ctx.audio_stream >= 0 && end != AV_NOPTS_VALUE && !isnan(clock)) {
+        const auto lag = end / (double)AV_TIME_BASE - clock;
+        auto tempo = catchup_tempo;
+        if (local_paused || lag < 1.0) {
+          tempo = 1.0;
+        } else if (lag > 3.0) {
+          tempo = std::clamp(sets.timeshift_catchup, 1.0, 2.0);
+        }
+        if (tempo != catchup_tempo) {
+          catchup_tempo = tempo;
+          ctx.auddec.setTempo(tempo);
+          logMsg("Timeshift: %.1f s behind live, playing at %.2gx", lag,
+                 tempo);
+        }
+      }
+
+      if (read_res < 0) wait_timeout();
+      continue;
+    }
+
     /* if the queues are full, no need to read more */
-    if ((ctx.video_stream >= 0 || ctx.audio_stream >= 0) &&
-        demux_check_buffer_fullness(ctx, streams)) {
+    const auto dual_active = dual.active();
+    auto full = (ctx.video_stream >= 0 || ctx.audio_stream >= 0) &&
+                demux_check_buffer_fullness(ctx, streams, dual_active);
+    if (full && interleave_stall(ctx, streams))
+      dual.onInterleaveStall(ic, realtime);
+
+    if (dual_active && !full) {
+      const auto st = ctx.buffering.state();
+      const auto video_wanted = !eof && !ctx.videoq.isFull() &&
+                                !ctx.subtitleq.isFull() &&
+                                st.video_buffered < st.target_duration;
+      if (dual.audioWanted(video_wanted)) {
+        const auto read_start = qtplay::clk_now();
+        if (dual.read(pkt.avData()) >= 0) {
+          const auto end_time = packet_end_time(ic, pkt.constAvData());
+          on_read(pkt.size(),
+                  end_time != AV_NOPTS_VALUE ? end_time / (double)AV_TIME_BASE
+                                             : NAN,
+                  read_start);
+          if (recorder) recorder->write(pkt);
+          queue_packet();
+        } else if (dual.eofReached()) {
+          eof = false;
+          finish_input();
+        } else {
+          wait_timeout();
+        }
+        continue;
+      }
+      full = !video_wanted;
+    }
+
+    if (full) {
       /* wait 10 ms */
       wait_timeout();
     } else {
+      const auto read_start = qtplay::clk_now();
       const auto read_res = av_read_frame(ic, pkt.avData());
+      if (read_res >= 0) {
+        const auto av_pkt = pkt.constAvData();
+        double media_time = NAN;
+        const auto ts =
+            av_pkt->pts != AV_NOPTS_VALUE ? av_pkt->pts : av_pkt->dts;
+        if (ts != AV_NOPTS_VALUE &&
+            av_pkt->stream_index < (int)ic->nb_streams) {
+          media_time = (ts + std::max<int64_t>(av_pkt->duration, 0)) *
+                       av_q2d(ic->streams[av_pkt->stream_index]->time_base);
+        }
+        on_read(pkt.size(), media_time, read_start);
+        if (recorder) recorder->write(pkt);
+      }
       if (ic->ctx_flags & AVFMTCTX_NOHEADER)  // Streams are dynamically added
       {
       }
@@ -553,11 +1454,12 @@ void DemuxThread::run() {
       if (read_res < 0) {
         if (((read_res == AVERROR_EOF) || (ic->pb && avio_feof(ic->pb))) &&
             !eof) {
-          eof = true;
-          ctx.setDemuxerEOF(eof);
-          ctx.videoq.put_nullpacket(ctx.video_stream, true);
-          ctx.audioq.put_nullpacket(ctx.audio_stream, true);
-          ctx.subtitleq.put_nullpacket(ctx.subtitle_stream, true);
+          // Finished once the audio demuxer catches up
+          if (dual.holdEOF()) {
+            eof = true;
+          } else {
+            finish_input();
+          }
         }
 
         if (ic->pb && ic->pb->error && autoexit) {
@@ -567,23 +1469,7 @@ void DemuxThread::run() {
       } else {
         eof = false;
         ctx.setDemuxerEOF(eof);
-        const auto pkt_st_idx = pkt.streamIndex();
-        if (pkt_st_idx >= 0 &&
-            pkt_st_idx < ic->nb_streams) {  // Avoid reading garbage if input is
-                                            // corrupted
-          if (pkt_st_idx == ctx.audio_stream) {
-            ctx.audioq.put(pkt);
-          } else if ((pkt_st_idx == ctx.video_stream) &&
-                     !streams[pkt_st_idx].isAttachedPic()) {
-            ctx.videoq.put(pkt);
-          } else if (pkt_st_idx == ctx.subtitle_stream) {
-            ctx.subtitleq.put(pkt);
-          } else {
-            pkt.clear();
-          }
-        } else {
-          pkt.clear();
-        }
+        queue_packet();
       }
     }
   }
@@ -0,0 +1,138 @@
+#include "DualDemuxer.hpp"
+
+#include "../Common/PlayerContext.hpp"
+#include "../Common/PlayerSettings.hpp"
+#include "InputOpen.hpp"
+
+using qtplay::logMsg;
+
+DualDemuxer::DualDemuxer(PlayerContext& _ctx,
+                         const AVIOInterruptCB& _io_int_cb)
+    : ctx(_ctx),
+      io_int_cb(_io_int_cb),
+      mode(PlayerSettings::get().dual_demuxer) {}
+
+void DualDemuxer::reset() {
+  dmx = nullptr;
+  failed = eof_pending = false;
+  pos_known = true;
+  last_audio_pts = AV_NOPTS_VALUE;
+  interleave_stalls = 0;
+}
+
+bool DualDemuxer::eligible(const AVFormatContext* ic, bool live) const {
+  return !dmx && !failed && !live && pos_known && ctx.audio_stream >= 0 &&
+         ctx.video_stream >= 0 &&
+         !(ic->streams[ctx.video_stream]->disposition &
+           AV_DISPOSITION_ATTACHED_PIC) &&
+         !(ic->ctx_flags & AVFMTCTX_UNSEEKABLE);
+}
+
+void DualDemuxer::onInputOpened(AVFormatContext* ic, bool live) {
+  if (mode == 2 && eligible(ic, live)) start(ic);
+}
+
+void DualDemuxer::onInterleaveStall(AVFormatContext* ic, bool live) {
+  if (mode == 1 && eligible(ic, live) && ++interleave_stalls >= 3) start(ic);
+}
+
+void DualDemuxer::start(AVFormatContext* ic) {
+  const auto start = qtplay::clk_now();
+  std::unique_ptr<InputIO> io;
+  // A seek while opening would be taken for a failure
+  const auto audio_ic =
+      qtplay::openInput(ctx.filename, io_int_cb, io_int_cb, io);
+  if (!audio_ic) {
+    failed = true;
+    logMsg("Dual demuxer: could not open the input a second time");
+    return;
+  }
+  const auto nb_streams = audio_ic->nb_streams;
+  auto audio_dmx = std::make_unique<StreamDemuxer>(audio_ic, std::move(io),
+                                                   ctx.audio_stream);
+  if (nb_streams != ic->nb_streams || !audio_dmx->resumeAfter(last_audio_pts)) {
+    failed = true;
+    logMsg("Dual demuxer: the second instance does not match the input");
+    return;
+  }
+
+  audio_ic->interrupt_callback = ic->interrupt_callback;
+  ic->streams[ctx.audio_stream]->discard = AVDISCARD_ALL;
+  dmx = std::move(audio_dmx);
+  logMsg("Dual demuxer: audio is read separately (opened in %.1f ms)",
+         std::chrono::duration<double, std::milli>(qtplay::clk_now() - start)
+             .count());
+}
+
+void DualDemuxer::onAudioPacket(AVFormatContext* ic, int64_t ts) {
+  if (ts == AV_NOPTS_VALUE) return;
+  last_audio_pts = ts;
+  pos_known = true;
+
+  // The main demuxer found where audio is after a byte seek
+  if (!dmx || !dmx->suspended()) return;
+  if (dmx->resumeAfter(ts)) {
+    ic->streams[dmx->streamIndex()]->discard = AVDISCARD_ALL;
+  } else {
+    dmx = nullptr;
+    logMsg("Dual demuxer: audio is read by the main demuxer again");
+  }
+}
+
+void DualDemuxer::onStreamsChanged() {
+  if (dmx && dmx->streamIndex() != ctx.audio_stream) {
+    dmx = nullptr;
+    eof_pending = false;
+  }
+}
+
+void DualDemuxer::followSeek(AVFormatContext* ic, int64_t min_ts, int64_t ts,
+                             int64_t max_ts, bool by_bytes, int64_t time) {
+  if (!dmx) return;
+
+  /* By time: in an input interleaved badly enough to need it, the byte
+   * position of a video keyframe holds audio of another time */
+  auto res = 0;
+  if (!by_bytes) {
+    res = dmx->seek(min_ts, ts, max_ts, 0);
+  } else if (time != AV_NOPTS_VALUE) {
+    res = dmx->seek(INT64_MIN, time, time, 0);
+  } else {
+    // Resumed after the first audio packet the main demuxer reads
+    dmx->suspend();
+  }
+  if (res < 0) logMsg("Audio demuxer: error while seeking");
+  ic->streams[dmx->streamIndex()]->discard =
+      dmx->suspended() ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+}
+
+void DualDemuxer::seekTo(int64_t ts) {
+  if (dmx && dmx->seek(INT64_MIN, ts, ts, 0) < 0)
+    logMsg("Audio demuxer: error while seeking");
+}
+
+void DualDemuxer::onRepositioned() {
+  eof_pending = false;
+  // Until audio is read again, it is not known where to resume it from
+  pos_known = dmx != nullptr;
+}
+
+bool DualDemuxer::audioWanted(bool video_wanted) const {
+  // Each demuxer reads as long as its own queue is below the target
+  const auto st = ctx.buffering.state();
+  return !dmx->eof() && !ctx.audioq.isFull() &&
+         st.audio_buffered < st.target_duration &&
+         (!video_wanted || st.audio_buffered <= st.video_buffered);
+}
+
+bool DualDemuxer::holdEOF() {
+  if (!active() || dmx->eof()) return false;
+  eof_pending = true;
+  return true;
+}
+
+bool DualDemuxer::eofReached() {
+  if (!eof_pending || !dmx->eof()) return false;
+  eof_pending = false;
+  return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "StreamDemuxer.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QtGlobal>
+#include <memory>
+
+struct PlayerContext;
+
+/* Dual-demuxer mode: audio is read through a second instance of the input,
+ * either from the start or once the main demuxer keeps filling one queue
+ * while the other runs dry. The main demuxer then skips the audio stream,
+ * and its EOF is held back until the audio demuxer catches up.
+ * Demux thread only. */
+class DualDemuxer final {
+  Q_DISABLE_COPY_MOVE(DualDemuxer);
+
+ public:
+  /* 'io_int_cb' interrupts the opening of the second instance, which a seek
+   * would otherwise make fail */
+  DualDemuxer(PlayerContext& ctx, const AVIOInterruptCB& io_int_cb);
+  ~DualDemuxer() = default;
+
+  // A new input: audio is read by the main demuxer
+  void reset();
+
+  StreamDemuxer* demuxer() const { return dmx.get(); }
+  // Audio is read by the second instance at the moment
+  bool active() const { return dmx && !dmx->suspended(); }
+
+  /* The input was opened, or chained to: in the "always" mode, the second
+   * instance is opened right away. 'live' inputs are never read twice. */
+  void onInputOpened(AVFormatContext* ic, bool live);
+  /* The main demuxer filled a queue while the other one ran dry: in the
+   * automatic mode, the third time opens the second instance */
+  void onInterleaveStall(AVFormatContext* ic, bool live);
+  /* An audio packet was queued, with its timestamp in the stream time base.
+   * It tells where the second instance continues from, once opened or after
+   * a byte seek. */
+  void onAudioPacket(AVFormatContext* ic, int64_t ts);
+  // Another audio track was selected, which the main demuxer reads
+  void onStreamsChanged();
+
+  /* Follows a seek of the main demuxer: with the same arguments, or by time
+   * after a byte seek. 'time' is the time the main demuxer went to
+   * (AV_TIME_BASE units), AV_NOPTS_VALUE if not known. */
+  void followSeek(AVFormatContext* ic, int64_t min_ts, int64_t ts,
+                  int64_t max_ts, bool by_bytes, int64_t time);
+  // Seeks to 'ts' or before, after the main demuxer did
+  void seekTo(int64_t ts);
+  // The main demuxer was repositioned, whether it was followed or not
+  void onRepositioned();
+
+  // Whether audio is read next, given whether video would be
+  bool audioWanted(bool video_wanted) const;
+  // Reads the next audio packet, as av_read_frame()
+  int read(AVPacket* pkt) { return dmx->read(pkt); }
+  /* The main demuxer reached the end. Returns true if that is held back until
+   * the second instance reaches it too. */
+  bool holdEOF();
+  // The end held back is reached, and the input is finished
+  bool eofReached();
+
+ private:
+  PlayerContext& ctx;
+  const AVIOInterruptCB io_int_cb;
+  const int mode;  // PlayerSettings::dual_demuxer
+
+  std::unique_ptr<StreamDemuxer> dmx;
+  bool failed = false;     // For the current input
+  bool pos_known = true;   // last_audio_pts is where audio is
+  bool eof_pending = false;
+  int64_t last_audio_pts = AV_NOPTS_VALUE;
+  int interleave_stalls = 0;
+
+  bool eligible(const AVFormatContext* ic, bool live) const;
+  // Audio continues from its own demuxer after the last packet queued
+  void start(AVFormatContext* ic);
+};
@@ -0,0 +1,93 @@
+#include "GaplessChain.hpp"
+
+#include "../Common/PlayerContext.hpp"
+#include "../Common/PlayerSettings.hpp"
+#include "../VideoOutput/GLWindow.hpp"
+#include "../Widgets/QtPlayGUI.hpp"
+#include "../Widgets/VideoDisplayWidget.hpp"
+#include "InputOpen.hpp"
+
+using qtplay::logMsg;
+
+GaplessChain::GaplessChain(PlayerContext& _ctx,
+                           const AVIOInterruptCB& _io_int_cb)
+    : ctx(_ctx), io_int_cb(_io_int_cb) {}
+
+/* Opens the input and primes ctx.next_auddec/next_viddec for it. Runs in the
+ * background while the current input is still being played. */
+std::unique_ptr<PendingInput> GaplessChain::open(PlayerContext& ctx,
+                                                 std::string url,
+                                                 AVIOInterruptCB int_cb) {
+  const auto start = qtplay::clk_now();
+  auto next = std::make_unique<PendingInput>();
+  next->url = std::move(url);
+  if (!(next->ic = qtplay::openInput(next->url, int_cb, int_cb, next->io)))
+    return nullptr;
+
+  const auto ic = next->ic;
+  int sub_idx = -1;
+  qtplay::findDefaultStreams(ic, next->video_idx, next->audio_idx, sub_idx);
+  for (auto i = 0; i < (int)ic->nb_streams; ++i)
+    ic->streams[i]->discard = AVDISCARD_ALL;
+
+  if (next->audio_idx >= 0) {
+    ic->streams[next->audio_idx]->discard = AVDISCARD_DEFAULT;
+    if (!ctx.next_auddec.init(Stream(ic, next->audio_idx)))
+      next->audio_idx = -1;
+  }
+  if (next->video_idx >= 0) {
+    ic->streams[next->video_idx]->discard = AVDISCARD_DEFAULT;
+    const auto display_size =
+        QtPlayGUI::instance().videoWidget()->getVideoOutput()->displaySize();
+    ctx.next_viddec.setDisplaySize(display_size.width(),
+                                   display_size.height());
+    ctx.next_viddec.setLowLatency(PlayerSettings::get().low_latency);
+    if (!ctx.next_viddec.init(Stream(ic, next->video_idx)))
+      next->video_idx = -1;
+  }
+
+  logMsg("Next input pre-opened in %.1f ms: '%s'",
+         std::chrono::duration<double, std::milli>(qtplay::clk_now() - start)
+             .count(),
+         next->url.c_str());
+
+  return next;
+}
+
+void GaplessChain::update(const AVFormatContext* ic, double duration,
+                          bool eof) {
+  if (!PlayerSettings::get().gapless || tried || ctx.pending_audio_switch ||
+      ctx.pending_video_switch)
+    return;
+
+  const auto pos = ctx.best_clkval() -
+                   ctx.pts_offset / (double)AV_TIME_BASE -
+                   (ic->start_time != AV_NOPTS_VALUE
+                        ? ic->start_time / (double)AV_TIME_BASE
+                        : 0.0);
+  if (!(eof || pos >= duration - preopen_margin)) return;
+
+  tried = true;
+  if (auto url = ctx.takeNextURL(); !url.empty()) {
+    next_input = std::async(std::launch::async, open, std::ref(ctx),
+                            std::move(url), io_int_cb);
+  }
+}
+
+std::unique_ptr<PendingInput> GaplessChain::take() {
+  if (!next_input.valid()) return nullptr;
+
+  auto next = next_input.get();
+  if (!next || (ctx.audio_stream >= 0) != (next->audio_idx >= 0) ||
+      (ctx.video_stream >= 0) != (next->video_idx >= 0)) {
+    ctx.next_auddec.destroy();
+    ctx.next_viddec.destroy();
+    return nullptr;
+  }
+
+  return next;
+}
+
+void GaplessChain::close() {
+  if (next_input.valid()) next_input.get();
+}
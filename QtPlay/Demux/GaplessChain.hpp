@@ -0,0 +1,69 @@
+#pragma once
+
+#include "InputIO.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QtGlobal>
+#include <future>
+#include <memory>
+#include <string>
+
+struct PlayerContext;
+
+/* The next playlist item, opened ahead of time for gapless playback */
+struct PendingInput final {
+  Q_DISABLE_COPY_MOVE(PendingInput);
+  PendingInput() = default;
+  ~PendingInput() { avformat_close_input(&ic); }
+
+  std::string url;
+  AVFormatContext* ic = nullptr;
+  std::unique_ptr<InputIO> io;  // Outlives ic
+  int audio_idx = -1, video_idx = -1;
+};
+
+/* Gapless playback: once the end of the current item is near, the next
+ * playlist item is opened on a background thread, which primes
+ * ctx.next_auddec and next_viddec for it. The demux thread then continues
+ * with it instead of signalling EOF. The next decoders are taken from the
+ * start of the pre-open until the item is chained to or dropped, so nothing
+ * else may prime them meanwhile. Demux thread only. */
+class GaplessChain final {
+  Q_DISABLE_COPY_MOVE(GaplessChain);
+
+ public:
+  /* 'io_int_cb' interrupts the pre-open, which must not fail on the seeks of
+   * the input being played */
+  GaplessChain(PlayerContext& ctx, const AVIOInterruptCB& io_int_cb);
+  ~GaplessChain() { close(); }
+
+  // The next item was looked for since the current one was opened
+  bool started() const { return tried; }
+  /* Starts the pre-open once the position is within preopen_margin of the
+   * 'duration' of 'ic' (seconds), or at 'eof', and the decoding threads are
+   * done with the previous item */
+  void update(const AVFormatContext* ic, double duration, bool eof);
+  /* The pre-opened item at the end of the current one, if it can follow it
+   * with the decoding threads as they are: both must have the same kinds of
+   * streams. Returns nullptr otherwise, and frees the next decoders. */
+  std::unique_ptr<PendingInput> take();
+  // The current item was chained to, the next one is looked for again
+  void reset() { tried = false; }
+  // Waits for the pre-open and closes what it opened
+  void close();
+
+ private:
+  static constexpr double preopen_margin = 10.0;
+
+  PlayerContext& ctx;
+  const AVIOInterruptCB io_int_cb;
+  std::future<std::unique_ptr<PendingInput>> next_input;
+  bool tried = false;
+
+  static std::unique_ptr<PendingInput> open(PlayerContext& ctx,
+                                            std::string url,
+                                            AVIOInterruptCB int_cb);
+};
@@ -0,0 +1,342 @@
+#include "HttpCacheIO.hpp"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+}
+
+#include "../Common/QtPlayCommon.hpp"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+struct HttpCacheIO::Entry {
+  Q_DISABLE_COPY_MOVE(Entry);
+
+  static constexpr quint32 file_magic = 0x51504843;  // "QPHC"
+  static constexpr quint32 file_version = 1;
+
+  Entry() = default;
+  ~Entry() { save(); }
+
+  std::mutex mtx;
+  std::string url, validator;
+  int64_t size = 0, max_bytes = 0;
+  QString index_path;
+  QFile data;  // Blocks, in the order they were stored
+  std::vector<int64_t> offsets;  // Of each block in 'data', -1 if not there
+  bool dirty = false;
+
+  bool load();
+  void save();
+  bool readBlock(int64_t index, uint8_t* buf, int len);
+  void writeBlock(int64_t index, const uint8_t* buf, int len);
+};
+
+bool HttpCacheIO::Entry::load() {
+  QFile file(index_path);
+  if (!file.open(QIODevice::ReadOnly)) return false;
+
+  QDataStream in(&file);
+  quint32 magic = 0, version = 0;
+  QString stored_url, stored_validator;
+  qint64 stored_size = 0, count = 0;
+  qint32 stored_block_size = 0;
+  in >> magic >> version >> stored_url >> stored_validator >> stored_size >>
+      stored_block_size >> count;
+  if (magic != file_magic || version != file_version ||
+      stored_url.toStdString() != url ||
+      stored_validator.toStdString() != validator || stored_size != size ||
+      stored_block_size != block_size || count < 0 ||
+      count > (qint64)offsets.size())
+    return false;
+
+  const auto data_size = QFileInfo(data.fileName()).size();
+  for (qint64 i = 0; i < count; ++i) {
+    qint64 index = 0, offset = 0;
+    in >> index >> offset;
+    if (index < 0 || index >= (qint64)offsets.size() || offset < 0 ||
+        offset + std::min<int64_t>(block_size, size - index * block_size) >
+            data_size)
+      return false;
+    offsets[index] = offset;
+  }
+
+  return in.status() == QDataStream::Ok;
+}
+
+void HttpCacheIO::Entry::save() {
+  std::scoped_lock lck(mtx);
+  if (!dirty) return;
+
+  QSaveFile file(index_path);
+  if (!file.open(QIODevice::WriteOnly)) return;
+
+  QDataStream out(&file);
+  const auto count = std::count_if(offsets.begin(), offsets.end(),
+                                   [](int64_t offset) { return offset >= 0; });
+  out << file_magic << file_version << QString::fromStdString(url)
+      << QString::fromStdString(validator) << (qint64)size
+      << (qint32)block_size << (qint64)count;
+  for (auto i = 0; i < (int)offsets.size(); ++i) {
+    if (offsets[i] >= 0) out << (qint64)i << (qint64)offsets[i];
+  }
+  if (out.status() == QDataStream::Ok && file.commit()) dirty = false;
+}
+
+bool HttpCacheIO::Entry::readBlock(int64_t index, uint8_t* buf, int len) {
+  std::scoped_lock lck(mtx);
+  const auto offset = offsets[index];
+  return offset >= 0 && data.seek(offset) &&
+         data.read(reinterpret_cast<char*>(buf), len) == len;
+}
+
+void HttpCacheIO::Entry::writeBlock(int64_t index, const uint8_t* buf,
+                                    int len) {
+  std::scoped_lock lck(mtx);
+  const auto offset = data.size();
+  if (offsets[index] >= 0 || offset + len > max_bytes) return;
+  if (!data.seek(offset) ||
+      data.write(reinterpret_cast<const char*>(buf), len) != len)
+    return;
+  offsets[index] = offset;
+  dirty = true;
+}
+
+HttpCacheIO::HttpCacheIO(AVIOContext* _source, std::shared_ptr<Entry> _entry,
+                         int64_t _file_size)
+    : source(_source),
+      entry(std::move(_entry)),
+      file_size(_file_size),
+      block(block_size) {
+  constexpr int avio_buf_size = 32 * 1024;
+  const auto avio_buf = static_cast<unsigned char*>(av_malloc(avio_buf_size));
+  if (avio_buf) {
+    pb = avio_alloc_context(
+        avio_buf, avio_buf_size, 0, this,
+        [](void* opaque, uint8_t* buf, int size) {
+          return static_cast<HttpCacheIO*>(opaque)->read(buf, size);
+        },
+        nullptr,
+        [](void* opaque, int64_t offset, int whence) {
+          return static_cast<HttpCacheIO*>(opaque)->seek(offset, whence);
+        });
+    if (!pb) av_free(avio_buf);
+  }
+
+  if (pb) pb->seekable = AVIO_SEEKABLE_NORMAL;
+}
+
+HttpCacheIO::~HttpCacheIO() {
+  if (pb) {
+    av_freep(&pb->buffer);
+    avio_context_free(&pb);
+  }
+  avio_closep(&source);
+}
+
+std::unique_ptr<HttpCacheIO> HttpCacheIO::open(const std::string& url,
+                                               const AVIOInterruptCB* int_cb,
+                                               int64_t max_bytes,
+                                               AVIOContext** uncached) {
+  *uncached = nullptr;
+  if (url.rfind("http://", 0) != 0 && url.rfind("https://", 0) != 0)
+    return nullptr;
+
+  AVIOContext* source = nullptr;
+  if (avio_open2(&source, url.c_str(), AVIO_FLAG_READ, int_cb, nullptr) < 0) {
+    return nullptr;
+  }
+
+  // Live streams, and servers that do not take range requests, are not
+  // cached
+  const auto size = avio_size(source);
+  if (size <= 0 || !(source->seekable & AVIO_SEEKABLE_NORMAL)) {
+    *uncached = source;
+    return nullptr;
+  }
+
+  uint8_t* mime_type = nullptr;
+  av_opt_get(source, "mime_type", AV_OPT_SEARCH_CHILDREN, &mime_type);
+  const auto validator =
+      std::to_string(size) + "|" +
+      (mime_type ? reinterpret_cast<const char*>(mime_type) : "");
+  av_free(mime_type);
+
+  auto entry = acquire(url, validator, size, max_bytes);
+  if (!entry) {
+    *uncached = source;
+    return nullptr;
+  }
+
+  std::unique_ptr<HttpCacheIO> io(
+      new HttpCacheIO(source, std::move(entry), size));
+  if (!io->avio()) io = nullptr;
+
+  return io;
+}
+
+std::shared_ptr<HttpCacheIO::Entry> HttpCacheIO::acquire(
+    const std::string& url, const std::string& validator, int64_t size,
+    int64_t max_bytes) {
+  static std::mutex registry_mtx;
+  static std::map<QString, std::weak_ptr<Entry>> registry;
+
+  const QDir dir(
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+      "/http");
+  if (!dir.mkpath(".")) return nullptr;
+  const auto key = QString::fromLatin1(
+      QCryptographicHash::hash(QByteArray::fromStdString(url),
+                               QCryptographicHash::Sha1)
+          .toHex());
+
+  std::scoped_lock lck(registry_mtx);
+  std::erase_if(registry,
+                [](const auto& item) { return item.second.expired(); });
+  // The last owner may have let go since the expired entries were erased
+  if (const auto it = registry.find(key); it != registry.end()) {
+    if (auto shared = it->second.lock())
+      return shared->validator == validator ? shared : nullptr;
+    registry.erase(it);
+  }
+
+  auto entry = std::make_shared<Entry>();
+  entry->url = url;
+  entry->validator = validator;
+  entry->size = size;
+  entry->index_path = dir.filePath(key + ".idx");
+  entry->data.setFileName(dir.filePath(key + ".data"));
+  entry->offsets.assign((size + block_size - 1) / block_size, -1);
+  if (!entry->load()) {
+    // New, or changed on the server
+    QFile::remove(entry->index_path);
+    QFile::remove(entry->data.fileName());
+    std::fill(entry->offsets.begin(), entry->offsets.end(), -1);
+  }
+  if (!entry->data.open(QIODevice::ReadWrite | QIODevice::Unbuffered))
+    return nullptr;
+  // Rewriting the index marks the entry as the most recently used
+  entry->dirty = true;
+  entry->save();
+
+  /* Evict the least recently used entries, but not those in use, to make
+   * room for this one to grow to the whole file. It is then held to what
+   * the others leave. */
+  const auto wanted = std::min(size, max_bytes);
+  int64_t others = 0;
+  const auto indexes =
+      dir.entryInfoList({"*.idx"}, QDir::Files, QDir::Time);  // Newest first
+  for (const auto& info : indexes) {
+    const auto other = info.completeBaseName();
+    if (other == key) continue;
+    const auto data_path = dir.filePath(other + ".data");
+    const auto data_size = QFileInfo(data_path).size();
+    if (others + data_size + wanted > max_bytes && !registry.count(other)) {
+      QFile::remove(info.filePath());
+      QFile::remove(data_path);
+      continue;
+    }
+    others += data_size;
+  }
+  entry->max_bytes = std::max<int64_t>(max_bytes - others, entry->data.size());
+
+  registry[key] = entry;
+  return entry;
+}
+
+HttpCacheIO::Stats HttpCacheIO::stats() const {
+  Stats st;
+  st.bytes_read = miss_bytes;
+  st.cache_hit_bytes = hit_bytes;
+  st.cache_miss_bytes = miss_bytes;
+  const auto seconds = source_seconds.load();
+  st.throughput = seconds > 0.0 ? miss_bytes / seconds : 0.0;
+  return st;
+}
+
+int HttpCacheIO::load_block(int64_t index) {
+  const auto start = index * block_size;
+  const auto len = (int)std::min<int64_t>(block_size, file_size - start);
+  block_index = -1;
+
+  if (entry->readBlock(index, block.data(), len)) {
+    hit_bytes += len;
+    block_len = len;
+  } else {
+    // The source is only positioned on a miss, which is where it usually is
+    if (source_pos != start) {
+      const auto ret = avio_seek(source, start, SEEK_SET);
+      if (ret < 0) return (int)ret;
+      source_pos = start;
+    }
+    const auto read_start = qtplay::clk_now();
+    const auto ret = avio_read(source, block.data(), len);
+    source_seconds = source_seconds + std::chrono::duration<double>(
+                                          qtplay::clk_now() - read_start)
+                                          .count();
+    if (ret == AVERROR_EXIT) {
+      // Interrupted: the block is read again, from a known position
+      source->error = 0;
+      source->eof_reached = 0;
+      source_pos = -1;
+    }
+    if (ret <= 0) return ret < 0 ? ret : AVERROR_EOF;
+    source_pos += ret;
+    miss_bytes += ret;
+    block_len = ret;
+    // A short block is served, but it is not stored
+    if (ret == len) entry->writeBlock(index, block.data(), len);
+  }
+  block_index = index;
+
+  return 0;
+}
+
+int HttpCacheIO::read(uint8_t* buf, int size) {
+  if (pos >= file_size) return AVERROR_EOF;
+
+  const auto index = pos / block_size;
+  if (index != block_index) {
+    const auto ret = load_block(index);
+    if (ret < 0) return ret;
+  }
+
+  const auto offset = (int)(pos - index * block_size);
+  if (offset >= block_len) {
+    return source->error ? source->error : AVERROR_EOF;
+  }
+  const auto n = std::min(size, block_len - offset);
+  std::memcpy(buf, block.data() + offset, n);
+  pos += n;
+
+  return n;
+}
+
+int64_t HttpCacheIO::seek(int64_t offset, int whence) {
+  whence &= ~AVSEEK_FORCE;
+  if (whence == AVSEEK_SIZE) return file_size;
+
+  int64_t target = offset;
+  if (whence == SEEK_CUR) {
+    target += pos;
+  } else if (whence == SEEK_END) {
+    target += file_size;
+  } else if (whence != SEEK_SET) {
+    return AVERROR(EINVAL);
+  }
+  if (target < 0) return AVERROR(EINVAL);
+
+  pos = target;
+  return pos;
+}
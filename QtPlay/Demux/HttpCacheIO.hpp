@@ -0,0 +1,66 @@
+#pragma once
+
+#include "InputIO.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Disk cache of HTTP(S) inputs, below the read-ahead, so that watching again
+ * or seeking back does not download the data again.
+ *
+ * The input is read from the server in fixed blocks, with range requests
+ * where it is not read in order. Blocks are appended to the entry's data
+ * file as they arrive, and the index of the entry maps them to their place
+ * in the input. Entries are keyed by the URL and validated with the size and
+ * content type the server reports, as libavformat does not expose ETag or
+ * Last-Modified. The cache is bounded in size: the least recently used
+ * entries are evicted when an input is opened. An input opened twice at once
+ * (e.g. by the dual demuxer) shares its entry. */
+class HttpCacheIO final : public InputIO {
+ public:
+  ~HttpCacheIO() override;
+
+  /* Opens 'url' if it is an HTTP(S) input of a known size, which can be
+   * cached in up to 'max_bytes'. Otherwise returns nullptr, and the context
+   * opened meanwhile, if any, in 'uncached', so that the caller does not
+   * have to open it again. */
+  static std::unique_ptr<HttpCacheIO> open(const std::string& url,
+                                           const AVIOInterruptCB* int_cb,
+                                           int64_t max_bytes,
+                                           AVIOContext** uncached);
+
+  AVIOContext* avio() const override { return pb; }
+  Stats stats() const override;
+  const char* name() const override { return "HTTP cache"; }
+
+ private:
+  struct Entry;
+
+  static constexpr int block_size = 128 * 1024;
+
+  AVIOContext* source = nullptr;
+  AVIOContext* pb = nullptr;
+  std::shared_ptr<Entry> entry;
+  const int64_t file_size;
+  int64_t pos = 0, source_pos = 0;
+
+  // The block being read, from the cache or from the source
+  std::vector<uint8_t> block;
+  int64_t block_index = -1;
+  int block_len = 0;
+
+  std::atomic<int64_t> hit_bytes = 0, miss_bytes = 0;
+  std::atomic<double> source_seconds = 0.0;  // Spent downloading
+
+  HttpCacheIO(AVIOContext* source, std::shared_ptr<Entry> entry,
+              int64_t file_size);
+
+  static std::shared_ptr<Entry> acquire(const std::string& url,
+                                        const std::string& validator,
+                                        int64_t size, int64_t max_bytes);
+  int load_block(int64_t index);
+  int read(uint8_t* buf, int size);
+  int64_t seek(int64_t offset, int whence);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+#include <QtGlobal>
+#include <cstdint>
+
+/* Custom I/O of a demuxer input. The AVIOContext is owned by the object and
+ * must outlive the AVFormatContext that uses it. */
+class InputIO {
+  Q_DISABLE_COPY_MOVE(InputIO);
+
+ public:
+  struct Stats {
+    int64_t bytes_buffered = 0;  // Ahead of the read position
+    int64_t bytes_read = 0;      // From the source, in total
+    double stall_ms = 0.0;       // Time the demuxer waited for data
+    double throughput = 0.0;     // Source throughput, bytes/s; 0 if unknown
+    int64_t cache_hit_bytes = 0;   // Served from the disk cache
+    int64_t cache_miss_bytes = 0;  // Downloaded, whether stored or not
+  };
+
+  InputIO() = default;
+  virtual ~InputIO() = default;
+
+  virtual AVIOContext* avio() const = 0;
+  virtual Stats stats() const = 0;
+  virtual const char* name() const = 0;
+};
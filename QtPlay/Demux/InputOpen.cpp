@@ -0,0 +1,102 @@
+#include "InputOpen.hpp"
+
+#include "../Common/PlayerSettings.hpp"
+#include "../Common/QtPlayCommon.hpp"
+#include "HttpCacheIO.hpp"
+#include "KeyframeReader.hpp"
+#include "MappedFileIO.hpp"
+#include "ReadAheadIO.hpp"
+
+using qtplay::logMsg;
+
+std::unique_ptr<InputIO> qtplay::openInputIO(const std::string& url,
+                                             const AVIOInterruptCB* int_cb) {
+  const auto& sets = PlayerSettings::get();
+  if (sets.memory_map) {
+    if (auto io = MappedFileIO::open(url)) return io;
+  }
+
+  // The disk cache sits below the read-ahead, if both are enabled
+  AVIOContext* source = nullptr;
+  std::unique_ptr<HttpCacheIO> cache;
+  if (sets.http_cache_mb > 0) {
+    cache = HttpCacheIO::open(url, int_cb, sets.http_cache_mb * 1048576LL,
+                              &source);
+  }
+
+  if (sets.readahead_kb <= 0) {
+    avio_closep(&source);
+    return cache;
+  }
+
+  const auto buffer_size = sets.readahead_kb * 1024,
+             back_size = sets.readahead_back_kb * 1024;
+  std::unique_ptr<ReadAheadIO> io;
+  if (cache) {
+    io = std::make_unique<ReadAheadIO>(std::move(cache), int_cb, buffer_size,
+                                       back_size);
+  } else if (source) {
+    io = std::make_unique<ReadAheadIO>(source, int_cb, buffer_size,
+                                       back_size);
+  } else {
+    io = ReadAheadIO::open(url, int_cb, buffer_size, back_size);
+  }
+  if (io && !io->avio()) io = nullptr;
+  if (!io) logMsg("Read-ahead is not available for '%s'", url.c_str());
+
+  return io;
+}
+
+AVFormatContext* qtplay::openInput(const std::string& url,
+                                   const AVIOInterruptCB& int_cb,
+                                   const AVIOInterruptCB& io_int_cb,
+                                   std::unique_ptr<InputIO>& io) {
+  auto ic = avformat_alloc_context();
+  if (!ic) return nullptr;
+
+  ic->interrupt_callback = int_cb;
+  if ((io = openInputIO(url, &io_int_cb))) {
+    ic->pb = io->avio();
+    ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+
+  AVDictionary* format_opts = nullptr;
+  KeyframeReader::setFormatOptions(&format_opts);
+  const auto open_res =
+      avformat_open_input(&ic, url.c_str(), nullptr, &format_opts);
+  av_dict_free(&format_opts);
+  if (open_res < 0) return nullptr;
+
+  ic->flags |= AVFMT_FLAG_GENPTS;
+  av_format_inject_global_side_data(ic);
+  if (avformat_find_stream_info(ic, nullptr) < 0) {
+    avformat_close_input(&ic);
+    return nullptr;
+  }
+
+  return ic;
+}
+
+void qtplay::findDefaultStreams(const AVFormatContext* ic, int& video_idx,
+                                int& audio_idx, int& sub_idx) {
+  video_idx = audio_idx = sub_idx = -1;
+  for (auto i = 0; i < (int)ic->nb_streams; ++i) {
+    const auto st = ic->streams[i];
+    switch (st->codecpar->codec_type) {
+      case AVMEDIA_TYPE_VIDEO:
+        if (video_idx < 0 || (ic->streams[video_idx]->disposition &
+                              AV_DISPOSITION_ATTACHED_PIC)) {
+          video_idx = i;
+        }
+        break;
+      case AVMEDIA_TYPE_AUDIO:
+        audio_idx = i;
+        break;
+      case AVMEDIA_TYPE_SUBTITLE:
+        sub_idx = i;
+        break;
+      default:
+        break;
+    }
+  }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "InputIO.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <memory>
+#include <string>
+
+namespace qtplay {
+/* Opens the I/O of an input, so that reading and seeking are decoupled from
+ * the demux thread: local files are memory-mapped, everything else is read
+ * ahead. Returns nullptr if the demuxer should open the url by itself (both
+ * disabled, or the url is not something avio can open). */
+std::unique_ptr<InputIO> openInputIO(const std::string& url,
+                                     const AVIOInterruptCB* int_cb);
+/* Opens an additional input with its streams probed, for the demux thread's
+ * own use. 'io' receives the custom I/O, which must outlive the context;
+ * it is interrupted by 'io_int_cb' only. */
+AVFormatContext* openInput(const std::string& url,
+                           const AVIOInterruptCB& int_cb,
+                           const AVIOInterruptCB& io_int_cb,
+                           std::unique_ptr<InputIO>& io);
+/* Picks the streams played by default: the last audio and subtitle streams,
+ * and the first video stream that is not just an attached picture */
+void findDefaultStreams(const AVFormatContext* ic, int& video_idx,
+                        int& audio_idx, int& sub_idx);
+}  // namespace qtplay
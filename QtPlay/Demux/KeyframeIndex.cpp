@@ -0,0 +1,191 @@
+#include "KeyframeIndex.hpp"
+
+#include "../Common/CachePaths.hpp"
+#include "../Common/QtPlayCommon.hpp"
+#include "KeyframeReader.hpp"
+
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+
+using qtplay::logMsg;
+
+KeyframeIndex::KeyframeIndex(const std::string& _url, int _stream)
+    : url(_url),
+      stream(_stream),
+      cache_file(qtplay::mediaCachePath(_url, "KeyframeIndex", "idx")) {
+  load();
+}
+
+KeyframeIndex::~KeyframeIndex() {
+  abort_scan = true;
+  if (scanner.joinable()) scanner.join();
+  save();
+}
+
+bool KeyframeIndex::isUseful(const AVFormatContext* ic) {
+  if (ic->iformat->flags & AVFMT_NO_BYTE_SEEK) return false;
+  if (ic->iformat->flags & AVFMT_TS_DISCONT) return true;
+
+  for (unsigned i = 0; i < ic->nb_streams; ++i) {
+    const auto st = ic->streams[i];
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+        !(st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+      return avformat_index_get_entries_count(st) < 2;
+    }
+  }
+
+  return false;
+}
+
+void KeyframeIndex::add(int64_t pts, int64_t pos) {
+  if (pts == AV_NOPTS_VALUE || pos < 0 || discontinuous) return;
+
+  std::scoped_lock lck(mtx);
+  const auto it =
+      std::lower_bound(entries.begin(), entries.end(), pts,
+                       [](const Entry& e, int64_t val) { return e.pts < val; });
+  // Out of order with its neighbours, the timestamps jumped back in between
+  if ((it != entries.end() && it->pos < pos) ||
+      (it != entries.begin() && std::prev(it)->pos > pos)) {
+    entries.clear();
+    discontinuous = dirty = true;
+    logMsg("Keyframe index: timestamp discontinuity, not indexed");
+    return;
+  }
+  if ((it != entries.end() && it->pts - pts < min_spacing) ||
+      (it != entries.begin() && pts - std::prev(it)->pts < min_spacing)) {
+    return;
+  }
+
+  entries.insert(it, {pts, pos});
+  dirty = true;
+}
+
+void KeyframeIndex::addPacket(const AVFormatContext* ic, const AVPacket* pkt) {
+  if (!(pkt->flags & AV_PKT_FLAG_KEY) || pkt->pos < 0 ||
+      pkt->stream_index != stream || stream >= (int)ic->nb_streams) {
+    return;
+  }
+
+  const auto ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+  if (ts == AV_NOPTS_VALUE) return;
+  add(av_rescale_q(ts, ic->streams[pkt->stream_index]->time_base,
+                   {1, AV_TIME_BASE}),
+      pkt->pos);
+}
+
+std::optional<KeyframeIndex::Entry> KeyframeIndex::lookup(
+    int64_t target) const {
+  std::scoped_lock lck(mtx);
+  if (discontinuous) return std::nullopt;
+  const auto it = std::upper_bound(
+      entries.begin(), entries.end(), target,
+      [](int64_t val, const Entry& e) { return val < e.pts; });
+  if (it == entries.begin()) return std::nullopt;
+  // Unless the whole input was scanned, there may be closer keyframes that
+  // were not seen yet
+  if (!scan_complete &&
+      (it == entries.end() || it->pts - std::prev(it)->pts > max_gap)) {
+    return std::nullopt;
+  }
+
+  return *std::prev(it);
+}
+
+std::size_t KeyframeIndex::size() const {
+  std::scoped_lock lck(mtx);
+  return entries.size();
+}
+
+void KeyframeIndex::load() {
+  if (cache_file.isEmpty()) return;
+
+  QFile file(cache_file);
+  if (!file.open(QIODevice::ReadOnly)) return;
+
+  QDataStream in(&file);
+  quint32 magic = 0, version = 0;
+  qint32 file_stream = -1;
+  bool complete = false, discont = false;
+  qint64 count = 0;
+  in >> magic >> version >> file_stream >> complete >> discont >> count;
+  // The index of another stream is built again
+  if (magic != file_magic || version != file_version ||
+      file_stream != stream || count < 0)
+    return;
+
+  std::vector<Entry> loaded(count);
+  for (auto& e : loaded) {
+    qint64 pts = 0, pos = 0;
+    in >> pts >> pos;
+    e = {pts, pos};
+  }
+  if (in.status() != QDataStream::Ok) return;
+
+  std::scoped_lock lck(mtx);
+  entries = std::move(loaded);
+  scan_complete = complete;
+  discontinuous = discont;
+}
+
+void KeyframeIndex::save() {
+  if (cache_file.isEmpty() || !dirty) return;
+
+  QSaveFile file(cache_file);
+  if (!file.open(QIODevice::WriteOnly)) return;
+
+  QDataStream out(&file);
+  std::scoped_lock lck(mtx);
+  out << file_magic << file_version << (qint32)stream << scan_complete.load()
+      << discontinuous.load() << (qint64)entries.size();
+  for (const auto& e : entries) {
+    out << (qint64)e.pts << (qint64)e.pos;
+  }
+
+  if (file.commit()) dirty = false;
+}
+
+void KeyframeIndex::startScan() {
+  if (scan_complete || discontinuous || scanner.joinable()) return;
+
+  scanner = std::thread(&KeyframeIndex::scan, this);
+}
+
+void KeyframeIndex::scan() {
+  // Opened as by the playback, so that the streams are numbered alike
+  const auto start = qtplay::clk_now();
+  auto ic = KeyframeReader::openInput(
+      url, {qtplay::interrupt_on_flag, &abort_scan});
+  if (!ic) return;
+  auto close_input = [&] { avformat_close_input(&ic); };
+  ON_SCOPE_EXIT(close_input, ic_guard);
+
+  const auto idx = stream;
+  if (idx < 0 || idx >= (int)ic->nb_streams) return;
+
+  // Only demux, and only the indexed stream
+  for (unsigned i = 0; i < ic->nb_streams; ++i) {
+    ic->streams[i]->discard = (int)i == idx ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+  }
+
+  AVPacket* pkt = av_packet_alloc();
+  if (!pkt) return;
+
+  int ret = 0;
+  while (!abort_scan && !discontinuous &&
+         (ret = av_read_frame(ic, pkt)) >= 0) {
+    if (pkt->stream_index == idx) addPacket(ic, pkt);
+    av_packet_unref(pkt);
+  }
+  av_packet_free(&pkt);
+
+  if (ret == AVERROR_EOF && !discontinuous) {
+    scan_complete = true;
+    dirty = true;
+    save();
+    logMsg("Keyframe index: %zu entries, scanned in %.1f s", size(),
+           std::chrono::duration<double>(qtplay::clk_now() - start).count());
+  }
+}
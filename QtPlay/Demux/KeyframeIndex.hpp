@@ -0,0 +1,78 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Keyframe timestamp -> byte position map of an input, used to serve seeks
+ * with a single byte seek on formats whose own index is missing or poor
+ * (MPEG-TS, raw streams, MKV without cues).
+ *
+ * Entries are collected from the keyframes of one stream, the one played,
+ * read during playback and by an optional background scan that only demuxes.
+ * The index of a local file is kept in the cache directory and loaded on the
+ * next open. Thread-safe.
+ *
+ * Timestamps must grow with byte positions for the index to be of any use.
+ * An input with a timestamp discontinuity or wrap, which is what MPEG-TS is
+ * allowed to have, gets no index at all. */
+class KeyframeIndex final {
+  Q_DISABLE_COPY_MOVE(KeyframeIndex);
+
+ public:
+  struct Entry {
+    int64_t pts = 0;  // AV_TIME_BASE units
+    int64_t pos = 0;  // Byte position
+  };
+
+  KeyframeIndex(const std::string& url, int stream);
+  ~KeyframeIndex();
+
+  // Whether seeking in 'ic' would benefit from the index
+  static bool isUseful(const AVFormatContext* ic);
+
+  void add(int64_t pts, int64_t pos);
+  void addPacket(const AVFormatContext* ic, const AVPacket* pkt);
+  /* Returns the last keyframe at or before 'target', provided the index also
+   * covers the time after it, so that the keyframe is known to be the
+   * closest one */
+  std::optional<Entry> lookup(int64_t target) const;
+  bool complete() const { return scan_complete && !discontinuous; }
+  bool persistent() const { return !cache_file.isEmpty(); }
+  std::size_t size() const;
+
+  // Demuxes the whole input on a background thread
+  void startScan();
+
+ private:
+  static constexpr quint32 file_magic = 0x51504b49;  // "QPKI"
+  static constexpr quint32 file_version = 2;
+  // Entries closer than this to an existing one are redundant for seeking
+  static constexpr int64_t min_spacing = AV_TIME_BASE / 4;
+  /* Entries further apart than this come from different parts of the input
+   * that were read during playback, with unseen keyframes in between */
+  static constexpr int64_t max_gap = 10LL * AV_TIME_BASE;
+
+  const std::string url;
+  const int stream;
+  const QString cache_file;
+  mutable std::mutex mtx;
+  std::vector<Entry> entries;  // Sorted by pts, and so by pos
+  std::atomic_bool scan_complete = false, abort_scan = false, dirty = false;
+  // Timestamps went back somewhere: the index is cleared and stays empty
+  std::atomic_bool discontinuous = false;
+  std::thread scanner;
+
+  void load();
+  void save();
+  void scan();
+};
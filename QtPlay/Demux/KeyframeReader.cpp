@@ -0,0 +1,71 @@
+#include "KeyframeReader.hpp"
+
+void KeyframeReader::setFormatOptions(AVDictionary** opts) {
+  // Programs announced late would otherwise shift the stream numbers
+  av_dict_set(opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
+}
+
+AVFormatContext* KeyframeReader::openInput(const std::string& url,
+                                           const AVIOInterruptCB& int_cb) {
+  auto ic = avformat_alloc_context();
+  if (!ic) return nullptr;
+  ic->interrupt_callback = int_cb;
+
+  AVDictionary* format_opts = nullptr;
+  setFormatOptions(&format_opts);
+  // Frees the context on failure
+  const auto open_res =
+      avformat_open_input(&ic, url.c_str(), nullptr, &format_opts);
+  av_dict_free(&format_opts);
+  if (open_res < 0) return nullptr;
+
+  if (avformat_find_stream_info(ic, nullptr) < 0) {
+    avformat_close_input(&ic);
+    return nullptr;
+  }
+
+  return ic;
+}
+
+bool KeyframeReader::open(const std::string& url,
+                          const AVIOInterruptCB& int_cb, int hint) {
+  close();
+  if (!(ic = openInput(url, int_cb))) return false;
+  if (ic->duration <= 0 || (ic->ctx_flags & AVFMTCTX_UNSEEKABLE) ||
+      (ic->pb && !(ic->pb->seekable & AVIO_SEEKABLE_NORMAL)))
+    return false;
+
+  auto is_video = [this](int idx) {
+    const auto st = ic->streams[idx];
+    return st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+           !(st->disposition & AV_DISPOSITION_ATTACHED_PIC);
+  };
+  video_idx = hint >= 0 && hint < (int)ic->nb_streams && is_video(hint)
+                  ? hint
+                  : av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1,
+                                        nullptr, 0);
+  if (video_idx < 0 || !is_video(video_idx)) return false;
+
+  // Only video keyframes are of any use, where the demuxer can skip the rest
+  for (auto i = 0; i < (int)ic->nb_streams; ++i)
+    ic->streams[i]->discard = i == video_idx ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+
+  return true;
+}
+
+void KeyframeReader::close() {
+  avformat_close_input(&ic);
+  video_idx = -1;
+}
+
+bool KeyframeReader::read(AVPacket* pkt, const std::function<bool()>& stop) {
+  for (auto i = 0; i < max_packets; ++i) {
+    av_packet_unref(pkt);
+    if (stop() || av_read_frame(ic, pkt) < 0) return false;
+    if (pkt->stream_index == video_idx && (pkt->flags & AV_PKT_FLAG_KEY))
+      return true;
+  }
+  av_packet_unref(pkt);
+
+  return false;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QtGlobal>
+#include <functional>
+#include <string>
+
+/* Reads the video keyframes of an input opened apart from the playback, for
+ * the pictures of the seek slider. The caller seeks the context as it likes,
+ * and reads the keyframe that follows.
+ *
+ * Every input opened apart from the playback goes through openInput(), with
+ * the format options of the playback: their streams are numbered alike, so a
+ * stream number of the playback, or of a KeyframeIndex kept for it, is the
+ * same stream there. */
+class KeyframeReader final {
+  Q_DISABLE_COPY_MOVE(KeyframeReader);
+
+ public:
+  KeyframeReader() = default;
+  ~KeyframeReader() { close(); }
+
+  // The format options the playback opens its inputs with
+  static void setFormatOptions(AVDictionary** opts);
+  // Opens 'url' and probes its streams; nullptr on failure
+  static AVFormatContext* openInput(const std::string& url,
+                                    const AVIOInterruptCB& int_cb);
+
+  /* Opens a seekable input with a duration, for its video stream: 'hint' if
+   * that is one, the best one otherwise. The demuxer then skips everything
+   * but the keyframes of that stream. */
+  bool open(const std::string& url, const AVIOInterruptCB& int_cb,
+            int hint = -1);
+  void close();
+
+  AVFormatContext* context() const { return ic; }
+  int streamIndex() const { return video_idx; }
+
+  /* Reads the next keyframe into 'pkt'. Gives up after max_packets packets,
+   * or as soon as 'stop' returns true. */
+  bool read(AVPacket* pkt, const std::function<bool()>& stop);
+
+ private:
+  static constexpr int max_packets = 5000;
+
+  AVFormatContext* ic = nullptr;
+  int video_idx = -1;
+};
@@ -0,0 +1,221 @@
+#include "MappedFileIO.hpp"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+#include <QString>
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Strips the file: protocol prefix; returns an empty string for urls of other
+// protocols
+static std::string local_path(const std::string& url) {
+  if (url.starts_with("file:")) return url.substr(5);
+  const auto proto_end = url.find("://");
+  if (proto_end != std::string::npos) return {};
+  return url;
+}
+
+MappedFileIO::~MappedFileIO() {
+  if (pb) {
+    av_freep(&pb->buffer);
+    avio_context_free(&pb);
+  }
+
+#ifdef _WIN32
+  if (data) UnmapViewOfFile(data);
+  if (mapping) CloseHandle(mapping);
+  if (file) CloseHandle(file);
+#else
+  if (data) munmap(const_cast<uint8_t*>(data), mapped_size);
+  if (fd >= 0) ::close(fd);
+#endif
+}
+
+std::unique_ptr<MappedFileIO> MappedFileIO::open(const std::string& url) {
+  if constexpr (sizeof(void*) < 8) return nullptr;
+
+  const auto path = local_path(url);
+  if (path.empty()) return nullptr;
+
+  std::unique_ptr<MappedFileIO> io(new MappedFileIO());
+  if (!io->map(path)) return nullptr;
+
+  constexpr int avio_buf_size = 256 * 1024;
+  const auto avio_buf = static_cast<unsigned char*>(av_malloc(avio_buf_size));
+  if (!avio_buf) return nullptr;
+  io->pb = avio_alloc_context(
+      avio_buf, avio_buf_size, 0, io.get(),
+      [](void* opaque, uint8_t* buf, int size) {
+        return static_cast<MappedFileIO*>(opaque)->read(buf, size);
+      },
+      nullptr,
+      [](void* opaque, int64_t offset, int whence) {
+        return static_cast<MappedFileIO*>(opaque)->seek(offset, whence);
+      });
+  if (!io->pb) {
+    av_free(avio_buf);
+    return nullptr;
+  }
+
+  io->prefetch(0);
+
+  return io;
+}
+
+#ifdef _WIN32
+bool MappedFileIO::map(const std::string& path) {
+  // Network shares can fail in the middle of a read, which would fault
+  if (path.starts_with("\\\\") || path.starts_with("//")) return false;
+
+  // So can removable media that goes away
+  const auto wpath = QString::fromStdString(path).toStdWString();
+  wchar_t root[MAX_PATH] = {};
+  if (!GetVolumePathNameW(wpath.c_str(), root, MAX_PATH) ||
+      GetDriveTypeW(root) != DRIVE_FIXED) {
+    return false;
+  }
+
+  /* Without write sharing, a file open for writing elsewhere (e.g. being
+   * recorded) is not mapped, and it cannot be truncated while mapped */
+  const auto h =
+      CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (h == INVALID_HANDLE_VALUE) return false;
+  file = h;
+
+  LARGE_INTEGER fsize = {};
+  if (GetFileType(h) != FILE_TYPE_DISK || !GetFileSizeEx(h, &fsize) ||
+      fsize.QuadPart <= 0) {
+    return false;
+  }
+  size = fsize.QuadPart;
+
+  if (!(mapping = CreateFileMappingW(h, nullptr, PAGE_READONLY, 0, 0,
+                                     nullptr))) {
+    return false;
+  }
+
+  data = static_cast<const uint8_t*>(
+      MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  return data != nullptr;
+}
+
+// No other process can write the file while it is open
+bool MappedFileIO::update_size() { return true; }
+
+void MappedFileIO::prefetch(int64_t from) {
+  const auto len = std::min(prefetch_size, size - from);
+  if (len <= 0) return;
+
+  WIN32_MEMORY_RANGE_ENTRY range = {};
+  range.VirtualAddress = const_cast<uint8_t*>(data + from);
+  range.NumberOfBytes = static_cast<SIZE_T>(len);
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+  prefetched_end = from + len;
+}
+#else
+bool MappedFileIO::map(const std::string& path) {
+  if ((fd = ::open(path.c_str(), O_RDONLY)) < 0) return false;
+
+  struct stat st = {};
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    return false;
+  }
+  size = mapped_size = st.st_size;
+
+  const auto addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) return false;
+  data = static_cast<const uint8_t*>(addr);
+  madvise(addr, size, MADV_SEQUENTIAL);
+
+  return true;
+}
+
+bool MappedFileIO::update_size() {
+  struct stat st = {};
+  if (fstat(fd, &st) < 0) return false;
+  if (st.st_size <= mapped_size) {
+    // Truncated: the pages past the new end would fault
+    size = st.st_size;
+    return true;
+  }
+
+  // Grown, e.g. still being recorded: mapped again up to the new end
+  const auto addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED) return false;
+  munmap(const_cast<uint8_t*>(data), mapped_size);
+  data = static_cast<const uint8_t*>(addr);
+  size = mapped_size = st.st_size;
+  madvise(addr, size, MADV_SEQUENTIAL);
+  prefetched_end = std::min(prefetched_end, size);
+
+  return true;
+}
+
+void MappedFileIO::prefetch(int64_t from) {
+  static const int64_t page = sysconf(_SC_PAGESIZE);
+  const auto start = from / page * page;
+  const auto len = std::min(prefetch_size, size - start);
+  if (len <= 0) return;
+
+  madvise(const_cast<uint8_t*>(data + start), len, MADV_WILLNEED);
+  prefetched_end = start + len;
+}
+#endif
+
+InputIO::Stats MappedFileIO::stats() const {
+  Stats st;
+  st.bytes_buffered = std::max<int64_t>(prefetched_end - pos, 0);
+  st.bytes_read = bytes_read;
+  return st;
+}
+
+int MappedFileIO::read(uint8_t* buf, int buf_size) {
+  /* The file may have changed since it was mapped: like the file protocol,
+   * this returns an error rather than faulting */
+  if (!update_size()) return AVERROR(EIO);
+  if (pos >= size) return AVERROR_EOF;
+
+  const auto n = (int)std::min<int64_t>(buf_size, size - pos);
+  // Keep the prefetched window ahead of the reader
+  if (pos + n > prefetched_end - prefetch_size / 2) prefetch(prefetched_end);
+  std::memcpy(buf, data + pos, n);
+  pos += n;
+  bytes_read += n;
+
+  return n;
+}
+
+int64_t MappedFileIO::seek(int64_t offset, int whence) {
+  whence &= ~AVSEEK_FORCE;
+  if (!update_size()) return AVERROR(EIO);
+  if (whence == AVSEEK_SIZE) return size;
+
+  int64_t target = offset;
+  if (whence == SEEK_CUR) {
+    target += pos;
+  } else if (whence == SEEK_END) {
+    target += size;
+  } else if (whence != SEEK_SET) {
+    return AVERROR(EINVAL);
+  }
+  if (target < 0) return AVERROR(EINVAL);
+
+  // Start paging in the target before the demuxer gets there
+  if (target < pos || target >= prefetched_end) prefetch(target);
+  pos = target;
+
+  return pos;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "InputIO.hpp"
+
+#include <memory>
+#include <string>
+
+/* AVIOContext reading a local file through a read-only memory mapping. The
+ * pages around the read position, and around seek targets, are prefetched
+ * asynchronously (PrefetchVirtualMemory on Windows, madvise elsewhere), which
+ * saves the read() syscalls and kernel copies of the file protocol at high
+ * bitrates. Only regular files are mapped, and only on 64-bit builds, where
+ * the address space is not a concern.
+ *
+ * A page of a mapped file that is gone faults instead of failing a read. On
+ * Windows, only files on fixed drives that no one writes are mapped, and
+ * writers are kept out while they are. Elsewhere the size is checked before
+ * every read: a truncated file ends early and a growing one is mapped
+ * again. */
+class MappedFileIO final : public InputIO {
+ public:
+  ~MappedFileIO() override;
+
+  // Returns nullptr if 'url' is not a mappable local file
+  static std::unique_ptr<MappedFileIO> open(const std::string& url);
+
+  AVIOContext* avio() const override { return pb; }
+  Stats stats() const override;
+  const char* name() const override { return "Memory-mapped"; }
+
+ private:
+  static constexpr int64_t prefetch_size = 16LL * 1024 * 1024;
+
+  MappedFileIO() = default;
+
+  AVIOContext* pb = nullptr;
+  const uint8_t* data = nullptr;
+  int64_t size = 0, pos = 0, prefetched_end = 0, bytes_read = 0;
+  int64_t mapped_size = 0;
+#ifdef _WIN32
+  void *file = nullptr, *mapping = nullptr;  // HANDLEs
+#else
+  int fd = -1;
+#endif
+
+  bool map(const std::string& path);
+  // Follows changes of the file size; false if the file cannot be read
+  bool update_size();
+  void prefetch(int64_t from);
+  int read(uint8_t* buf, int buf_size);
+  int64_t seek(int64_t offset, int whence);
+};
@@ -0,0 +1,98 @@
+#include "PacketHistory.hpp"
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#include <algorithm>
+
+void PacketHistory::reset(int anchor_stream) {
+  clear();
+  anchor = anchor_stream;
+}
+
+void PacketHistory::clear() {
+  entries.clear();
+  total_bytes = 0;
+  newest = INT64_MIN;
+}
+
+double PacketHistory::duration() const {
+  if (entries.empty()) return 0.0;
+  return (newest - entries.front().time) / (double)AV_TIME_BASE;
+}
+
+void PacketHistory::drop_first_gop() {
+  do {
+    total_bytes -= entries.front().pkt.sizePlusSizeof();
+    entries.pop_front();
+  } while (!entries.empty() && !entries.front().keyframe);
+}
+
+void PacketHistory::add(const Packet& pkt, int64_t time, double window,
+                        int64_t max_bytes) {
+  if (anchor < 0 || time == AV_NOPTS_VALUE || pkt.isFlush()) return;
+
+  const auto keyframe = pkt.streamIndex() == anchor &&
+                        (pkt.constAvData()->flags & AV_PKT_FLAG_KEY);
+  // Nothing can be resumed from before the first keyframe
+  if (entries.empty() && !keyframe) return;
+
+  entries.push_back({pkt, time, keyframe});
+  total_bytes += pkt.sizePlusSizeof();
+  newest = std::max(newest, time);
+
+  // Drop the oldest GOP once the next one alone still covers the window
+  const auto oldest_wanted = newest - int64_t(window * AV_TIME_BASE);
+  for (;;) {
+    const auto next_key =
+        std::find_if(entries.begin() + 1, entries.end(),
+                     [](const Entry& e) { return e.keyframe; });
+    if (next_key == entries.end()) break;
+    if (next_key->time > oldest_wanted && total_bytes <= max_bytes) break;
+    drop_first_gop();
+  }
+}
+
+std::vector<Packet> PacketHistory::replayFrom(int64_t target) const {
+  std::vector<Packet> out;
+  if (entries.empty() || target < entries.front().time || target > newest)
+    return out;
+
+  auto start = entries.end();
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    if (it->keyframe && it->time <= target) start = it;
+  }
+  if (start == entries.end()) return out;
+
+  const auto start_time = start->time;
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    const auto from_anchor = it->pkt.streamIndex() == anchor;
+    if (from_anchor ? it >= start : it->time >= start_time)
+      out.push_back(it->pkt);
+  }
+
+  return out;
+}
+
+std::vector<Packet> PacketHistory::streamFrom(int stream_index,
+                                              int64_t target) const {
+  std::vector<Packet> out;
+  if (entries.empty() || target < entries.front().time || target > newest)
+    return out;
+
+  auto start = entries.end();
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    if (it->pkt.streamIndex() != stream_index ||
+        !(it->pkt.constAvData()->flags & AV_PKT_FLAG_KEY))
+      continue;
+    if (it->time <= target || start == entries.end()) start = it;
+    if (it->time > target) break;
+  }
+
+  for (auto it = start; it != entries.end(); ++it) {
+    if (it->pkt.streamIndex() == stream_index) out.push_back(it->pkt);
+  }
+
+  return out;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../AVWrappers/Packet.hpp"
+
+#include <QtGlobal>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/* The packets queued during the last seconds of playback, so that short
+ * seeks can be served from memory instead of from the demuxer, along with
+ * those of the alternate tracks that are read but not played (opt-in). The
+ * history always starts at a keyframe of the anchor stream (video, or audio
+ * if there is no video) and reaches the last packet queued. Packets share
+ * their data with the queued ones, so only what has already been played adds
+ * to the memory use. Demux thread only. */
+class PacketHistory final {
+  Q_DISABLE_COPY_MOVE(PacketHistory);
+
+ public:
+  PacketHistory() = default;
+  ~PacketHistory() = default;
+
+  // Starts over with another anchor stream, -1 disables the history
+  void reset(int anchor_stream);
+  // Starts over, e.g. after a seek in the demuxer
+  void clear();
+  /* Records a queued packet; 'time' is its timestamp in AV_TIME_BASE units,
+   * as queued. Whole GOPs older than 'window' seconds, or over 'max_bytes',
+   * are dropped. */
+  void add(const Packet& pkt, int64_t time, double window, int64_t max_bytes);
+  /* Copies of the packets to queue again to resume at 'target': the anchor
+   * stream from its last keyframe at or before it, the other streams from
+   * the same time. Empty if 'target' is outside the history. */
+  std::vector<Packet> replayFrom(int64_t target) const;
+  /* Copies of the packets of a single stream to queue to switch to it at
+   * 'target', from its last keyframe at or before it (or its first one after
+   * it, for sparse streams). Empty if 'target' is outside the history. */
+  std::vector<Packet> streamFrom(int stream_index, int64_t target) const;
+
+  int64_t bytes() const { return total_bytes; }
+  double duration() const;
+
+ private:
+  struct Entry {
+    Packet pkt;
+    int64_t time = 0;
+    bool keyframe = false;  // Of the anchor stream
+  };
+
+  std::deque<Entry> entries;
+  int anchor = -1;
+  int64_t total_bytes = 0, newest = INT64_MIN;
+
+  void drop_first_gop();
+};
@@ -0,0 +1,240 @@
+#include "ParallelScanner.hpp"
+
+#include "../Common/Decoder.hpp"
+#include "../Common/QtPlayCommon.hpp"
+#include "KeyframeIndex.hpp"
+#include "KeyframeReader.hpp"
+
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <memory>
+
+using qtplay::logMsg;
+
+ParallelScanner::ParallelScanner(const std::string& _url) : url(_url) {}
+
+bool ParallelScanner::run(Task& task, int threads) {
+  if (threads <= 0) threads = std::max(QThread::idealThreadCount(), 1);
+  const auto type = task.mediaType();
+  if (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO) return false;
+  if (type == AVMEDIA_TYPE_AUDIO &&
+      task.audioTarget().fmt == AV_SAMPLE_FMT_NONE)
+    return false;
+
+  const auto scan_start = qtplay::clk_now();
+  if (!plan(type, threads)) return false;
+
+  const auto count = (int)segments.size();
+  threads = std::min(threads, count);
+  states.assign(count, State::PENDING);
+  next_segment = 0;
+  workers = pool_size = threads;
+  progress_value = 0.0;
+  task.begin(count, input_start, input_duration);
+
+  // Below the playback threads, which must never wait for a scan
+  std::vector<std::unique_ptr<QThread>> pool;
+  for (auto i = 0; i < threads; ++i) {
+    pool.emplace_back(QThread::create([this, &task] { work(task); }));
+    pool.back()->start(QThread::LowPriority);
+  }
+
+  auto complete = true;
+  auto merged = 0;
+  {
+    std::unique_lock lck(mtx);
+    while (merged < count) {
+      cond.wait(lck, [&] {
+        return states[merged] != State::PENDING || !workers;
+      });
+      // Every worker is gone, e.g. cancelled or unable to open the input
+      if (states[merged] == State::PENDING) break;
+
+      complete = complete && states[merged] == State::DONE;
+      lck.unlock();
+      task.merge(merged);
+      lck.lock();
+      progress_value = double(++merged) / count;
+    }
+  }
+  for (auto& thr : pool) thr->wait();
+
+  complete = complete && merged == count && !cancelled;
+  logMsg("Scan of '%s': %d segments on %d threads in %.1f s%s", url.c_str(),
+         count, threads,
+         std::chrono::duration<double>(qtplay::clk_now() - scan_start).count(),
+         complete ? "" : " (incomplete)");
+
+  return complete;
+}
+
+AVFormatContext* ParallelScanner::open_input(AVMediaType type, int& stream) {
+  // The streams are numbered as by the keyframe index the plan snaps to
+  auto ic =
+      KeyframeReader::openInput(url, {qtplay::interrupt_on_flag, &cancelled});
+  if (!ic) return nullptr;
+
+  if ((stream = av_find_best_stream(ic, type, -1, -1, nullptr, 0)) < 0 ||
+      (ic->streams[stream]->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+    avformat_close_input(&ic);
+    return nullptr;
+  }
+
+  for (auto i = 0; i < (int)ic->nb_streams; ++i)
+    ic->streams[i]->discard = i == stream ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+
+  return ic;
+}
+
+bool ParallelScanner::plan(AVMediaType type, int threads) {
+  auto stream = -1;
+  auto ic = open_input(type, stream);
+  if (!ic) return false;
+  const auto index_stream = stream;
+
+  const auto start = input_start =
+      (ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0LL) /
+      (double)AV_TIME_BASE;
+  const auto duration = input_duration =
+      ic->duration > 0 ? ic->duration / (double)AV_TIME_BASE : 0.0;
+  const auto seekable =
+      !(ic->ctx_flags & AVFMTCTX_UNSEEKABLE) &&
+      (!ic->pb || (ic->pb->seekable & AVIO_SEEKABLE_NORMAL));
+  avformat_close_input(&ic);
+
+  // An input that cannot be split is scanned in one piece
+  auto count = 1;
+  if (seekable && duration > 0.0) {
+    count = std::clamp(int(duration / min_segment_seconds), 1,
+                       threads * segments_per_worker);
+  }
+
+  // Video segments start at known keyframes if the index is complete
+  std::unique_ptr<KeyframeIndex> kf_index;
+  if (type == AVMEDIA_TYPE_VIDEO && count > 1) {
+    kf_index = std::make_unique<KeyframeIndex>(url, index_stream);
+    if (!kf_index->complete()) kf_index = nullptr;
+  }
+
+  std::vector<double> bounds;
+  for (auto i = 1; i < count; ++i) {
+    auto bound = start + duration * i / count;
+    if (kf_index) {
+      if (const auto kf = kf_index->lookup(int64_t(bound * AV_TIME_BASE)))
+        bound = kf->pts / (double)AV_TIME_BASE;
+    }
+    if (bounds.empty() || bound > bounds.back()) bounds.push_back(bound);
+  }
+
+  segments.clear();
+  auto seg_start = -INFINITY;
+  for (const auto bound : bounds) {
+    segments.push_back({seg_start, bound});
+    seg_start = bound;
+  }
+  segments.push_back({seg_start, INFINITY});
+
+  return true;
+}
+
+void ParallelScanner::work(Task& task) {
+  auto stream = -1;
+  auto ic = open_input(task.mediaType(), stream);
+
+  // Every worker runs a single-threaded decoder, the pool uses the cores
+  Decoder dec;
+  dec.single_thread = true;
+  task.configure(dec);
+  const auto audio_tgt = task.audioTarget();
+
+  if (ic && dec.init_swdec(Stream(ic, stream))) {
+    for (auto i = next_segment++; !cancelled && i < (int)segments.size();
+         i = next_segment++) {
+      const auto ok = scan_segment(ic, stream, dec, task, audio_tgt, i);
+      {
+        std::scoped_lock lck(mtx);
+        states[i] = ok ? State::DONE : State::FAILED;
+      }
+      cond.notify_all();
+    }
+  }
+  dec.destroy();
+  avformat_close_input(&ic);
+
+  {
+    std::scoped_lock lck(mtx);
+    --workers;
+  }
+  cond.notify_all();
+}
+
+bool ParallelScanner::scan_segment(AVFormatContext* ic, int stream,
+                                   Decoder& dec, Task& task,
+                                   const AudioParams& audio_tgt, int index) {
+  const auto& seg = segments[index];
+
+  // The keyframe at or before the start of the segment
+  const auto ts =
+      std::isinf(seg.start)
+          ? (ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0LL)
+          : std::llround(seg.start * AV_TIME_BASE);
+  if (avformat_seek_file(ic, -1, INT64_MIN, ts, ts, 0) < 0) return false;
+  dec.flush();
+  dec.next_pts = AV_NOPTS_VALUE;
+
+  Packet pkt;
+  AudioParams audio_src;
+  std::deque<Frame> frames;
+  auto done = false;
+  auto decode = [&](const Packet& packet) {
+    if (task.mediaType() == AVMEDIA_TYPE_VIDEO) {
+      dec.decode_video_packet(packet, frames);
+    } else {
+      dec.decode_audio_packet(packet, frames, audio_src, audio_tgt);
+    }
+
+    // Frames come out in presentation order
+    for (; !frames.empty(); frames.pop_front()) {
+      const auto& fr = frames.front();
+      if (fr.pts >= seg.end) {
+        done = true;
+      } else if (!done && !(fr.pts < seg.start)) {
+        task.frame(index, fr);
+      }
+    }
+  };
+
+  // Each worker reads its share of the rate
+  const auto worker_rate =
+      read_rate > 0 ? double(read_rate) / pool_size : 0.0;
+  const auto read_start = qtplay::clk_now();
+  const auto start_pos = ic->pb ? avio_tell(ic->pb) : 0LL;
+
+  while (!done && !cancelled) {
+    if (worker_rate > 0.0 && ic->pb) {
+      const auto ahead =
+          (avio_tell(ic->pb) - start_pos) / worker_rate -
+          std::chrono::duration<double>(qtplay::clk_now() - read_start).count();
+      if (ahead > 0.0) {
+        qtplay::sleep_ms(std::min(int(ahead * 1000.0) + 1, 100));
+        continue;
+      }
+    }
+
+    pkt.clear();
+    const auto ret = av_read_frame(ic, pkt.avData());
+    if (ret < 0) {
+      // The last segment ends with the input, the decoder is drained
+      Packet flush_pkt;
+      flush_pkt.setFlush(true);
+      decode(flush_pkt);
+      dec.eof_state = false;
+      return ret == AVERROR_EOF;
+    }
+    if (pkt.streamIndex() == stream) decode(pkt);
+  }
+
+  return !cancelled;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../AVWrappers/Frame.hpp"
+#include "../Common/AudioParams.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QtGlobal>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct Decoder;
+
+/* Decodes a whole input for an analysis (waveform overview, loudness,
+ * thumbnail strips...) on all cores. The input is split into segments that
+ * start at keyframes; workers with an input and a Decoder of their own take
+ * the next segment as they become free, and the results of the segments are
+ * merged in order as they complete.
+ *
+ * Segment boundaries are snapped to the keyframes of the keyframe index when
+ * a complete one is cached. Otherwise a worker seeks to the keyframe before
+ * its segment and skips the frames before the boundary, which costs at most
+ * one GOP per segment. Either way, every frame belongs to exactly one
+ * segment.
+ *
+ * Its only user so far, the waveform overview, runs it with a single paced
+ * worker so as not to compete with the playback for the input. How the scan
+ * scales with the number of workers has not been measured yet; the log line
+ * of every scan gives its duration and thread count to compare. */
+class ParallelScanner final {
+  Q_DISABLE_COPY_MOVE(ParallelScanner);
+
+ public:
+  class Task {
+   public:
+    virtual ~Task() = default;
+
+    virtual AVMediaType mediaType() const = 0;
+    // Audio is converted to this, e.g. mono at a low rate for a waveform
+    virtual AudioParams audioTarget() const { return {}; }
+    // Sets up the decoder of a worker, e.g. a reduced size for video
+    virtual void configure(Decoder&) {}
+    /* Called once, before any frame, with the start time and the duration
+     * of the input in seconds (0 if unknown) */
+    virtual void begin(int segments, double start, double duration) = 0;
+    /* A frame of 'segment'. The frames of a segment come in order from one
+     * worker thread, while other segments are decoded concurrently. */
+    virtual void frame(int segment, const Frame& frame) = 0;
+    // Segments are merged in order, on the thread that runs the scan
+    virtual void merge(int segment) = 0;
+  };
+
+  explicit ParallelScanner(const std::string& url);
+  ~ParallelScanner() = default;
+
+  /* Scans the input for 'task' with 'threads' workers, all cores if 0, and
+   * blocks until it is done. Returns false if the input could not be
+   * scanned in full, or if cancelled. */
+  bool run(Task& task, int threads = 0);
+  /* Caps the rate at which the workers read the input, together, so that a
+   * scan leaves the disk or the network to the playback; 0 for no cap */
+  void setReadRate(int64_t bytes_per_second) { read_rate = bytes_per_second; }
+  // From any thread
+  void cancel() { cancelled = true; }
+  // Share of the segments merged so far
+  double progress() const { return progress_value; }
+
+ private:
+  // Shorter segments cost more in seeks and skipped frames than they balance
+  static constexpr double min_segment_seconds = 30.0;
+  static constexpr int segments_per_worker = 4;
+
+  struct Segment {
+    double start = 0.0, end = 0.0;  // Seconds, +-INFINITY at the ends
+  };
+  enum class State { PENDING, DONE, FAILED };
+
+  const std::string url;
+  int64_t read_rate = 0;  // Bytes/s
+  std::atomic_bool cancelled = false;
+  std::atomic<double> progress_value = 0.0;
+
+  // The scan being run
+  double input_start = 0.0, input_duration = 0.0;  // Seconds
+  std::vector<Segment> segments;
+  std::atomic_int next_segment = 0;
+  std::mutex mtx;
+  std::condition_variable cond;
+  std::vector<State> states;  // Protected by the mtx, as is 'workers'
+  int workers = 0;
+  int pool_size = 1;
+
+  AVFormatContext* open_input(AVMediaType type, int& stream);
+  bool plan(AVMediaType type, int threads);
+  void work(Task& task);
+  bool scan_segment(AVFormatContext* ic, int stream, Decoder& dec,
+                    Task& task, const AudioParams& audio_tgt, int index);
+};
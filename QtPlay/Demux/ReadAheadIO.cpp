@@ -0,0 +1,245 @@
+#include "ReadAheadIO.hpp"
+
+#include "../Common/QtPlayCommon.hpp"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+#include <algorithm>
+#include <cstring>
+
+using qtplay::clk_now;
+
+ReadAheadIO::ReadAheadIO(AVIOContext* _source, const AVIOInterruptCB* _int_cb,
+                         int buffer_size, int _back_size)
+    : source(_source),
+      ring(std::max(buffer_size, 4 * chunk_size)),
+      back_size(std::clamp(_back_size, 0, (int)ring.size() / 2)) {
+  if (_int_cb) int_cb = *_int_cb;
+  file_size = avio_size(source);
+  win_start = win_end = read_pos = avio_tell(source);
+
+  constexpr int avio_buf_size = 32 * 1024;
+  const auto avio_buf = static_cast<unsigned char*>(av_malloc(avio_buf_size));
+  if (avio_buf) {
+    pb = avio_alloc_context(
+        avio_buf, avio_buf_size, 0, this,
+        [](void* opaque, uint8_t* buf, int size) {
+          return static_cast<ReadAheadIO*>(opaque)->read(buf, size);
+        },
+        nullptr,
+        [](void* opaque, int64_t offset, int whence) {
+          return static_cast<ReadAheadIO*>(opaque)->seek(offset, whence);
+        });
+    if (!pb) av_free(avio_buf);
+  }
+
+  if (pb) {
+    pb->seekable = source->seekable;
+    io_thread = std::thread(&ReadAheadIO::io_loop, this);
+  }
+}
+
+ReadAheadIO::ReadAheadIO(std::unique_ptr<InputIO> _source_io,
+                         const AVIOInterruptCB* _int_cb, int buffer_size,
+                         int _back_size)
+    : ReadAheadIO(_source_io->avio(), _int_cb, buffer_size, _back_size) {
+  source_io = std::move(_source_io);
+}
+
+ReadAheadIO::~ReadAheadIO() {
+  {
+    std::scoped_lock lck(mtx);
+    quit = true;
+  }
+  space_cond.notify_all();
+  data_cond.notify_all();
+  if (io_thread.joinable()) io_thread.join();
+
+  if (pb) {
+    av_freep(&pb->buffer);
+    avio_context_free(&pb);
+  }
+  if (source_io) {
+    source = nullptr;
+    source_io.reset();
+  } else {
+    avio_closep(&source);
+  }
+}
+
+std::unique_ptr<ReadAheadIO> ReadAheadIO::open(const std::string& url,
+                                               const AVIOInterruptCB* int_cb,
+                                               int buffer_size,
+                                               int back_size) {
+  AVIOContext* source = nullptr;
+  if (avio_open2(&source, url.c_str(), AVIO_FLAG_READ, int_cb, nullptr) < 0) {
+    return nullptr;
+  }
+
+  auto io =
+      std::make_unique<ReadAheadIO>(source, int_cb, buffer_size, back_size);
+  if (!io->avio()) io = nullptr;
+
+  return io;
+}
+
+ReadAheadIO::Stats ReadAheadIO::stats() const {
+  std::scoped_lock lck(mtx);
+  Stats st;
+  st.bytes_buffered = win_end - read_pos;
+  st.bytes_read = bytes_read;
+  st.stall_ms = stall_ms;
+  st.throughput = source_seconds > 0.0 ? bytes_read / source_seconds : 0.0;
+  if (source_io) {
+    const auto source_st = source_io->stats();
+    st.cache_hit_bytes = source_st.cache_hit_bytes;
+    st.cache_miss_bytes = source_st.cache_miss_bytes;
+  }
+  return st;
+}
+
+bool ReadAheadIO::interrupted() const {
+  return int_cb.callback && int_cb.callback(int_cb.opaque);
+}
+
+void ReadAheadIO::store(const uint8_t* data, int size) {
+  const auto cap = (int64_t)ring.size();
+  win_start = std::max(win_start, win_end + size - cap);
+  while (size > 0) {
+    const auto off = win_end % cap;
+    const auto n = (int)std::min<int64_t>(size, cap - off);
+    std::memcpy(ring.data() + off, data, n);
+    data += n;
+    size -= n;
+    win_end += n;
+  }
+}
+
+void ReadAheadIO::io_loop() {
+  std::vector<uint8_t> chunk(chunk_size);
+  std::unique_lock lck(mtx);
+  while (!quit) {
+    if (seek_gen != seek_done_gen) {
+      const auto gen = seek_gen;
+      const auto target = seek_target;
+      lck.unlock();
+      const auto ret = avio_seek(source, target, SEEK_SET);
+      lck.lock();
+      seek_result = ret < 0 ? (int)ret : 0;
+      // An interrupted seek fails alone, the next one starts afresh
+      source_error = ret < 0 && ret != AVERROR_EXIT ? (int)ret : 0;
+      seek_done_gen = gen;
+      data_cond.notify_all();
+      continue;
+    }
+
+    // Keep the back-buffer, fill the rest of the ring
+    const auto ahead = win_end - read_pos;
+    const auto room = (int64_t)ring.size() - back_size - ahead;
+    if (source_error || room <= 0) {
+      space_cond.wait(lck);
+      continue;
+    }
+
+    const auto gen = seek_gen;
+    const auto to_read = (int)std::min<int64_t>(room, chunk_size);
+    lck.unlock();
+    const auto start = clk_now();
+    const auto ret = avio_read_partial(source, chunk.data(), to_read);
+    const auto elapsed = std::chrono::duration<double>(clk_now() - start);
+    lck.lock();
+
+    // The data is stale if a seek was requested meanwhile
+    if (gen != seek_gen) continue;
+
+    source_seconds += elapsed.count();
+    if (ret > 0) {
+      store(chunk.data(), ret);
+      bytes_read += ret;
+    } else if (ret == AVERROR_EXIT) {
+      // Interrupted, not an error of the input: the read is tried again
+      source->error = 0;
+      source->eof_reached = 0;
+      space_cond.wait_for(lck, qtplay::time_ms(10));
+    } else if (ret < 0) {
+      source_error = ret;  // Including AVERROR_EOF
+    }
+    data_cond.notify_all();
+  }
+}
+
+int ReadAheadIO::read(uint8_t* buf, int size) {
+  std::unique_lock lck(mtx);
+  const auto starving = [this] {
+    return win_end == read_pos &&
+           (!source_error || seek_gen != seek_done_gen) && !quit;
+  };
+  if (starving()) {
+    const auto start = clk_now();
+    while (starving()) {
+      if (interrupted()) return AVERROR_EXIT;
+      data_cond.wait_for(lck, qtplay::time_ms(10));
+    }
+    stall_ms += std::chrono::duration<double, std::milli>(clk_now() - start)
+                    .count();
+  }
+
+  if (win_end == read_pos) {
+    return source_error ? source_error : AVERROR_EOF;
+  }
+
+  const auto cap = (int64_t)ring.size();
+  int done = 0;
+  while (done < size && read_pos < win_end) {
+    const auto off = read_pos % cap;
+    const auto n = (int)std::min<int64_t>(
+        {(int64_t)size - done, win_end - read_pos, cap - off});
+    std::memcpy(buf + done, ring.data() + off, n);
+    done += n;
+    read_pos += n;
+  }
+  space_cond.notify_one();
+
+  return done;
+}
+
+int64_t ReadAheadIO::seek(int64_t offset, int whence) {
+  whence &= ~AVSEEK_FORCE;
+  if (whence == AVSEEK_SIZE) {
+    return file_size >= 0 ? file_size : AVERROR(ENOSYS);
+  }
+
+  std::unique_lock lck(mtx);
+  int64_t pos = offset;
+  if (whence == SEEK_CUR) {
+    pos += read_pos;
+  } else if (whence == SEEK_END) {
+    if (file_size < 0) return AVERROR(ENOSYS);
+    pos += file_size;
+  } else if (whence != SEEK_SET) {
+    return AVERROR(EINVAL);
+  }
+  if (pos < 0) return AVERROR(EINVAL);
+
+  if (pos >= win_start && pos <= win_end) {
+    read_pos = pos;
+    space_cond.notify_one();
+    return pos;
+  }
+
+  if (!source->seekable) return AVERROR(ENOSYS);
+
+  win_start = win_end = read_pos = pos;
+  seek_target = pos;
+  const auto gen = ++seek_gen;
+  space_cond.notify_one();
+  while (seek_done_gen != gen && !quit) {
+    if (interrupted()) return AVERROR_EXIT;
+    data_cond.wait_for(lck, qtplay::time_ms(10));
+  }
+
+  return seek_result < 0 ? seek_result : pos;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "InputIO.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* AVIOContext that reads ahead of the demuxer on a dedicated I/O thread, so
+ * that av_read_frame() is served from memory instead of blocking on the disk
+ * or the network.
+ *
+ * The data lives in a ring buffer addressed by absolute stream positions.
+ * Seeks inside the buffered window (including the back-buffer kept behind the
+ * read position) are served without touching the source, other seeks are
+ * handed to the I/O thread and waited for. */
+class ReadAheadIO final : public InputIO {
+ public:
+  // Takes ownership of 'source'
+  ReadAheadIO(AVIOContext* source, const AVIOInterruptCB* int_cb,
+              int buffer_size, int back_size);
+  // Reads ahead of another custom I/O, which it takes ownership of
+  ReadAheadIO(std::unique_ptr<InputIO> source_io,
+              const AVIOInterruptCB* int_cb, int buffer_size, int back_size);
+  ~ReadAheadIO() override;
+
+  /* Opens 'url' with avio_open2() and wraps it. Returns nullptr on failure,
+   * in which case the caller should let the demuxer open the url itself. */
+  static std::unique_ptr<ReadAheadIO> open(const std::string& url,
+                                           const AVIOInterruptCB* int_cb,
+                                           int buffer_size, int back_size);
+
+  AVIOContext* avio() const override { return pb; }
+  Stats stats() const override;
+  const char* name() const override { return "Read-ahead"; }
+
+ private:
+  static constexpr int chunk_size = 64 * 1024;
+
+  AVIOContext* source = nullptr;
+  std::unique_ptr<InputIO> source_io;  // Owns 'source' if set
+  AVIOContext* pb = nullptr;
+  AVIOInterruptCB int_cb = {};
+  int64_t file_size = -1;
+
+  mutable std::mutex mtx;
+  std::condition_variable data_cond, space_cond;
+  std::vector<uint8_t> ring;
+  const int back_size;
+  // Absolute positions: [win_start, win_end) is buffered
+  int64_t win_start = 0, win_end = 0, read_pos = 0;
+  int64_t seek_target = -1;
+  unsigned seek_gen = 0, seek_done_gen = 0;
+  int seek_result = 0, source_error = 0;
+  bool quit = false;
+
+  // Statistics, protected by mtx
+  int64_t bytes_read = 0;
+  double stall_ms = 0.0, source_seconds = 0.0;
+
+  std::thread io_thread;
+
+  bool interrupted() const;
+  void io_loop();
+  void store(const uint8_t* data, int size);
+  int read(uint8_t* buf, int size);
+  int64_t seek(int64_t offset, int whence);
+};
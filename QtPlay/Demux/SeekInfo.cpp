@@ -6,11 +6,14 @@ void SeekInfo::reset() {
   chapter_incr = 0;
   cycle_type = AVMEDIA_TYPE_UNKNOWN;
   st_idx_to_open = -1;
+  fast = false;
 }
 
-void SeekInfo::set_seek(SeekInfo::SeekType type, double val, int chapter_incr) {
+void SeekInfo::set_seek(SeekInfo::SeekType type, double val, int chapter_incr,
+                        bool fast) {
   reset();
   this->chapter_incr = chapter_incr;
+  this->fast = fast;
   seek_type = type;
   incr_or_percent = val;
 }
@@ -8,21 +8,24 @@ struct SeekInfo final {
   enum SeekType {
     SEEK_INCR,
     SEEK_PERCENT,
+    SEEK_TIME,  // To a clock value, in seconds
     SEEK_CHAPTER,
     SEEK_STREAM_SWITCH,
     SEEK_NONE
   };
 
   SeekType seek_type = SEEK_NONE;
-  double incr_or_percent = 0.0;
+  double incr_or_percent = 0.0;  // Or the time of a SEEK_TIME
   int chapter_incr = 0;
-  AVMediaType cycle_type = AVMEDIA_TYPE_UNKNOWN;
+  AVMediaType cycle_type = AVMEDIA_TYPE_UNKNOWN;  // UNKNOWN: the program
   int st_idx_to_open = -1;
+  bool fast = false;  // Keyframe only, e.g. while the slider is dragged
 
   SeekInfo() = default;
   ~SeekInfo() = default;
 
   void reset();
-  void set_seek(SeekInfo::SeekType type, double val, int chapter_incr = 0);
+  void set_seek(SeekInfo::SeekType type, double val, int chapter_incr = 0,
+                bool fast = false);
   void set_stream_switch(AVMediaType type, int idx);
 };
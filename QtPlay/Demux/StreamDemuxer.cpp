@@ -0,0 +1,50 @@
+#include "StreamDemuxer.hpp"
+
+StreamDemuxer::StreamDemuxer(AVFormatContext* _ic,
+                             std::unique_ptr<InputIO> _io, int _stream_index)
+    : ic(_ic), io(std::move(_io)), stream_index(_stream_index) {
+  for (auto i = 0; i < (int)ic->nb_streams; ++i) {
+    ic->streams[i]->discard =
+        i == stream_index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+  }
+}
+
+StreamDemuxer::~StreamDemuxer() { avformat_close_input(&ic); }
+
+int StreamDemuxer::read(AVPacket* pkt) {
+  if (is_suspended) return AVERROR(EAGAIN);
+  for (;;) {
+    const auto ret = av_read_frame(ic, pkt);
+    if (ret < 0) {
+      if (ret == AVERROR_EOF || (ic->pb && avio_feof(ic->pb))) at_eof = true;
+      return ret;
+    }
+
+    const auto ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (pkt->stream_index != stream_index ||
+        (skip_until != AV_NOPTS_VALUE && ts != AV_NOPTS_VALUE &&
+         ts <= skip_until)) {
+      av_packet_unref(pkt);
+      continue;
+    }
+
+    skip_until = AV_NOPTS_VALUE;
+    return ret;
+  }
+}
+
+int StreamDemuxer::seek(int64_t min_ts, int64_t ts, int64_t max_ts,
+                        int flags) {
+  at_eof = is_suspended = false;
+  skip_until = AV_NOPTS_VALUE;
+  return avformat_seek_file(ic, -1, min_ts, ts, max_ts, flags);
+}
+
+bool StreamDemuxer::resumeAfter(int64_t pts) {
+  if (pts == AV_NOPTS_VALUE) return true;
+  at_eof = is_suspended = false;
+  if (avformat_seek_file(ic, stream_index, INT64_MIN, pts, pts, 0) < 0)
+    return false;
+  skip_until = pts;
+  return true;
+}
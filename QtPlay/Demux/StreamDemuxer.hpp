@@ -0,0 +1,48 @@
+#pragma once
+
+#include "InputIO.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QtGlobal>
+#include <memory>
+
+/* A second instance of the input that demuxes a single stream. Files whose
+ * streams are interleaved too coarsely fill one packet queue long before the
+ * other one gets anything; with a read position per media type, each queue is
+ * filled on its own. Seeks are mirrored from the main demuxer. */
+class StreamDemuxer final {
+  Q_DISABLE_COPY_MOVE(StreamDemuxer);
+
+ public:
+  // Takes ownership of the opened 'ic' and of the I/O it reads from
+  StreamDemuxer(AVFormatContext* ic, std::unique_ptr<InputIO> io,
+                int stream_index);
+  ~StreamDemuxer();
+
+  int streamIndex() const { return stream_index; }
+  bool eof() const { return at_eof; }
+  bool suspended() const { return is_suspended; }
+  const AVFormatContext* context() const { return ic; }
+
+  // Reads the next packet of the stream, as av_read_frame()
+  int read(AVPacket* pkt);
+  // Same arguments as avformat_seek_file() with stream_index -1
+  int seek(int64_t min_ts, int64_t ts, int64_t max_ts, int flags);
+  /* Continues after the packet with timestamp 'pts' (stream time base), which
+   * the main demuxer has already queued */
+  bool resumeAfter(int64_t pts);
+  /* Reads nothing until the next seek or resumeAfter(): the main demuxer went
+   * to a byte position whose time is not known, and reads the stream until it
+   * can tell */
+  void suspend() { is_suspended = true; }
+
+ private:
+  AVFormatContext* ic = nullptr;
+  std::unique_ptr<InputIO> io;  // Outlives ic
+  const int stream_index;
+  bool at_eof = false, is_suspended = false;
+  int64_t skip_until = AV_NOPTS_VALUE;
+};
@@ -0,0 +1,236 @@
+#include "StreamRecorder.hpp"
+
+#include "../Common/QtPlayCommon.hpp"
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QUrl>
+#include <algorithm>
+
+using qtplay::logMsg;
+
+StreamRecorder::StreamRecorder(AVFormatContext* _oc, const QString& path,
+                               std::vector<OutputStream> _streams,
+                               int _anchor, bool _ts_discont)
+    : oc(_oc),
+      file_path(path),
+      streams(std::move(_streams)),
+      anchor(_anchor),
+      ts_discont(_ts_discont),
+      wait_keyframe(_anchor >= 0) {
+  mux_thread = std::thread([this] { mux_loop(); });
+}
+
+StreamRecorder::~StreamRecorder() {
+  {
+    std::scoped_lock lck(mtx);
+    quit = true;
+  }
+  cond.notify_all();
+  if (mux_thread.joinable()) mux_thread.join();
+
+  logMsg("Recording stopped: '%s', %lld KiB, %lld packets dropped",
+         file_path.toUtf8().constData(), (long long)bytes_written / 1024,
+         (long long)packets_dropped);
+  avio_closep(&oc->pb);
+  avformat_free_context(oc);
+}
+
+std::unique_ptr<StreamRecorder> StreamRecorder::create(
+    const AVFormatContext* ic, const QString& dir) {
+  const auto out_dir =
+      dir.isEmpty()
+          ? QStandardPaths::writableLocation(QStandardPaths::MoviesLocation)
+          : dir;
+  if (out_dir.isEmpty() || !QDir().mkpath(out_dir)) return nullptr;
+
+  auto base =
+      QFileInfo(QUrl(QString::fromUtf8(ic->url)).path()).completeBaseName();
+  if (base.isEmpty()) base = "Recording";
+  const auto path = QDir(out_dir).filePath(
+      QString("%1 %2.mkv")
+          .arg(base, QDateTime::currentDateTime().toString(
+                         "yyyy-MM-dd hh-mm-ss")));
+
+  AVFormatContext* oc = nullptr;
+  if (avformat_alloc_output_context2(&oc, nullptr, "matroska", nullptr) < 0)
+    return nullptr;
+
+  // The streams being read, as far as the container takes their codecs
+  std::vector<OutputStream> streams(ic->nb_streams);
+  auto anchor = -1;
+  for (auto i = 0; i < (int)ic->nb_streams; ++i) {
+    const auto st = ic->streams[i];
+    const auto par = st->codecpar;
+    if (st->discard == AVDISCARD_ALL ||
+        (st->disposition & AV_DISPOSITION_ATTACHED_PIC) ||
+        (par->codec_type != AVMEDIA_TYPE_VIDEO &&
+         par->codec_type != AVMEDIA_TYPE_AUDIO &&
+         par->codec_type != AVMEDIA_TYPE_SUBTITLE) ||
+        avformat_query_codec(oc->oformat, par->codec_id,
+                             FF_COMPLIANCE_NORMAL) != 1)
+      continue;
+
+    const auto out = avformat_new_stream(oc, nullptr);
+    if (!out || avcodec_parameters_copy(out->codecpar, par) < 0) {
+      avformat_free_context(oc);
+      return nullptr;
+    }
+    out->codecpar->codec_tag = 0;
+    out->time_base = st->time_base;
+    out->disposition = st->disposition;
+    av_dict_copy(&out->metadata, st->metadata, 0);
+    streams[i].index = out->index;
+    streams[i].time_base = st->time_base;
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO && anchor < 0) anchor = i;
+  }
+
+  if (!oc->nb_streams) {
+    avformat_free_context(oc);
+    return nullptr;
+  }
+
+  // Live inputs rarely start at zero
+  oc->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_ZERO;
+  oc->url = av_strdup(path.toUtf8().constData());
+  if (!oc->url) {
+    avformat_free_context(oc);
+    return nullptr;
+  }
+
+  return std::unique_ptr<StreamRecorder>(
+      new StreamRecorder(oc, path, std::move(streams), anchor,
+                         ic->iformat->flags & AVFMT_TS_DISCONT));
+}
+
+void StreamRecorder::write(const Packet& pkt) {
+  const auto idx = pkt.streamIndex();
+  if (error || idx < 0 || idx >= (int)streams.size() ||
+      streams[idx].index < 0)
+    return;
+
+  {
+    std::scoped_lock lck(mtx);
+    const auto keyframe = pkt.constAvData()->flags & AV_PKT_FLAG_KEY;
+    if (wait_keyframe && (idx != anchor || !keyframe)) return;
+    wait_keyframe = false;
+
+    if (queued_bytes + pkt.size() > max_queued_bytes) {
+      // The muxer is behind: skip ahead rather than hold up the demuxer
+      wait_keyframe = anchor >= 0;
+      ++packets_dropped;
+      return;
+    }
+    queue.push_back({pkt, seeked});  // A reference, the data is not copied
+    queued_bytes += pkt.size();
+    seeked = false;
+  }
+  cond.notify_one();
+}
+
+void StreamRecorder::onSeek() {
+  std::scoped_lock lck(mtx);
+  seeked = true;
+}
+
+void StreamRecorder::mux_loop() {
+  auto ret = avio_open(&oc->pb, oc->url, AVIO_FLAG_WRITE);
+  if (ret >= 0) ret = avformat_write_header(oc, nullptr);
+  if (ret < 0) {
+    logMsg("Recording: cannot write '%s' (error %d)",
+           file_path.toUtf8().constData(), ret);
+    error = ret;
+    return;
+  }
+  logMsg("Recording to '%s'", file_path.toUtf8().constData());
+
+  // What is queued when recording stops is still written
+  std::unique_lock lck(mtx);
+  while (true) {
+    cond.wait(lck, [this] { return quit || !queue.empty(); });
+    if (queue.empty()) break;
+
+    auto queued = std::move(queue.front());
+    queue.pop_front();
+    queued_bytes -= queued.pkt.size();
+    lck.unlock();
+    if (queued.after_seek) {
+      for (auto& os : streams) os.after_seek = true;
+    }
+    ret = mux(queued.pkt);
+    lck.lock();
+
+    if (ret < 0) {
+      logMsg("Recording: writing '%s' failed (error %d)",
+             file_path.toUtf8().constData(), ret);
+      error = ret;
+      queue.clear();
+      queued_bytes = 0;
+      break;
+    }
+  }
+  lck.unlock();
+
+  av_write_trailer(oc);
+}
+
+int StreamRecorder::mux(Packet& pkt) {
+  auto& os = streams[pkt.streamIndex()];
+  const auto av_pkt = pkt.avData();
+  const auto in_dts =
+      av_pkt->dts != AV_NOPTS_VALUE ? av_pkt->dts : av_pkt->pts;
+  if (in_dts == AV_NOPTS_VALUE) return 0;
+
+  constexpr AVRational time_base_q = {1, AV_TIME_BASE};
+  auto offset = av_rescale_q(ts_offset, time_base_q, os.time_base);
+  auto dts = in_dts + offset;
+  if (os.last_dts != AV_NOPTS_VALUE && ts_discont && !os.after_seek) {
+    /* A discontinuity or wrap of a live input: the timestamps go on one
+     * packet after the last ones. The other streams follow with the same
+     * offset, which already brings them close to their own. */
+    const auto jump = av_rescale_q(dts - os.last_dts, os.time_base,
+                                   time_base_q);
+    if (jump < -max_ts_jump || jump > max_ts_jump) {
+      const auto next_dts =
+          os.last_dts + std::max<int64_t>(av_pkt->duration, 1);
+      ts_offset += av_rescale_q(next_dts - dts, os.time_base, time_base_q);
+      offset = av_rescale_q(ts_offset, time_base_q, os.time_base);
+      dts = in_dts + offset;
+      os.need_keyframe = true;
+      logMsg("Recording: timestamp discontinuity of %.1f s, rebased",
+             jump / (double)AV_TIME_BASE);
+    }
+  }
+
+  // Behind the last one, as read again after a seek back: skipped, then
+  // resumed at a keyframe
+  if (os.last_dts != AV_NOPTS_VALUE && dts < os.last_dts) {
+    os.need_keyframe = true;
+    return 0;
+  }
+  os.after_seek = false;
+  if (os.need_keyframe && !(av_pkt->flags & AV_PKT_FLAG_KEY)) return 0;
+  os.need_keyframe = false;
+  os.last_dts = dts;
+
+  const auto size = pkt.size();
+  if (offset) {
+    if (av_pkt->pts != AV_NOPTS_VALUE) av_pkt->pts += offset;
+    if (av_pkt->dts != AV_NOPTS_VALUE) av_pkt->dts += offset;
+  }
+  av_pkt->stream_index = os.index;
+  av_pkt->pos = -1;
+  av_packet_rescale_ts(av_pkt, os.time_base, oc->streams[os.index]->time_base);
+  // Takes over the reference
+  const auto ret = av_interleaved_write_frame(oc, av_pkt);
+  if (ret >= 0) bytes_written += size;
+
+  return ret;
+}
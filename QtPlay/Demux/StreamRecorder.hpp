@@ -0,0 +1,95 @@
+#pragma once
+
+#include "../AVWrappers/Packet.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Records the input as it is read, remuxed to Matroska without decoding.
+ * The demux thread hands over references to the packets it reads; the
+ * muxer runs on a thread of its own, behind a bounded queue, so that file
+ * I/O never holds up playback. If the queue is full, packets are dropped up
+ * to the next keyframe.
+ *
+ * The streams read when recording starts are recorded, as far as Matroska
+ * can hold them. After a seek, packets that do not follow the previous one
+ * of their stream are skipped: the file has a gap where the playback jumped
+ * ahead and no repeats where it went back. Otherwise, a timestamp jump of an
+ * input that may have discontinuities (MPEG-TS) is taken for one, and the
+ * timestamps are rebased to go on from where they were. */
+class StreamRecorder final {
+  Q_DISABLE_COPY_MOVE(StreamRecorder);
+
+ public:
+  ~StreamRecorder();
+
+  /* Starts recording 'ic' to a new file in 'dir', or in the videos folder
+   * if 'dir' is empty. Returns nullptr if no stream can be recorded. */
+  static std::unique_ptr<StreamRecorder> create(const AVFormatContext* ic,
+                                                const QString& dir);
+
+  // A packet read from the input, never blocks
+  void write(const Packet& pkt);
+  // The input was repositioned, the packets written next come from there
+  void onSeek();
+  // Writing failed, nothing more is recorded
+  bool failed() const { return error != 0; }
+  const QString& path() const { return file_path; }
+
+ private:
+  static constexpr int64_t max_queued_bytes = 32LL * 1024 * 1024;
+  // Larger timestamp jumps are discontinuities, as for ffmpeg's -dts_delta
+  static constexpr int64_t max_ts_jump = 10LL * AV_TIME_BASE;
+
+  struct OutputStream {
+    int index = -1;  // In the output, -1 if the stream is not recorded
+    AVRational time_base = {};  // Of the input stream
+    // Muxer thread only
+    int64_t last_dts = AV_NOPTS_VALUE;  // Rebased
+    bool need_keyframe = false;
+    bool after_seek = false;  // Until it follows last_dts again
+  };
+
+  struct QueuedPacket {
+    Packet pkt;
+    bool after_seek = false;  // The first one written after a seek
+  };
+
+  StreamRecorder(AVFormatContext* oc, const QString& path,
+                 std::vector<OutputStream> streams, int anchor,
+                 bool ts_discont);
+
+  AVFormatContext* oc = nullptr;
+  const QString file_path;
+  std::vector<OutputStream> streams;  // Indexed by input stream
+  const int anchor;  // Recording (re)starts at one of its keyframes
+  const bool ts_discont;  // AVFMT_TS_DISCONT input
+  int64_t ts_offset = 0;  // Added to the input timestamps, muxer thread only
+
+  std::mutex mtx;
+  std::condition_variable cond;
+  std::deque<QueuedPacket> queue;
+  int64_t queued_bytes = 0;
+  bool wait_keyframe = true, seeked = false, quit = false;
+  std::atomic_int error = 0;
+
+  // Statistics
+  std::atomic<int64_t> packets_dropped = 0, bytes_written = 0;
+
+  std::thread mux_thread;
+
+  void mux_loop();
+  int mux(Packet& pkt);
+};
@@ -0,0 +1,301 @@
+#include "TimeshiftBuffer.hpp"
+
+#include "../Common/QtPlayCommon.hpp"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QStandardPaths>
+#include <algorithm>
+#include <chrono>
+
+TimeshiftBuffer::TimeshiftBuffer(const QString& _dir, int anchor_stream,
+                                 double _max_seconds)
+    : dir(_dir), anchor(anchor_stream), max_seconds(_max_seconds) {
+  io_thread = std::thread([this] { io_loop(); });
+}
+
+TimeshiftBuffer::~TimeshiftBuffer() {
+  {
+    std::scoped_lock lck(mtx);
+    quit = true;
+  }
+  cond.notify_all();
+  if (io_thread.joinable()) io_thread.join();
+
+  write_file.close();
+  read_file.close();
+  QDir(dir).removeRecursively();
+  if (packets_dropped) {
+    qtplay::logMsg("Timeshift: %lld packets dropped, the disk was behind",
+                   (long long)packets_dropped);
+  }
+}
+
+std::unique_ptr<TimeshiftBuffer> TimeshiftBuffer::create(int anchor_stream,
+                                                         double max_seconds) {
+  if (anchor_stream < 0 || max_seconds <= 0.0) return nullptr;
+
+  const auto path =
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+      QString("/timeshift/%1_%2")
+          .arg(QCoreApplication::applicationPid())
+          .arg(QDateTime::currentMSecsSinceEpoch());
+  if (!QDir().mkpath(path)) return nullptr;
+
+  return std::unique_ptr<TimeshiftBuffer>(
+      new TimeshiftBuffer(path, anchor_stream, max_seconds));
+}
+
+QString TimeshiftBuffer::segment_path(int id) const {
+  return QString("%1/%2.seg").arg(dir).arg(id, 6, 10, QChar('0'));
+}
+
+void TimeshiftBuffer::write(const Packet& pkt, int64_t time) {
+  if (time == AV_NOPTS_VALUE) return;
+  {
+    std::scoped_lock lck(mtx);
+    const auto keyframe = pkt.constAvData()->flags & AV_PKT_FLAG_KEY;
+    if (wait_keyframe && (pkt.streamIndex() != anchor || !keyframe)) return;
+    wait_keyframe = false;
+
+    if (pending_bytes + pkt.size() > max_pending_bytes) {
+      // The disk is behind: skip ahead rather than grow without bound
+      wait_keyframe = true;
+      ++packets_dropped;
+      return;
+    }
+    pending_writes.push_back({pkt, time});
+    pending_bytes += pkt.size();
+  }
+  cond.notify_one();
+}
+
+void TimeshiftBuffer::seek(int64_t time) {
+  {
+    std::scoped_lock lck(mtx);
+    ready.clear();
+    ready_bytes = 0;
+    seek_target = time;
+    seek_pending = true;
+    reader_idle = false;
+  }
+  cond.notify_one();
+}
+
+bool TimeshiftBuffer::read(Packet& pkt) {
+  {
+    std::scoped_lock lck(mtx);
+    if (ready.empty()) return false;
+    auto& front = ready.front();
+    ready_bytes -= front.pkt.size();
+    read_time = front.time;
+    pkt = std::move(front.pkt);
+    ready.pop_front();
+  }
+  cond.notify_one();
+  return true;
+}
+
+bool TimeshiftBuffer::atLiveEdge() const {
+  std::scoped_lock lck(mtx);
+  return ready.empty() && pending_writes.empty() && reader_idle &&
+         !seek_pending;
+}
+
+void TimeshiftBuffer::io_loop() {
+  std::unique_lock lck(mtx);
+  while (!quit) {
+    auto writes = std::move(pending_writes);
+    pending_writes.clear();
+    pending_bytes = 0;
+    const auto seek_req = seek_pending;
+    const auto target = seek_target;
+    seek_pending = false;
+    const auto room = ready_bytes < max_ready_bytes &&
+                      ready.size() < max_ready_packets;
+    lck.unlock();
+
+    for (const auto& rec : writes) append(rec);
+    if (!writes.empty() && write_file.isOpen()) {
+      write_file.flush();
+      segments.back().size = write_file.pos();
+    }
+    if (seek_req) reposition(target);
+
+    // Read ahead in batches, sequentially from the reader position
+    std::deque<ReadyPacket> got;
+    auto exhausted = false;
+    if (room) {
+      for (auto i = 0; i < 64; ++i) {
+        ReadyPacket rec;
+        if (!read_record(rec)) {
+          exhausted = true;
+          break;
+        }
+        got.push_back(std::move(rec));
+      }
+    }
+
+    lck.lock();
+    if (!seek_pending) {  // Otherwise a newer seek made these stale
+      for (auto& rec : got) {
+        ready_bytes += rec.pkt.size();
+        ready.push_back(std::move(rec));
+      }
+      reader_idle = exhausted;
+    }
+
+    if (writes.empty() && got.empty() && !seek_req && pending_writes.empty() &&
+        !seek_pending && !quit) {
+      cond.wait_for(lck, std::chrono::milliseconds(10));
+    }
+  }
+}
+
+void TimeshiftBuffer::append(const ReadyPacket& rec) {
+  const auto av_pkt = rec.pkt.constAvData();
+  const auto keyframe = rec.pkt.streamIndex() == anchor &&
+                        (av_pkt->flags & AV_PKT_FLAG_KEY);
+  // Playback can only start from a keyframe
+  if (segments.empty() && !keyframe) return;
+
+  if (keyframe &&
+      (segments.empty() ||
+       rec.time - segment_start >= int64_t(segment_seconds * AV_TIME_BASE) ||
+       write_file.pos() >= max_segment_size)) {
+    if (write_file.isOpen()) {
+      write_file.flush();
+      segments.back().size = write_file.pos();
+      write_file.close();
+    }
+
+    Segment seg;
+    seg.id = segments.empty() ? 0 : segments.back().id + 1;
+    write_file.setFileName(segment_path(seg.id));
+    if (!write_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+      qtplay::logMsg("Timeshift: cannot write '%s'",
+                     qPrintable(write_file.fileName()));
+      return;
+    }
+    segments.push_back(std::move(seg));
+    segment_start = rec.time;
+    if (start_time == AV_NOPTS_VALUE) start_time = rec.time;
+    trim();
+  }
+
+  if (!write_file.isOpen()) return;
+
+  if (keyframe) {
+    segments.back().keyframes.push_back({rec.time, write_file.pos()});
+  }
+
+  RecordHeader hdr = {};
+  hdr.time = rec.time;
+  hdr.pts = av_pkt->pts;
+  hdr.dts = av_pkt->dts;
+  hdr.duration = av_pkt->duration;
+  hdr.stream_index = av_pkt->stream_index;
+  hdr.flags = av_pkt->flags;
+  hdr.size = av_pkt->size;
+  write_file.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+  if (av_pkt->size > 0)
+    write_file.write(reinterpret_cast<const char*>(av_pkt->data), av_pkt->size);
+
+  if (end_time == AV_NOPTS_VALUE || rec.time > end_time) end_time = rec.time;
+}
+
+/* Deletes the oldest segments once the next one alone covers max_seconds */
+void TimeshiftBuffer::trim() {
+  const auto newest = end_time.load();
+  if (newest == AV_NOPTS_VALUE) return;
+
+  while (segments.size() > 1 && !segments[1].keyframes.empty() &&
+         newest - segments[1].keyframes.front().time >=
+             int64_t(max_seconds * AV_TIME_BASE)) {
+    const auto id = segments.front().id;
+    if (read_segment == id) {
+      // The reader fell behind the recording; it continues at its start
+      read_file.close();
+      read_segment = segments[1].id;
+      read_offset = 0;
+    }
+    QFile::remove(segment_path(id));
+    segments.pop_front();
+  }
+
+  if (!segments.front().keyframes.empty())
+    start_time = segments.front().keyframes.front().time;
+}
+
+void TimeshiftBuffer::reposition(int64_t time) {
+  read_file.close();
+  read_segment = -1;
+  read_offset = 0;
+
+  for (const auto& seg : segments) {
+    for (const auto& kf : seg.keyframes) {
+      if (kf.time > time && read_segment >= 0) return;
+      read_segment = seg.id;
+      read_offset = kf.offset;
+    }
+  }
+}
+
+bool TimeshiftBuffer::read_record(ReadyPacket& out) {
+  for (;;) {
+    if (segments.empty()) return false;
+
+    auto seg =
+        std::find_if(segments.begin(), segments.end(),
+                     [&](const Segment& s) { return s.id == read_segment; });
+    if (seg == segments.end()) {
+      read_file.close();
+      read_segment = segments.front().id;
+      read_offset = 0;
+      continue;
+    }
+
+    if (read_offset + (int64_t)sizeof(RecordHeader) > seg->size) {
+      if (std::next(seg) == segments.end()) return false;  // Live edge
+      read_file.close();
+      read_segment = std::next(seg)->id;
+      read_offset = 0;
+      continue;
+    }
+
+    if (!read_file.isOpen()) {
+      read_file.setFileName(segment_path(read_segment));
+      // Unbuffered, the file keeps growing behind the reader
+      if (!read_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+        return false;
+    }
+    if (read_file.pos() != read_offset && !read_file.seek(read_offset))
+      return false;
+
+    RecordHeader hdr;
+    if (read_file.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)) !=
+            sizeof(hdr) ||
+        hdr.size < 0 ||
+        read_offset + (int64_t)sizeof(hdr) + hdr.size > seg->size)
+      return false;
+
+    Packet pkt;
+    auto av_pkt = pkt.avData();
+    if (av_new_packet(av_pkt, hdr.size) < 0 ||
+        read_file.read(reinterpret_cast<char*>(av_pkt->data), hdr.size) !=
+            hdr.size)
+      return false;
+    av_pkt->pts = hdr.pts;
+    av_pkt->dts = hdr.dts;
+    av_pkt->duration = hdr.duration;
+    av_pkt->stream_index = hdr.stream_index;
+    av_pkt->flags = hdr.flags;
+    av_pkt->pos = -1;
+
+    read_offset += sizeof(hdr) + hdr.size;
+    out.pkt = std::move(pkt);
+    out.time = hdr.time;
+    return true;
+  }
+}
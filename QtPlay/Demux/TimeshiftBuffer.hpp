@@ -0,0 +1,115 @@
+#pragma once
+
+#include "../AVWrappers/Packet.hpp"
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+#include <QFile>
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Disk-backed recording of a live input, so that it can be paused, rewound
+ * and played behind the live edge. The demux thread records the packets it
+ * reads and plays what it gets back from the reader.
+ *
+ * Packets are appended to segment files of about segment_seconds, each
+ * starting at a keyframe of the anchor stream and with an index of those
+ * keyframes. The oldest segments are deleted past the configured duration.
+ * All file I/O happens sequentially on a dedicated thread, which also reads
+ * ahead of the playback position into memory. Writes queue up behind a
+ * bound: if the disk falls behind, packets are dropped up to the next
+ * keyframe of the anchor stream. */
+class TimeshiftBuffer final {
+  Q_DISABLE_COPY_MOVE(TimeshiftBuffer);
+
+ public:
+  ~TimeshiftBuffer();
+
+  /* Creates the recording in the cache directory. 'anchor_stream' is the
+   * stream whose keyframes segments and seeks start at. Returns nullptr if
+   * the directory is not writable. */
+  static std::unique_ptr<TimeshiftBuffer> create(int anchor_stream,
+                                                 double max_seconds);
+
+  // Records a packet read from the input; 'time' is in AV_TIME_BASE units
+  void write(const Packet& pkt, int64_t time);
+  /* Moves the reader to the last keyframe at or before 'time', within the
+   * recorded range */
+  void seek(int64_t time);
+  // Next recorded packet after the reader, false if none is available yet
+  bool read(Packet& pkt);
+
+  // Recorded range, AV_NOPTS_VALUE until the first keyframe
+  int64_t startTime() const { return start_time; }
+  int64_t endTime() const { return end_time; }
+  // Time of the last packet read
+  int64_t readTime() const { return read_time; }
+  // Everything recorded so far has been read
+  bool atLiveEdge() const;
+
+ private:
+  static constexpr double segment_seconds = 10.0;
+  static constexpr int64_t max_segment_size = 256LL * 1024 * 1024;
+  static constexpr int64_t max_ready_bytes = 8LL * 1024 * 1024;
+  static constexpr size_t max_ready_packets = 512;
+  static constexpr int64_t max_pending_bytes = 32LL * 1024 * 1024;
+
+  struct RecordHeader {
+    int64_t time, pts, dts, duration;
+    int32_t stream_index, flags, size, reserved;
+  };
+  struct Keyframe {
+    int64_t time, offset;
+  };
+  struct Segment {
+    int id = 0;
+    int64_t size = 0;  // Bytes written and flushed
+    std::vector<Keyframe> keyframes;
+  };
+  struct ReadyPacket {
+    Packet pkt;
+    int64_t time = 0;
+  };
+
+  TimeshiftBuffer(const QString& dir, int anchor_stream, double max_seconds);
+
+  const QString dir;
+  const int anchor;
+  const double max_seconds;
+
+  mutable std::mutex mtx;
+  std::condition_variable cond;
+  std::deque<ReadyPacket> pending_writes, ready;
+  int64_t ready_bytes = 0, pending_bytes = 0;
+  bool wait_keyframe = false;  // Writes resume at an anchor keyframe
+  int64_t packets_dropped = 0;
+  int64_t seek_target = AV_NOPTS_VALUE;
+  bool seek_pending = false, reader_idle = false, quit = false;
+  std::atomic<int64_t> start_time = AV_NOPTS_VALUE, end_time = AV_NOPTS_VALUE,
+                       read_time = AV_NOPTS_VALUE;
+
+  // I/O thread only
+  std::deque<Segment> segments;
+  QFile write_file, read_file;
+  int read_segment = -1;  // Id, -1 until the first segment exists
+  int64_t read_offset = 0;
+  int64_t segment_start = AV_NOPTS_VALUE;
+  std::thread io_thread;
+
+  QString segment_path(int id) const;
+  void io_loop();
+  void append(const ReadyPacket& rec);
+  void trim();
+  void reposition(int64_t time);
+  bool read_record(ReadyPacket& out);
+};
@@ -0,0 +1,193 @@
+#include "TrickPlay.hpp"
+
+#include "../Common/PlayerContext.hpp"
+#include "../Common/PlayerSettings.hpp"
+#include "DualDemuxer.hpp"
+#include "KeyframeIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using qtplay::logMsg;
+
+bool TrickPlay::eligible(const AVFormatContext* ic, bool live) const {
+  return ctx.video_stream >= 0 &&
+         !(ic->streams[ctx.video_stream]->disposition &
+           AV_DISPOSITION_ATTACHED_PIC) &&
+         !live && !(ic->ctx_flags & AVFMTCTX_UNSEEKABLE);
+}
+
+void TrickPlay::start(AVFormatContext* ic) {
+  const auto clock = ctx.best_clkval();
+  const auto start = ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0LL;
+  pos = !isnan(clock) ? int64_t(clock * AV_TIME_BASE) - ctx.pts_offset : start;
+  shown = pkt_time = AV_NOPTS_VALUE;
+  backoff = AV_TIME_BASE;
+  tick = qtplay::clk_now();
+  pkt.clear();
+
+  const CThread::ScopedLocker athr_l(ctx.audio_thr);
+  const CThread::ScopedLocker vthr_l(ctx.video_thr);
+  ctx.completePendingSwitches();
+  for (auto i = 0; i < (int)ic->nb_streams; ++i) {
+    ic->streams[i]->discard =
+        i == ctx.video_stream ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+  }
+  ctx.viddec.setSeekTarget(AV_NOPTS_VALUE);
+  ctx.auddec.setSeekTarget(AV_NOPTS_VALUE);
+  ctx.audioq.flush();
+  ctx.videoq.flush();
+  ctx.subtitleq.flush();
+}
+
+void TrickPlay::stop(AVFormatContext* ic, DualDemuxer& dual) {
+  const auto resume_at = shown != AV_NOPTS_VALUE ? shown : pos;
+  pkt.clear();
+  pkt_time = AV_NOPTS_VALUE;
+
+  const CThread::ScopedLocker athr_l(ctx.audio_thr);
+  const CThread::ScopedLocker vthr_l(ctx.video_thr);
+  for (auto i = 0; i < (int)ic->nb_streams; ++i) {
+    ic->streams[i]->discard = AVDISCARD_ALL;
+  }
+  for (const auto idx : {ctx.video_stream, ctx.audio_stream,
+                         ctx.subtitle_stream}) {
+    // The dual demuxer's audio stays with it
+    if (idx >= 0 && !(dual.demuxer() && idx == ctx.audio_stream))
+      ic->streams[idx]->discard = AVDISCARD_DEFAULT;
+  }
+
+  if (avformat_seek_file(ic, -1, INT64_MIN, resume_at, resume_at, 0) < 0)
+    logMsg("%s: error while seeking", ic->url);
+  dual.seekTo(resume_at);
+  const auto target = PlayerSettings::get().accurate_seek
+                          ? resume_at + ctx.pts_offset
+                          : AV_NOPTS_VALUE;
+  ctx.viddec.setSeekTarget(target);
+  ctx.auddec.setSeekTarget(target);
+  ctx.last_seek_pos = resume_at;
+  ctx.last_seek_rel = 0;
+  ctx.audioq.flush();
+  ctx.videoq.flush();
+  ctx.subtitleq.flush();
+  ctx.buffering.onSeek();
+  ctx.eof_notified = false;
+}
+
+void TrickPlay::reverse() {
+  pkt.clear();
+  pkt_time = AV_NOPTS_VALUE;
+}
+
+void TrickPlay::end(bool at_end) {
+  // The demux thread stops it as requested, from the last keyframe shown
+  ctx.trick_request = 0;
+  logMsg("Trick play: reached the %s", at_end ? "end" : "start");
+}
+
+bool TrickPlay::seek(AVFormatContext* ic, const KeyframeIndex* kf_index,
+                     int64_t target, bool forward) {
+  const auto keyframe = kf_index ? kf_index->lookup(target) : std::nullopt;
+  if (keyframe) {
+    return avformat_seek_file(ic, -1, INT64_MIN, keyframe->pos, INT64_MAX,
+                              AVSEEK_FLAG_BYTE) >= 0;
+  }
+  return (forward ? avformat_seek_file(ic, -1, target, target, INT64_MAX, 0)
+                  : avformat_seek_file(ic, -1, INT64_MIN, target, target,
+                                       0)) >= 0;
+}
+
+bool TrickPlay::read(AVFormatContext* ic, KeyframeIndex* kf_index) {
+  while (av_read_frame(ic, pkt.avData()) >= 0) {
+    const auto av_pkt = pkt.constAvData();
+    const auto ts = av_pkt->pts != AV_NOPTS_VALUE ? av_pkt->pts : av_pkt->dts;
+    if (av_pkt->stream_index == ctx.video_stream &&
+        (av_pkt->flags & AV_PKT_FLAG_KEY) && ts != AV_NOPTS_VALUE) {
+      if (kf_index) kf_index->addPacket(ic, av_pkt);
+      pkt_time = av_rescale_q(ts, ic->streams[ctx.video_stream]->time_base,
+                              AVRational{1, AV_TIME_BASE});
+      return true;
+    }
+    pkt.clear();
+  }
+  pkt.clear();
+  return false;
+}
+
+bool TrickPlay::step(AVFormatContext* ic, KeyframeIndex* kf_index,
+                     bool paused) {
+  const auto now = qtplay::clk_now();
+  const int speed = ctx.trick_speed;
+  if (!paused) {
+    pos += int64_t(speed * AV_TIME_BASE *
+                   std::chrono::duration<double>(now - tick).count());
+  }
+  tick = now;
+
+  // One keyframe at a time, so that none waits in the queue
+  if (paused || !ctx.videoq.isEmpty()) return false;
+
+  /* Half a second behind is worth a jump rather than reading on. What a jump
+   * lands on is shown however far it is. */
+  const auto forward = speed > 0;
+  const auto jump = std::abs(speed) * (int64_t)AV_TIME_BASE / 2;
+  if (pkt_time != AV_NOPTS_VALUE && shown != AV_NOPTS_VALUE &&
+      (forward ? pkt_time < pos - jump : pkt_time > pos + jump)) {
+    pkt.clear();
+    pkt_time = AV_NOPTS_VALUE;
+    shown = AV_NOPTS_VALUE;
+  }
+
+  if (pkt_time == AV_NOPTS_VALUE) {
+    const auto start = ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0LL;
+    auto target = AV_NOPTS_VALUE;
+    if (shown == AV_NOPTS_VALUE) {
+      target = pos;
+    } else if (!forward) {
+      target = std::min(pos, shown - backoff);
+    } else if (pos - shown > jump) {
+      target = pos;
+    }
+    if (!forward && target != AV_NOPTS_VALUE && target < start) {
+      shown = start;
+      end(false);
+      return true;
+    }
+    if ((target != AV_NOPTS_VALUE && !seek(ic, kf_index, target, forward)) ||
+        !read(ic, kf_index)) {
+      end(forward);
+      return true;
+    }
+
+    // An imprecise seek back found the same keyframe: look further back
+    if (!forward && shown != AV_NOPTS_VALUE && pkt_time >= shown) {
+      pkt.clear();
+      pkt_time = AV_NOPTS_VALUE;
+      backoff *= 2;
+      return true;
+    }
+    backoff = AV_TIME_BASE;
+  }
+
+  // The first keyframe is shown at once, the others when they are reached
+  if (shown != AV_NOPTS_VALUE &&
+      (forward ? pkt_time > pos : pkt_time < pos))
+    return false;
+
+  // Drained right away: frame threading would hold it back otherwise
+  if (ctx.pts_offset) {
+    const auto offset =
+        av_rescale_q(ctx.pts_offset, AVRational{1, AV_TIME_BASE},
+                     ic->streams[ctx.video_stream]->time_base);
+    const auto av_pkt = pkt.avData();
+    if (av_pkt->pts != AV_NOPTS_VALUE) av_pkt->pts += offset;
+    if (av_pkt->dts != AV_NOPTS_VALUE) av_pkt->dts += offset;
+  }
+  ctx.videoq.put(pkt);
+  ctx.videoq.put_nullpacket(ctx.video_stream);
+  pkt.clear();
+  shown = pkt_time;
+  pkt_time = AV_NOPTS_VALUE;
+
+  return true;
+}
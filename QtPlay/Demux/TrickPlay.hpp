@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../AVWrappers/Packet.hpp"
+#include "../Common/QtPlayCommon.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QtGlobal>
+#include <cstdint>
+
+struct PlayerContext;
+class KeyframeIndex;
+class DualDemuxer;
+
+/* Trick play: only video keyframes are read (AVDISCARD_NONKEY) and shown, at
+ * ctx.trick_speed times the normal speed, backwards if negative. Audio is not
+ * read. The position advances with the wall clock; keyframes are read in
+ * order while that keeps up, and jumped to through the keyframe index or the
+ * demuxer's own index otherwise. Rewinding jumps to the keyframe before the
+ * one shown last. Demux thread only. */
+class TrickPlay final {
+  Q_DISABLE_COPY_MOVE(TrickPlay);
+
+ public:
+  explicit TrickPlay(PlayerContext& _ctx) : ctx(_ctx) {}
+  ~TrickPlay() = default;
+
+  // A video to show, in an input that can be seeked at will
+  bool eligible(const AVFormatContext* ic, bool live) const;
+
+  // Starts from the current position, the queues are flushed
+  void start(AVFormatContext* ic);
+  /* Repositions the demuxers to resume normal playback from the last keyframe
+   * shown. The caller resets what depends on the read position. */
+  void stop(AVFormatContext* ic, DualDemuxer& dual);
+  // The speed changed direction: what was read ahead is of no use
+  void reverse();
+
+  /* Queues the next keyframe once the position reaches it. At the end or the
+   * start of the input, ctx.trick_request is reset and playback resumes from
+   * there. Returns false when there is nothing to do for now. */
+  bool step(AVFormatContext* ic, KeyframeIndex* kf_index, bool paused);
+
+ private:
+  PlayerContext& ctx;
+
+  int64_t pos = AV_NOPTS_VALUE;    // AV_TIME_BASE units of the input
+  int64_t shown = AV_NOPTS_VALUE;  // Time of the last keyframe queued
+  int64_t backoff = AV_TIME_BASE;
+  qtplay::steady_clock::time_point tick;
+  Packet pkt;  // Read ahead, queued once the position reaches it
+  int64_t pkt_time = AV_NOPTS_VALUE;
+
+  // Keyframe at or after (forward) or at or before 'target'
+  bool seek(AVFormatContext* ic, const KeyframeIndex* kf_index, int64_t target,
+            bool forward);
+  // Reads the next video keyframe into pkt
+  bool read(AVFormatContext* ic, KeyframeIndex* kf_index);
+  void end(bool at_end);
+};
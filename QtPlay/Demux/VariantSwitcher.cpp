@@ -0,0 +1,114 @@
+#include "VariantSwitcher.hpp"
+
+#include "../Common/PlayerContext.hpp"
+#include "../Common/PlayerSettings.hpp"
+#include "../VideoOutput/GLWindow.hpp"
+#include "../Widgets/QtPlayGUI.hpp"
+#include "../Widgets/VideoDisplayWidget.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using qtplay::logMsg;
+
+void VariantSwitcher::attach(AVFormatContext* ic, AVDictionary** format_opts) {
+  if (!PlayerSettings::get().abr) return;
+  abr = std::make_unique<AbrController>();
+  abr->attach(ic);
+  // Kept-alive HLS connections cannot go through metered I/O
+  av_dict_set(format_opts, "http_persistent", "0", AV_DICT_DONT_OVERWRITE);
+}
+
+bool VariantSwitcher::init(AVFormatContext* ic, int& video_idx,
+                           int& audio_idx) {
+  // Probing read the first segments of the variants: they tell where to start
+  is_active = false;
+  if (!abr || !abr->init(ic)) return false;
+
+  auto start_variant = abr->pick(NAN);
+  if (start_variant < 0)
+    start_variant = abr->find(video_idx >= 0 ? video_idx : audio_idx);
+  if (start_variant < 0) return false;
+
+  const auto& variant = abr->variant(start_variant);
+  if (variant.video >= 0) video_idx = variant.video;
+  if (variant.audio >= 0) audio_idx = variant.audio;
+  abr->setCurrent(start_variant);
+  logMsg("ABR: starting with the %lld kbit/s variant (%.0f measured)",
+         variant.bitrate / 1000, abr->throughput() / 1000.0);
+
+  return is_active = true;
+}
+
+bool VariantSwitcher::update(AVFormatContext* ic, int64_t audio_end,
+                             int64_t video_end) {
+  // The queues still hold the end of the previous item or variant
+  if (!is_active || ctx.pending_audio_switch || ctx.pending_video_switch ||
+      ctx.audioq.isFull() || ctx.videoq.isFull())
+    return false;
+
+  // Buffer health, in seconds queued ahead of playback
+  const auto clock = ctx.best_clkval();
+  double buffered = INFINITY;
+  if (ctx.audio_stream >= 0 && audio_end != AV_NOPTS_VALUE)
+    buffered = std::min(buffered, audio_end / (double)AV_TIME_BASE - clock);
+  if (ctx.video_stream >= 0 && video_end != AV_NOPTS_VALUE &&
+      !(ic->streams[ctx.video_stream]->disposition &
+        AV_DISPOSITION_ATTACHED_PIC))
+    buffered = std::min(buffered, video_end / (double)AV_TIME_BASE - clock);
+  if (isnan(buffered) || isinf(buffered)) return false;
+
+  const auto index = abr->pick(buffered);
+  if (index < 0 || index == abr->current()) return false;
+  const auto& variant = abr->variant(index);
+  const auto video_idx =
+      variant.video >= 0 && ctx.video_thr ? variant.video : ctx.video_stream;
+  const auto audio_idx =
+      variant.audio >= 0 && ctx.audio_thr ? variant.audio : ctx.audio_stream;
+
+  if (video_idx != ctx.video_stream) {
+    const auto display_size =
+        QtPlayGUI::instance().videoWidget()->getVideoOutput()->displaySize();
+    ctx.next_viddec.setDisplaySize(display_size.width(),
+                                   display_size.height());
+    ctx.next_viddec.setLowLatency(ctx.viddec.low_latency);
+    if (!ctx.next_viddec.init(Stream(ic, video_idx))) {
+      ctx.next_viddec.destroy();
+      return false;
+    }
+  }
+  if (audio_idx != ctx.audio_stream &&
+      !ctx.next_auddec.init(Stream(ic, audio_idx))) {
+    if (video_idx != ctx.video_stream) ctx.next_viddec.destroy();
+    ctx.next_auddec.destroy();
+    return false;
+  }
+
+  logMsg("ABR: %.0f kbit/s measured, %.1f s buffered: %lld -> %lld kbit/s",
+         abr->throughput() / 1000.0, buffered,
+         abr->variant(abr->current()).bitrate / 1000, variant.bitrate / 1000);
+  for (const auto idx : abr->variant(abr->current()).streams) {
+    ic->streams[idx]->discard = AVDISCARD_ALL;
+  }
+  if (video_idx != ctx.video_stream) {
+    ctx.next_viddec.setSeekTarget(video_end);
+    ctx.pending_video_switch = true;
+    ctx.videoq.put_stream_change(video_idx);
+    ctx.video_stream = ctx.last_video_stream = video_idx;
+  }
+  if (audio_idx != ctx.audio_stream) {
+    ctx.next_auddec.setSeekTarget(audio_end);
+    ctx.next_auddec.setTempo(ctx.auddec.tempo);
+    ctx.pending_audio_switch = true;
+    ctx.audioq.put_stream_change(audio_idx);
+    ctx.audio_stream = ctx.last_audio_stream = audio_idx;
+  }
+  // The streams now played, some of which the variants may share
+  for (const auto idx : {ctx.video_stream, ctx.audio_stream,
+                         ctx.subtitle_stream}) {
+    if (idx >= 0) ic->streams[idx]->discard = AVDISCARD_DEFAULT;
+  }
+  abr->setCurrent(index);
+
+  return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "AbrController.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <QtGlobal>
+#include <cstdint>
+#include <memory>
+
+struct PlayerContext;
+
+/* Adaptive bitrate playback: moves to the variant the AbrController picks,
+ * with the same decoder hand-over as gapless playback. The new variant's
+ * streams are read from the segment that holds the current read position,
+ * which overlaps what is queued already: the new decoders skip up to its end.
+ * Demux thread only. */
+class VariantSwitcher final {
+  Q_DISABLE_COPY_MOVE(VariantSwitcher);
+
+ public:
+  explicit VariantSwitcher(PlayerContext& _ctx) : ctx(_ctx) {}
+  ~VariantSwitcher() = default;
+
+  /* Meters the input if adaptive playback is enabled. Must be called before
+   * avformat_open_input, with the options it is given. The switcher must
+   * outlive 'ic', whose I/O it closes. */
+  void attach(AVFormatContext* ic, AVDictionary** format_opts);
+  /* Picks the variant to start with once the input is probed, and the streams
+   * to play for it. Returns false if there is nothing to adapt. */
+  bool init(AVFormatContext* ic, int& video_idx, int& audio_idx);
+  // Another input is played, which is not metered
+  void reset() { is_active = false; }
+  bool active() const { return is_active; }
+
+  /* Switches to the variant the controller picks, if the decoders are free
+   * for it. 'audio_end' and 'video_end' are where the queued streams end, as
+   * queued. Returns true if it switched. */
+  bool update(AVFormatContext* ic, int64_t audio_end, int64_t video_end);
+
+ private:
+  PlayerContext& ctx;
+  std::unique_ptr<AbrController> abr;
+  bool is_active = false;
+};
@@ -1,6 +1,7 @@
 #include "PlayerCore.hpp"
 
 #include "Common/PlayerContext.hpp"
+#include "Common/PlayerSettings.hpp"
 #include "Widgets/QtPlayGUI.hpp"
 #include "Widgets/VideoDisplayWidget.hpp"
 #include "Widgets/ToolBar.hpp"
@@ -54,14 +55,29 @@ void PlayerCore::openURL(QUrl url) {
     }
 }
 
+/* The item to chain to when the current one ends, see PlayerContext */
+void PlayerCore::setNextURL(QUrl url) {
+    if (!player_inst) return;
+    const auto str = url.isValid()
+        ? (url.isLocalFile() ? url.toLocalFile() : url.toString())
+        : QString();
+    player_inst->setNextURL(str.toStdString());
+}
+
 void PlayerCore::shutDown() {
     player_inst = nullptr;
     closeVideoOutput();
     resetControls();
 }
 
-void PlayerCore::reqSeek(double pcnt) {
-    if (isActive()) player_inst->seek_by_percent(pcnt);
+void PlayerCore::reqSeek(double pcnt, bool fast) {
+    if (!isActive()) return;
+    // Dragging the slider scrubs where the input allows it
+    if (fast && PlayerSettings::get().live_scrubbing &&
+        player_inst->scrub_to(pcnt))
+        return;
+    if (!fast && player_inst->end_scrub(pcnt)) return;
+    player_inst->seek_by_percent(pcnt, fast);
 }
 
 void PlayerCore::setVol(double percent) {
@@ -71,12 +87,24 @@ void PlayerCore::setVol(double percent) {
     }
 }
 
+std::string PlayerCore::currentURL() {
+    return isActive() ? player_inst->currentURL() : std::string();
+}
+
+bool PlayerCore::isBuffered() {
+    if (!isActive()) return false;
+    const auto st = player_inst->buffering.state();
+    return player_inst->demuxerEOF() ||
+           (st.audio_buffered >= st.target_duration &&
+            st.video_buffered >= st.target_duration);
+}
+
 std::pair<double, double> PlayerCore::getPlaybackPos() {
     double pos = NAN, dur = NAN;
     if (player_inst) {
         const auto best_clock = player_inst->best_clkval();
         if (!std::isnan(best_clock)) {
-            pos = best_clock;
+            pos = best_clock - player_inst->timeline_offset.load();
             dur = player_inst->stream_duration.load(std::memory_order_relaxed);
         }
     }
@@ -101,6 +129,25 @@ void  PlayerCore::seekByIncr(double incr) {
     }
 }
 
+// Keyframe-only fast forward and rewind
+void PlayerCore::stepTrickSpeed(bool faster) {
+    if (isActive()) {
+        player_inst->step_trick_speed(faster);
+    }
+}
+
+void PlayerCore::stepFrame(bool backward) {
+    if (isActive()) {
+        player_inst->step_frame(backward);
+    }
+}
+
+void PlayerCore::toggleReverse() {
+    if (isActive()) {
+        player_inst->toggle_reverse();
+    }
+}
+
 bool PlayerCore::isPlaying() {
     if (isActive()) {
         return player_inst->read_tid->getPauseStatus();
@@ -119,4 +166,36 @@ void PlayerCore::toggleMute() {
     if (isActive()) {
         player_inst->toggle_mute();
     }
+}
+
+// Remuxes the input to a file in the videos folder as it plays
+void PlayerCore::toggleRecording() {
+    if (isActive()) {
+        player_inst->toggle_recording();
+    }
+}
+
+void PlayerCore::cycleAudioStream() {
+    if (isActive()) {
+        player_inst->request_stream_cycle(AVMEDIA_TYPE_AUDIO);
+    }
+}
+
+void PlayerCore::cycleVideoStream() {
+    if (isActive()) {
+        player_inst->request_stream_cycle(AVMEDIA_TYPE_VIDEO);
+    }
+}
+
+void PlayerCore::cycleSubtitleStream() {
+    if (isActive()) {
+        player_inst->request_stream_cycle(AVMEDIA_TYPE_SUBTITLE);
+    }
+}
+
+// Multi-program inputs, e.g. a DVB multiplex
+void PlayerCore::cycleProgram() {
+    if (isActive()) {
+        player_inst->request_stream_cycle(AVMEDIA_TYPE_UNKNOWN);
+    }
 }
\ No newline at end of file
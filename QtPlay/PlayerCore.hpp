@@ -4,6 +4,7 @@
 #include<QUrl>
 
 #include <memory>
+#include <string>
 #include <vector>
 
 class PlayerCore final {
@@ -18,17 +19,30 @@ public:
 	static PlayerCore& instance();
 
 	void openURL(QUrl url);
+	void setNextURL(QUrl url);
 	void shutDown();
-	void reqSeek(double pcnt);
+	void reqSeek(double pcnt, bool fast = false);
 	void seekByIncr(double incr);
+	void stepTrickSpeed(bool faster);
+	void stepFrame(bool backward);
+	void toggleReverse();
 	void setVol(double pcnt);
 	void togglePause();
 	void toggleMute();
+	void toggleRecording();
+	void cycleAudioStream();
+	void cycleVideoStream();
+	void cycleSubtitleStream();
+	void cycleProgram();
 	void pausePlayback();
 	void resumePlayback();
 	bool isPlaying();
 	bool isActive() const;
+	// Of the item being played, empty if none
+	std::string currentURL();
 	std::pair<double, double> getPlaybackPos();
+	// The packet queues have reached their buffering targets
+	bool isBuffered();
 };
 
 #define playerCore PlayerCore::instance()
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "GopCache.hpp"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+#include <iterator>
+
+GopCache::GopCache(int64_t _max_bytes) : max_bytes(_max_bytes) {}
+
+void GopCache::clear() {
+  frames.clear();
+  bytes = 0;
+  first = last = run_end = run_last = NAN;
+}
+
+void GopCache::beginRun(double end) {
+  // Only a run up to the start of the range is consecutive with it
+  if (first != end) clear();
+  run_end = end;
+  run_last = NAN;
+}
+
+bool GopCache::add(const Frame& frame) {
+  if (!inRun() || std::isnan(frame.pts)) return false;
+
+  // The frame at the end of a run that extends the range is there already
+  if (!frames.count(frame.pts)) {
+    const auto src = frame.av();
+    Frame compact;
+    const auto dst = compact.av();
+    dst->format = src->format;
+    dst->width = src->width;
+    dst->height = src->height;
+    if (av_frame_get_buffer(dst, 1) < 0 || av_frame_copy(dst, src) < 0 ||
+        av_frame_copy_props(dst, src) < 0) {
+      endRun();
+      return true;
+    }
+    Frame::copyParams(frame, compact);
+    bytes += frame_size(dst);
+    frames.emplace(frame.pts, std::move(compact));
+  }
+  run_last = frame.pts;
+  evict();
+
+  if (frame.pts < run_end) return false;
+  endRun();
+  return true;
+}
+
+void GopCache::endRun() {
+  if (!inRun()) return;
+
+  // Short of its end, the run is not consecutive with the frames after it
+  if (std::isnan(run_last)) {
+    frames.clear();
+    bytes = 0;
+  } else if (run_last < run_end) {
+    for (auto it = frames.upper_bound(run_last); it != frames.end();) {
+      bytes -= frame_size(it->second.av());
+      it = frames.erase(it);
+    }
+  }
+
+  run_end = run_last = NAN;
+  first = frames.empty() ? NAN : frames.begin()->first;
+  last = frames.empty() ? NAN : frames.rbegin()->first;
+}
+
+const Frame* GopCache::before(double pts) const {
+  if (inRun() || !(pts > first && pts <= last)) return nullptr;
+  const auto it = frames.lower_bound(pts);
+  return it != frames.begin() ? &std::prev(it)->second : nullptr;
+}
+
+const Frame* GopCache::after(double pts) const {
+  if (inRun() || !(pts >= first && pts < last)) return nullptr;
+  const auto it = frames.upper_bound(pts);
+  return it != frames.end() ? &it->second : nullptr;
+}
+
+int64_t GopCache::frame_size(const AVFrame* frame) {
+  const auto size = av_image_get_buffer_size((AVPixelFormat)frame->format,
+                                             frame->width, frame->height, 1);
+  return size > 0 ? size : 0;
+}
+
+void GopCache::evict() {
+  while (bytes > max_bytes && frames.size() > 1) {
+    // Frames after the run first, then the earliest ones of the run
+    auto it = std::prev(frames.end());
+    if (it->first <= run_end) it = frames.begin();
+    bytes -= frame_size(it->second.av());
+    frames.erase(it);
+  }
+}
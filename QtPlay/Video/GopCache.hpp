@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../AVWrappers/Frame.hpp"
+
+#include <QtGlobal>
+#include <cmath>
+#include <cstdint>
+#include <map>
+
+/* Decoded video frames around the position, for stepping backwards. To step
+ * back past what it holds, the GOP before the frame shown is decoded again
+ * from its keyframe into the cache (a run), and the frames are then served
+ * from memory in either direction.
+ *
+ * The cache covers a single range of consecutive frames: a run that ends
+ * where the range starts extends it. Frames are copied into tightly packed
+ * buffers, which releases the decoder's pool and padding. Over the budget,
+ * frames are evicted from the end of the range away from the run being
+ * decoded, so that the frames next to the one shown are kept. Video thread
+ * only. */
+class GopCache final {
+  Q_DISABLE_COPY_MOVE(GopCache);
+
+ public:
+  explicit GopCache(int64_t max_bytes);
+  ~GopCache() = default;
+
+  void clear();
+
+  // Starts collecting the frames decoded up to the one shown at 'end'
+  void beginRun(double end);
+  /* Adds a frame of the run. Returns true once the frame at 'end' (or a
+   * later one) is in, which completes the run. */
+  bool add(const Frame& frame);
+  // Completes the run with what it has, e.g. at the end of the input
+  void endRun();
+  bool inRun() const { return !std::isnan(run_end); }
+
+  // The frame before or after 'pts', if the cache holds both
+  const Frame* before(double pts) const;
+  const Frame* after(double pts) const;
+
+ private:
+  const int64_t max_bytes;
+  std::map<double, Frame> frames;  // By pts, in seconds
+  int64_t bytes = 0;
+  // Range of consecutive frames held, NAN if none
+  double first = NAN, last = NAN;
+  double run_end = NAN, run_last = NAN;  // Of the run being decoded
+
+  static int64_t frame_size(const AVFrame* frame);
+  void evict();
+};
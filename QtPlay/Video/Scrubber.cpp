@@ -0,0 +1,131 @@
+#include "Scrubber.hpp"
+
+#include "../Common/QtPlayCommon.hpp"
+#include "../Demux/KeyframeIndex.hpp"
+#include "../VideoOutput/GLWindow.hpp"
+
+#include <deque>
+#include <optional>
+#include <utility>
+
+using qtplay::logMsg;
+
+Scrubber::Scrubber(const std::string& url, int video_hint, GLWindow* _output)
+    : input_url(url), stream_hint(video_hint), output(_output) {
+  worker = std::thread([this] { run(); });
+}
+
+Scrubber::~Scrubber() {
+  {
+    std::scoped_lock lck(mtx);
+    quit = true;
+  }
+  cond.notify_all();
+  if (worker.joinable()) worker.join();
+
+  dec.destroy();
+}
+
+void Scrubber::show(double percent) {
+  {
+    std::scoped_lock lck(mtx);
+    pending = percent;
+    active = true;
+  }
+  cond.notify_one();
+}
+
+void Scrubber::stop() {
+  std::scoped_lock lck(mtx);
+  pending = NAN;
+  active = false;
+}
+
+int Scrubber::interrupt_cb(void* opaque) {
+  return qtplay::ptr_cast<Scrubber>(opaque)->quit;
+}
+
+void Scrubber::run() {
+  if (!open()) {
+    if (!quit) logMsg("Scrubbing is not available for this input");
+    unusable = true;
+    return;
+  }
+
+  std::unique_lock lck(mtx);
+  while (true) {
+    cond.wait(lck, [this] { return quit || !std::isnan(pending); });
+    if (quit) break;
+
+    const auto percent = std::exchange(pending, NAN);
+    lck.unlock();
+    showAt(percent);
+    lck.lock();
+  }
+}
+
+bool Scrubber::open() {
+  // The hint and the keyframe index are stream numbers of the playback
+  if (!reader.open(input_url, {interrupt_cb, this}, stream_hint)) return false;
+  const auto ic = reader.context();
+  const auto video_idx = reader.streamIndex();
+
+  // Half the display size is plenty for a picture that keeps changing
+  const auto display_size = output->displaySize();
+  if (!display_size.isEmpty())
+    dec.setDisplaySize(display_size.width() / 2, display_size.height() / 2);
+  if (!dec.init_swdec(Stream(ic, video_idx))) return false;
+
+  // The index of the playback, kept on disk, maps times to keyframes
+  if (KeyframeIndex::isUseful(ic))
+    kf_index = std::make_unique<KeyframeIndex>(input_url, video_idx);
+
+  return true;
+}
+
+void Scrubber::showAt(double percent) {
+  const auto ic = reader.context();
+  const auto start_time =
+      ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0LL;
+  const auto target =
+      start_time + std::int64_t(percent * double(ic->duration));
+
+  std::optional<KeyframeIndex::Entry> keyframe;
+  if (kf_index) keyframe = kf_index->lookup(target);
+  if (keyframe && keyframe->pts == shown_pts) return;
+  const auto ret =
+      keyframe ? avformat_seek_file(ic, -1, keyframe->pos, keyframe->pos,
+                                    keyframe->pos, AVSEEK_FLAG_BYTE)
+               : avformat_seek_file(ic, -1, INT64_MIN, target, INT64_MAX, 0);
+  if (ret < 0) return;
+
+  Packet pkt;
+  if (!reader.read(pkt.avData(), [this] { return quit.load(); })) return;
+
+  const auto av_pkt = pkt.constAvData();
+  const auto ts = av_pkt->pts != AV_NOPTS_VALUE ? av_pkt->pts : av_pkt->dts;
+  const auto pts =
+      ts != AV_NOPTS_VALUE
+          ? av_rescale_q(ts, ic->streams[reader.streamIndex()]->time_base,
+                         AVRational{1, AV_TIME_BASE})
+          : AV_NOPTS_VALUE;
+  if (pts == AV_NOPTS_VALUE || pts != shown_pts) present(pkt);
+  shown_pts = keyframe ? keyframe->pts : pts;
+}
+
+void Scrubber::present(const Packet& keyframe) {
+  // The keyframe is drained out right away, then the decoder is reused
+  std::deque<Frame> frames;
+  dec.decode_video_packet(keyframe, frames);
+  Packet flush_pkt;
+  flush_pkt.setFlush(true);
+  dec.decode_video_packet(flush_pkt, frames);
+  dec.eof_state = false;
+  if (frames.empty()) return;
+
+  // Not over the precise seek that follows the release of the slider
+  std::scoped_lock lck(mtx);
+  if (!active) return;
+  output->setVideoData(std::move(frames.back()));
+  output->requestUpdate(true);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../Common/Decoder.hpp"
+#include "../Demux/KeyframeReader.hpp"
+
+#include <QtGlobal>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class GLWindow;
+class KeyframeIndex;
+
+/* Shows pictures while the seek slider is dragged. The input is opened a
+ * second time, on a thread of its own, and each slider position is mapped to
+ * the nearest keyframe, which alone is decoded at reduced resolution and
+ * handed straight to the video output. The playback itself is not touched;
+ * it seeks precisely once the slider is released.
+ *
+ * Only the latest position is kept: while one keyframe is decoded, newer
+ * positions replace each other. Positions between the same two keyframes
+ * show the same picture and are not decoded again. */
+class Scrubber final {
+  Q_DISABLE_COPY_MOVE(Scrubber);
+
+ public:
+  // 'video_hint' is the video stream being played, if any
+  Scrubber(const std::string& url, int video_hint, GLWindow* output);
+  ~Scrubber();
+
+  const std::string& url() const { return input_url; }
+  // Shows the keyframe nearest to 'percent' of the duration, never blocks
+  void show(double percent);
+  // Nothing more is shown until the next show()
+  void stop();
+  // The input cannot be scrubbed: no video, not seekable or not opened
+  bool failed() const { return unusable; }
+
+ private:
+  const std::string input_url;
+  const int stream_hint;
+  GLWindow* const output;
+
+  std::mutex mtx;
+  std::condition_variable cond;
+  double pending = NAN;  // Protected by the mtx, as is 'active'
+  bool active = false;
+  std::atomic_bool quit = false, unusable = false;
+  std::thread worker;
+
+  // Worker thread only
+  KeyframeReader reader;
+  Decoder dec;
+  std::unique_ptr<KeyframeIndex> kf_index;
+  int64_t shown_pts = AV_NOPTS_VALUE;  // Keyframe shown, AV_TIME_BASE units
+
+  static int interrupt_cb(void* opaque);
+  void run();
+  bool open();
+  void showAt(double percent);
+  void present(const Packet& keyframe);
+};
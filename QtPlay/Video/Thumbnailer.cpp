@@ -0,0 +1,260 @@
+#include "Thumbnailer.hpp"
+
+#include "../Common/CachePaths.hpp"
+#include "../Common/PlayerSettings.hpp"
+#include "../Common/QtPlayCommon.hpp"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+#include <utility>
+
+using qtplay::logMsg;
+
+Thumbnailer::Thumbnailer(const std::string& url, int width)
+    : QThread(nullptr),
+      input_url(url),
+      thumb_width(std::clamp(width, 16, 1024)),
+      cache_file(PlayerSettings::get().thumbnail_disk_cache
+                     ? qtplay::mediaCachePath(url, "Thumbnails", "thm")
+                     : QString()) {
+  load();
+  start(QThread::LowestPriority);
+}
+
+Thumbnailer::~Thumbnailer() {
+  {
+    std::scoped_lock lck(mtx);
+    quit = true;
+  }
+  cond.notify_all();
+  wait();
+  save();
+}
+
+int Thumbnailer::bucket(double percent) {
+  return std::clamp(int(percent * buckets), 0, buckets - 1);
+}
+
+QImage Thumbnailer::request(double percent) {
+  {
+    std::scoped_lock lck(mtx);
+    if (auto image = lookup(bucket(percent)); !image.isNull()) {
+      pending = NAN;
+      return image;
+    }
+    pending = percent;
+  }
+  cond.notify_one();
+
+  return {};
+}
+
+void Thumbnailer::cancel() {
+  std::scoped_lock lck(mtx);
+  pending = NAN;
+}
+
+void Thumbnailer::run() {
+  if (!open()) {
+    close();
+    return;
+  }
+
+  std::unique_lock lck(mtx);
+  while (true) {
+    cond.wait(lck, [this] { return quit || !std::isnan(pending); });
+    if (quit) break;
+
+    const auto percent = std::exchange(pending, NAN);
+    const auto idx = bucket(percent);
+    if (!lookup(idx).isNull()) continue;
+    lck.unlock();
+    const auto image = generate(idx);
+    lck.lock();
+
+    if (image.isNull()) continue;
+    insert(idx, image);
+    emit sigReady(percent, image);
+  }
+  lck.unlock();
+
+  close();
+}
+
+bool Thumbnailer::open() {
+  if (!reader.open(input_url, {qtplay::interrupt_on_flag, &quit}))
+    return false;
+
+  const auto st = reader.context()->streams[reader.streamIndex()];
+  const auto par = st->codecpar;
+  const auto codec = avcodec_find_decoder(par->codec_id);
+  if (!codec || !(avctx = avcodec_alloc_context3(codec)) ||
+      avcodec_parameters_to_context(avctx, par) < 0)
+    return false;
+  avctx->pkt_timebase = st->time_base;
+  // A single thread, and the largest reduction that stays above the width
+  avctx->thread_count = 1;
+  avctx->skip_loop_filter = AVDISCARD_ALL;
+  avctx->flags2 |= AV_CODEC_FLAG2_FAST;
+  auto lowres = 0;
+  while (lowres < codec->max_lowres &&
+         (par->width >> (lowres + 1)) >= thumb_width)
+    ++lowres;
+  avctx->lowres = lowres;
+  if (avcodec_open2(avctx, codec, nullptr) < 0) return false;
+
+  return (pkt = av_packet_alloc()) && (frame = av_frame_alloc());
+}
+
+void Thumbnailer::close() {
+  av_frame_free(&frame);
+  av_packet_free(&pkt);
+  sws_freeContext(sws);
+  sws = nullptr;
+  avcodec_free_context(&avctx);
+  reader.close();
+}
+
+bool Thumbnailer::superseded() {
+  std::scoped_lock lck(mtx);
+  return quit || !std::isnan(pending);
+}
+
+QImage Thumbnailer::generate(int idx) {
+  // The middle of the bucket, so that its keyframe is rarely the previous one
+  const auto ic = reader.context();
+  const auto start_time =
+      ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0LL;
+  const auto target =
+      start_time + std::int64_t((idx + 0.5) / buckets * double(ic->duration));
+  if (avformat_seek_file(ic, -1, INT64_MIN, target, target, 0) < 0 ||
+      !reader.read(pkt, [this] { return superseded(); }))
+    return {};
+
+  // Sent with the end of stream, so that the picture comes out at once
+  QImage image;
+  if (avcodec_send_packet(avctx, pkt) >= 0 &&
+      avcodec_send_packet(avctx, nullptr) >= 0 &&
+      avcodec_receive_frame(avctx, frame) >= 0) {
+    image = toImage(frame);
+    av_frame_unref(frame);
+  }
+  av_packet_unref(pkt);
+  avcodec_flush_buffers(avctx);
+
+  return image;
+}
+
+QImage Thumbnailer::toImage(const AVFrame* src) {
+  if (src->width <= 0 || src->height <= 0) return {};
+
+  // Display aspect ratio, with the sample aspect ratio of the frame
+  auto aspect = double(src->width) / src->height;
+  if (src->sample_aspect_ratio.num > 0 && src->sample_aspect_ratio.den > 0)
+    aspect *= av_q2d(src->sample_aspect_ratio);
+  const auto height = std::max(int(thumb_width / aspect + 0.5) & ~1, 2);
+
+  // swscale picks its SIMD code paths for the CPU by itself
+  sws = sws_getCachedContext(sws, src->width, src->height,
+                             (AVPixelFormat)src->format, thumb_width, height,
+                             AV_PIX_FMT_BGRA, SWS_BILINEAR, nullptr, nullptr,
+                             nullptr);
+  if (!sws) return {};
+
+  QImage image(thumb_width, height, QImage::Format_RGB32);
+  if (image.isNull()) return {};
+  uint8_t* const dst[4] = {image.bits(), nullptr, nullptr, nullptr};
+  const int dst_linesize[4] = {(int)image.bytesPerLine(), 0, 0, 0};
+  if (sws_scale(sws, src->data, src->linesize, 0, src->height, dst,
+                dst_linesize) <= 0)
+    return {};
+
+  return image;
+}
+
+QImage Thumbnailer::lookup(int idx) {
+  if (const auto it = images.find(idx); it != images.end()) {
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->second;
+  }
+
+  // Decoded from the cache file on first use
+  const auto stored_it = stored.find(idx);
+  if (stored_it == stored.end()) return {};
+  QImage image;
+  if (!image.loadFromData(stored_it->second, "JPG")) {
+    stored.erase(stored_it);
+    return {};
+  }
+  insert(idx, image);
+
+  return image;
+}
+
+void Thumbnailer::insert(int idx, const QImage& image) {
+  if (images.count(idx)) return;
+
+  lru.emplace_front(idx, image);
+  images[idx] = lru.begin();
+  while (lru.size() > max_images) {
+    images.erase(lru.back().first);
+    lru.pop_back();
+  }
+
+  if (cache_file.isEmpty() || stored.count(idx)) return;
+  QByteArray jpeg;
+  QBuffer buffer(&jpeg);
+  if (buffer.open(QIODevice::WriteOnly) && image.save(&buffer, "JPG", 80)) {
+    stored.emplace(idx, std::move(jpeg));
+    dirty = true;
+  }
+}
+
+void Thumbnailer::load() {
+  if (cache_file.isEmpty()) return;
+
+  QFile file(cache_file);
+  if (!file.open(QIODevice::ReadOnly)) return;
+
+  QDataStream in(&file);
+  quint32 magic = 0, version = 0;
+  qint32 width = 0, count = 0;
+  in >> magic >> version >> width >> count;
+  // Thumbnails of another width are generated again
+  if (magic != file_magic || version != file_version ||
+      width != thumb_width || count < 0 || count > buckets)
+    return;
+
+  std::map<int, QByteArray> loaded;
+  for (auto i = 0; i < count; ++i) {
+    qint32 idx = 0;
+    QByteArray jpeg;
+    in >> idx >> jpeg;
+    if (idx >= 0 && idx < buckets) loaded.emplace(idx, std::move(jpeg));
+  }
+  if (in.status() != QDataStream::Ok) return;
+
+  std::scoped_lock lck(mtx);
+  stored = std::move(loaded);
+  logMsg("Thumbnails: %zu loaded from the cache", stored.size());
+}
+
+void Thumbnailer::save() {
+  std::scoped_lock lck(mtx);
+  if (cache_file.isEmpty() || !dirty) return;
+
+  QSaveFile file(cache_file);
+  if (!file.open(QIODevice::WriteOnly)) return;
+
+  QDataStream out(&file);
+  out << file_magic << file_version << (qint32)thumb_width
+      << (qint32)stored.size();
+  for (const auto& [idx, jpeg] : stored) {
+    out << (qint32)idx << jpeg;
+  }
+
+  if (file.commit()) dirty = false;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../Demux/KeyframeReader.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/* Thumbnails of an input for the seek slider. The duration is split into
+ * buckets; the thumbnail of a bucket is the keyframe at or before its middle,
+ * decoded at lowres where the codec allows it and scaled down to RGB.
+ *
+ * The thumbnailer never contends with the playback: it opens the input on
+ * its own, runs at the lowest thread priority and decodes on a single thread.
+ * Only the latest request is served; a newer one cancels the request in
+ * progress at the next packet. Thumbnails are kept in a memory LRU and, for
+ * local files, in a cache file that is loaded on the next open. */
+class Thumbnailer final : public QThread {
+  Q_OBJECT;
+  Q_DISABLE_COPY_MOVE(Thumbnailer);
+
+ public:
+  static constexpr int buckets = 500;
+
+  Thumbnailer(const std::string& url, int width);
+  ~Thumbnailer();
+
+  const std::string& url() const { return input_url; }
+  static int bucket(double percent);
+  /* Returns the thumbnail at 'percent' of the duration if it is cached,
+   * otherwise a null image, and sigReady follows once it is generated */
+  QImage request(double percent);
+  void cancel();
+
+  Q_SIGNAL void sigReady(double percent, QImage image);
+
+ private:
+  static constexpr quint32 file_magic = 0x51505448;  // "QPTH"
+  static constexpr quint32 file_version = 1;
+  static constexpr std::size_t max_images = 256;  // Memory LRU
+
+  const std::string input_url;
+  const int thumb_width;
+  const QString cache_file;  // Empty without a disk cache
+
+  std::mutex mtx;
+  std::condition_variable cond;
+  // Protected by the mtx
+  double pending = NAN;
+  std::list<std::pair<int, QImage>> lru;  // Most recently used first
+  std::unordered_map<int, decltype(lru)::iterator> images;
+  std::map<int, QByteArray> stored;  // JPEG, as in the cache file
+  bool dirty = false;
+  std::atomic_bool quit = false;
+
+  // Worker thread only
+  KeyframeReader reader;
+  AVCodecContext* avctx = nullptr;
+  SwsContext* sws = nullptr;
+  AVPacket* pkt = nullptr;
+  AVFrame* frame = nullptr;
+
+  void run() override;
+  bool open();
+  void close();
+  bool superseded();
+  QImage generate(int bucket);
+  QImage toImage(const AVFrame* src);
+  // Under the mtx
+  QImage lookup(int bucket);
+  void insert(int bucket, const QImage& image);
+  void load();
+  void save();
+};
@@ -1,6 +1,8 @@
 #include "VideoThread.hpp"
 
 #include "../Common/PlayerContext.hpp"
+#include "../Common/PlayerSettings.hpp"
+#include "GopCache.hpp"
 #include "SupportedPixFmts.hpp"
 #include "../Widgets/QtPlayGUI.hpp"
 #include "../Widgets/VideoDisplayWidget.hpp"
@@ -31,12 +33,26 @@ void VideoThread::run() {
   /* Preferred number of frames to keep in filtered_frames during playback */
   constexpr auto preferred_buffered_frames = 2;
 
-  const auto is_attached_pic = ctx.viddec.stream.isAttachedPic();
+  auto is_attached_pic = ctx.viddec.stream.isAttachedPic();
   auto step_pending = true, update_frame_timer = true, can_skip = true,
-       last_paused = false, local_paused = false, local_eof = false;
+       last_paused = false, local_paused = false, local_eof = false,
+       resumed = false;
   const auto max_frame_duration = ctx.max_frame_duration;
   auto frame_timer = 0.0, last_pts = 0.0, last_estim_duration = 0.0;
 
+  /* Stepping back while paused: the frames before the one shown come from
+   * the GOP cache. On a miss, the input is seeked to the keyframe before the
+   * frame shown, and the frames up to it are decoded into the cache (a fill)
+   * without being displayed. The playback resumes from the frame shown. */
+  enum class Fill { NONE, REQUESTED, COLLECTING };
+  constexpr auto max_fill_attempts = 3;
+  const auto gop_cache_mb = PlayerSettings::get().gop_cache_mb;
+  GopCache gop_cache(std::max(gop_cache_mb, 0) * 1048576LL);
+  auto fill = Fill::NONE;
+  double fill_end = NAN, shown_pts = NAN, last_back_step = 0.0;
+  auto fill_attempts = 0, back_steps = 0, forward_steps = 0;
+  auto rewound = false;  // The frame shown is behind the decoder
+
   auto vp_duration = [](double max_duration, double cur_pts, double last_pts,
                         double framerate_duration, double last_pts_duration) {
     auto dur_probably_valid = [max_duration](double duration) {
@@ -91,6 +107,17 @@ void VideoThread::run() {
     pkt.clear();
     step_pending = update_frame_timer = true;
     can_skip = local_eof = false;
+    // The seek of a fill lands on the keyframe the fill decodes from
+    if (fill == Fill::REQUESTED) {
+      fill = Fill::COLLECTING;
+    } else {
+      fill = Fill::NONE;
+      gop_cache.clear();
+      shown_pts = NAN;
+      rewound = false;
+    }
+    // The decoder may have been switched to another stream meanwhile
+    is_attached_pic = ctx.viddec.stream.isAttachedPic();
     ctx.viddec.flush();
     std::scoped_lock sl(ctx.sub_stream_mutex);
     if (ctx.subtitle_stream >= 0) {
@@ -99,6 +126,89 @@ void VideoThread::run() {
     }
   };
 
+  auto present_cached = [&](const Frame& frame) {
+    videoWidget->setVideoData(frame);
+    videoWidget->requestUpdate(true);
+    shown_pts = frame.pts;
+    last_back_step = qtplay::gettime();
+    ctx.vidclk.set(shown_pts, last_back_step);
+    rewound = true;
+  };
+
+  // 'lead' moves the seek further back than the frame shown
+  auto request_fill = [&](double end, double lead) {
+    fill = Fill::REQUESTED;
+    fill_end = end;
+    step_pending = false;
+    gop_cache.beginRun(end);
+    ctx.request_seek_to(end - lead, true);
+  };
+
+  auto finish_fill = [&] {
+    gop_cache.endRun();
+    fill = Fill::NONE;
+    step_pending = false;
+    if (const auto prev = gop_cache.before(fill_end)) {
+      present_cached(*prev);
+      back_steps = std::max(back_steps - 1, 0);
+    } else if (++fill_attempts < max_fill_attempts) {
+      // The seek did not land before the frame shown, go further back
+      request_fill(fill_end, fill_attempts);
+    } else {
+      logMsg("Cannot step back from %.3f s", fill_end);
+      back_steps = 0;
+      ctx.reverse_playback = false;
+    }
+  };
+
+  // Frame steps are taken one at a time while paused, backward ones first
+  auto take_steps = [&] {
+    const auto steps = ctx.frame_steps.exchange(0);
+    if (is_attached_pic || ctx.trick_speed) return;
+    if (steps < 0 && gop_cache_mb > 0) back_steps -= steps;
+    if (steps > 0) forward_steps += steps;
+
+    const auto interval =
+        last_estim_duration > 0.0 ? last_estim_duration : 0.04;
+    if (ctx.reverse_playback && !back_steps &&
+        qtplay::gettime() - last_back_step >= interval)
+      back_steps = 1;
+
+    if (fill != Fill::NONE || std::isnan(shown_pts)) return;
+    if (back_steps > 0) {
+      if (const auto prev = gop_cache.before(shown_pts)) {
+        present_cached(*prev);
+        --back_steps;
+      } else {
+        fill_attempts = 0;
+        request_fill(shown_pts, 0.001);
+      }
+    } else if (forward_steps > 0 && !step_pending) {
+      --forward_steps;
+      const auto next = rewound ? gop_cache.after(shown_pts) : nullptr;
+      if (next)
+        present_cached(*next);
+      else
+        step_pending = true;
+    }
+  };
+
+  // After stepping back, the playback goes on from the frame shown
+  auto resume_from_shown = [&] {
+    const auto moved = rewound || fill != Fill::NONE;
+    ctx.reverse_playback = false;
+    ctx.frame_steps = 0;
+    back_steps = forward_steps = 0;
+    if (fill != Fill::NONE) {
+      gop_cache.endRun();
+      fill = Fill::NONE;
+    }
+    if (moved && !std::isnan(shown_pts)) {
+      filtered_frames.clear();
+      ctx.request_seek_to(shown_pts, false);
+    }
+  };
+
   auto cleanup_func = [&] {
     flush_state();
     sws_freeContext(sub_convert_ctx);
@@ -129,6 +239,7 @@ void VideoThread::run() {
 
       if ((is_paused != local_paused)) {
         local_paused = is_paused;
+        resumed = !local_paused;
         ctx.vidclk.setPaused(local_paused);
 
         request_received = true;
@@ -136,9 +247,19 @@ void VideoThread::run() {
       }
     }
 
+    if (resumed) {
+      resumed = false;
+      resume_from_shown();
+    } else if (local_paused) {
+      take_steps();
+    }
+
     local_eof = filtered_frames.empty() && ctx.videoq.isEmpty() && (ctx.viddec.eof_state || is_attached_pic || ctx.demuxerEOF());
+    if (fill == Fill::COLLECTING && local_eof) finish_fill();
     step_pending = step_pending && !local_eof;
-    const bool paused = (local_paused && !step_pending) || local_eof;
+    const auto collecting = fill == Fill::COLLECTING;
+    const bool paused =
+        (local_paused && !step_pending && !collecting) || local_eof;
 
     if (paused) {
       qtplay::sleep_ms(10);
@@ -151,23 +272,49 @@ void VideoThread::run() {
 
     if (filtered_frames.size() < preferred_buffered_frames) {
       if (ctx.videoq.get(pkt)) {
+        // A fill keeps every frame for stepping through
+        ctx.viddec.setMinFrameInterval(is_attached_pic || collecting
+                                           ? 0.0
+                                           : videoWidget->minFrameInterval());
+        const auto display_size = videoWidget->displaySize();
+        ctx.viddec.setDisplaySize(display_size.width(), display_size.height());
         ctx.viddec.decode_video_packet(pkt, filtered_frames);
+        if (pkt.isStreamChange()) {
+          ctx.switchToNextDecoder(AVMEDIA_TYPE_VIDEO);
+          is_attached_pic = ctx.viddec.stream.isAttachedPic();
+        }
         pkt.clear();
       } else {
         ctx.continue_read_thread.notify_one();
       }
     }
 
+    if (collecting) {
+      while (!filtered_frames.empty() && fill == Fill::COLLECTING) {
+        const auto done = gop_cache.add(filtered_frames.front());
+        filtered_frames.pop_front();
+        if (done) finish_fill();
+      }
+      continue;
+    }
+
     if (!filtered_frames.empty()) {
       auto& video_frame = filtered_frames.front();
       if (is_attached_pic) {
         videoWidget->setVideoData(std::move(video_frame));
         videoWidget->requestUpdate(true);
+        ctx.reportFirstFrame();
         filtered_frames.pop_front();
         step_pending = false;
         continue;
       }
 
+      // Already shown from the GOP cache
+      if (rewound && video_frame.pts <= shown_pts) {
+        filtered_frames.pop_front();
+        continue;
+      }
+
       bool force_display = false;
       auto time = qtplay::gettime();
       if (update_frame_timer) {
@@ -186,8 +333,11 @@ void VideoThread::run() {
 
       const auto skip_threshold =
           last_duration > 0 ? last_duration : AV_SYNC_THRESHOLD_MIN;
+      // Trick play keyframes are paced by the demuxer, shown as they come
+      const auto trick_play = ctx.trick_speed != 0;
       bool skip = false, too_late = false;
-      const auto delay = compute_target_delay(last_duration, too_late);
+      const auto delay =
+          trick_play ? 0.0 : compute_target_delay(last_duration, too_late);
       skip = (too_late && can_skip);
       step_pending = false;
       can_skip = true;
@@ -209,13 +359,14 @@ void VideoThread::run() {
 
       if (display) {
         frame_timer = next_frame_time;
-        last_pts = video_frame.pts;
+        shown_pts = last_pts = video_frame.pts;
         if (video_frame.bytePos() >= 0LL)
           ctx.last_video_byte_pos = video_frame.bytePos();
         if (!std::isnan(last_pts)) ctx.vidclk.set(last_pts, time);
 
-        if (delay > 0.0 &&
-            -time_left > AV_SYNC_THRESHOLD_MAX)  // frame_timer is too far off
+        if (trick_play ||
+            (delay > 0.0 &&
+             -time_left > AV_SYNC_THRESHOLD_MAX))  // frame_timer is too far off
           frame_timer = time;
         else if (time_left <= -skip_threshold)
           skip = can_skip;
@@ -328,11 +479,12 @@ void VideoThread::run() {
         if (!skip) {
           videoWidget->setVideoData(std::move(video_frame));
           videoWidget->requestUpdate(true);
+          ctx.reportFirstFrame();
         }
 
         filtered_frames.pop_front();
 
-        if (filtered_frames.size() > 0) {
+        if (filtered_frames.size() > 0 && !trick_play) {
           const auto& next_fr = filtered_frames.front();
           const auto dur =
               vp_duration(max_frame_duration, next_fr.pts, last_pts,
@@ -35,6 +35,15 @@ void GLCommon::doUpdateGL() {
       if (frame_pending) {
           first_readable = !first_readable;
           frame_pending = false;
+
+          const auto now = qtplay::gettime();
+          const auto dt = now - last_present_time;
+          if (dt > 0.0 && dt < 0.5) {
+            const auto prev = present_interval.load(std::memory_order_relaxed);
+            present_interval.store(prev > 0.0 ? prev * 0.9 + dt * 0.1 : dt,
+                                   std::memory_order_relaxed);
+          }
+          last_present_time = now;
       }
 
       return first_readable ? 0 : 1;
@@ -254,6 +263,7 @@ bool GLCommon::doInitGL() {
 bool GLCommon::setVideoData(const Frame& frame) {
   std::scoped_lock vl(video_pool_mutex);
   if (!is_opened) return false;
+  updateOverwriteStats(frame_pending);
   const auto uploaded = !frame_pending;
   m_framePair[first_readable ? 1 : 0] = frame;
   frame_pending = true;
@@ -264,6 +274,7 @@ bool GLCommon::setVideoData(const Frame& frame) {
 bool GLCommon::setVideoData(Frame&& frame) {
   std::scoped_lock vl(video_pool_mutex);
   if (!is_opened) return false;
+  updateOverwriteStats(frame_pending);
   const auto uploaded = !frame_pending;
   m_framePair[first_readable ? 1 : 0] = std::move(frame);
   frame_pending = true;
@@ -308,6 +319,48 @@ void GLCommon::reset() {
   for (auto& fr : m_framePair) fr.clear();
   osdPict.clear();
   first_readable = frame_pending = false;
+  resetPresentationStats();
+}
+
+void GLCommon::setRefreshRate(double hz) {
+  refresh_interval.store(hz > 1.0 ? 1.0 / hz : 0.0, std::memory_order_relaxed);
+}
+
+double GLCommon::minFrameInterval() const {
+  const auto refresh = refresh_interval.load(std::memory_order_relaxed);
+  if (!presentation_bound.load(std::memory_order_relaxed)) return refresh;
+  return std::max(refresh, present_interval.load(std::memory_order_relaxed));
+}
+
+void GLCommon::setDisplaySize(int w, int h) {
+  display_w.store(w, std::memory_order_relaxed);
+  display_h.store(h, std::memory_order_relaxed);
+}
+
+QSize GLCommon::displaySize() const {
+  return QSize(display_w.load(std::memory_order_relaxed),
+               display_h.load(std::memory_order_relaxed));
+}
+
+void GLCommon::resetPresentationStats() {
+  std::scoped_lock vl(video_pool_mutex);
+  present_interval.store(0.0, std::memory_order_relaxed);
+  presentation_bound.store(false, std::memory_order_relaxed);
+  last_present_time = NAN;
+  overwrite_ratio = 0.0;
+}
+
+// Must be called with the video_pool_mutex held
+void GLCommon::updateOverwriteStats(bool overwritten) {
+  /* Frames that get replaced before they were drawn mean that the window
+   * presents slower than we submit. Use a hysteresis so that the decimation
+   * in the decoder does not flip back and forth. */
+  overwrite_ratio = overwrite_ratio * 0.95 + (overwritten ? 0.05 : 0.0);
+  if (overwrite_ratio > 0.2) {
+    presentation_bound.store(true, std::memory_order_relaxed);
+  } else if (overwrite_ratio < 0.02) {
+    presentation_bound.store(false, std::memory_order_relaxed);
+  }
 }
 
 void GLCommon::onResize(int newW, int newH) {
@@ -441,6 +494,7 @@ void GLCommon::removeOSD() {
 
 bool GLCommon::pushVideoData(Frame& fr) {
   if (!is_opened) return false;
+  updateOverwriteStats(frame_pending);
   const auto uploaded = !frame_pending;
   fr.moveTo(m_framePair[first_readable ? 1 : 0]);
   frame_pending = true;
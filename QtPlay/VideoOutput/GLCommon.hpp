@@ -2,8 +2,10 @@
 
 #include <QOpenGLFunctions>
 #include <QOpenGLShaderProgram>
+#include <QSize>
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <memory>
 #include <mutex>
 
@@ -140,6 +142,19 @@ class GLCommon : public QOpenGLFunctions {
   Frame m_framePair[2];
   bool first_readable = false, frame_pending = false, is_opened = false;
 
+  /*
+  Presentation statistics. The decoder asks for the minimal interval between
+  frames that can actually reach the screen and drops everything in between
+  before any filtering or copying is done. The interval is bounded by the
+  display refresh rate and, once submitted frames start being overwritten in
+  the double buffer, by the measured rate at which frames are presented.
+  Protected by the video_pool_mutex, except the atomics.
+  */
+  std::atomic<int> display_w = 0, display_h = 0;  // In device pixels
+  std::atomic<double> refresh_interval = 0.0, present_interval = 0.0;
+  std::atomic_bool presentation_bound = false;
+  double last_present_time = NAN, overwrite_ratio = 0.0;
+
  public:
   GLCommon();
   virtual ~GLCommon();
@@ -150,6 +165,11 @@ class GLCommon : public QOpenGLFunctions {
   bool pushVideoData(Frame& frame);
   void setOSDImage(const Frame& osd);
   void setOpened(bool opened);
+  void setRefreshRate(double hz);
+  void setDisplaySize(int w, int h);
+  // Thread-safe
+  double minFrameInterval() const;
+  QSize displaySize() const;
 
  protected:
   void doUpdateGL();
@@ -162,6 +182,8 @@ class GLCommon : public QOpenGLFunctions {
   bool initShaderProgram(const Frame& frame);
   bool compileShaderProgram(const Frame& frame);
   void removeOSD();
+  void resetPresentationStats();
+  void updateOverwriteStats(bool overwritten);
 
  private:
   GLfloat rectVertices[8] = {
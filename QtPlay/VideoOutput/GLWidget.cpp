@@ -1,6 +1,7 @@
 #include "GLWidget.hpp"
 
 #include <QCoreApplication>
+#include <QScreen>
 
 GLWidget::GLWidget(QWidget* parent) : QOpenGLWidget(parent) {
   setObjectName("OpenGLWidget");
@@ -15,9 +16,16 @@ GLWidget::~GLWidget() {
   doneCurrent();
 }
 
-void GLWidget::resizeGL(int newW, int newH) { GLCommon::onResize(newW, newH); }
+void GLWidget::resizeGL(int newW, int newH) {
+  GLCommon::onResize(newW, newH);
+  const auto dpr = devicePixelRatio();
+  setDisplaySize(qRound(newW * dpr), qRound(newH * dpr));
+}
 
-void GLWidget::initializeGL() { GLCommon::doInitGL(); }
+void GLWidget::initializeGL() {
+  GLCommon::doInitGL();
+  if (auto scr = screen()) setRefreshRate(scr->refreshRate());
+}
 
 void GLWidget::paintGL() { GLCommon::doUpdateGL(); }
 
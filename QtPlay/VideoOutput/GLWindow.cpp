@@ -1,6 +1,7 @@
 ﻿#include "GLWindow.hpp"
 
 #include <QCoreApplication>
+#include <QScreen>
 #include <QThread>
 #include <QWidget>
 
@@ -16,6 +17,10 @@ GLWindow::GLWindow(QWidget* parent, Qt::WindowFlags flags) : QOpenGLWindow() {
   m_wrapperWidget->setAttribute(Qt::WA_OpaquePaintEvent, true);
   m_wrapperWidget->setAttribute(Qt::WA_PaintOnScreen, true);
   m_wrapperWidget->setAttribute(Qt::WA_NoSystemBackground, true);
+
+  connect(this, &QWindow::screenChanged, this, [this](QScreen* scr) {
+    if (scr) setRefreshRate(scr->refreshRate());
+  });
 }
 
 GLWindow::~GLWindow() {
@@ -24,9 +29,16 @@ GLWindow::~GLWindow() {
   doneCurrent();
 }
 
-void GLWindow::resizeGL(int newW, int newH) { GLCommon::onResize(newW, newH); }
+void GLWindow::resizeGL(int newW, int newH) {
+  GLCommon::onResize(newW, newH);
+  const auto dpr = devicePixelRatio();
+  setDisplaySize(qRound(newW * dpr), qRound(newH * dpr));
+}
 
-void GLWindow::initializeGL() { GLCommon::doInitGL(); }
+void GLWindow::initializeGL() {
+  GLCommon::doInitGL();
+  if (auto scr = screen()) setRefreshRate(scr->refreshRate());
+}
 
 void GLWindow::paintGL() {
   if (isExposed()) GLCommon::doUpdateGL();
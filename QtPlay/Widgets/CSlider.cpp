@@ -1,6 +1,10 @@
 #include "CSlider.hpp"
 
+#include <QLabel>
 #include <QMouseEvent>
+#include <QPainter>
+#include <algorithm>
+#include <utility>
 
 CSlider::CSlider(QWidget* parent) : QSlider(parent) {
   setMaximum(65536 * 2);
@@ -15,6 +19,13 @@ bool CSlider::event(QEvent* evt) {
   const auto etype = evt->type();
 
   switch (etype) {
+    case QEvent::MouseButtonRelease:
+      if (dragging &&
+          static_cast<const QMouseEvent*>(evt)->button() == Qt::LeftButton) {
+        dragging = false;
+        emit sigReleased(std::clamp((double)value() / maximum(), 0.0, 1.0));
+      }
+      break;
     case QEvent::MouseButtonPress:
     case QEvent::MouseMove:  // Move events are only emitted if at least one of
                              // the mouse buttons is being held(mouse tracking
@@ -23,10 +34,24 @@ bool CSlider::event(QEvent* evt) {
       if (isEnabled()) {
         auto mEvt = static_cast<const QMouseEvent*>(evt);
         if (mEvt->buttons() & Qt::LeftButton) {
+          dragging = true;
+          hidePreview();
           setValue(((double)mEvt->x() / width()) * maximum());
+        } else if (hover_preview && etype == QEvent::MouseMove &&
+                   mEvt->buttons() == Qt::NoButton) {
+          hover_x = mEvt->x();
+          emit sigHovered(std::clamp((double)hover_x / width(), 0.0, 1.0));
         }
       }
     } break;
+    case QEvent::Leave:
+    case QEvent::Hide:
+    case QEvent::EnabledChange:
+      if (hover_preview) {
+        hidePreview();
+        emit sigHoverLeft();
+      }
+      break;
   }
 
   return QSlider::event(evt);
@@ -37,6 +62,91 @@ void CSlider::handleValChange(int val) {
   emit sigValChanged(percent);
 }
 
+void CSlider::setHoverPreview(bool enable) {
+  hover_preview = enable;
+  setMouseTracking(enable);
+  if (!enable) hidePreview();
+}
+
+void CSlider::showPreview(const QImage& image, const QString& text) {
+  if (!preview) {
+    preview = new QLabel(this, Qt::ToolTip);
+    preview->setAlignment(Qt::AlignCenter);
+    preview->setMargin(2);
+  }
+
+  if (image.isNull()) {
+    preview->setText(text);
+  } else {
+    // The text goes on a strip along the bottom of the thumbnail
+    auto composed = image.convertToFormat(QImage::Format_RGB32);
+    QPainter painter(&composed);
+    const auto strip_h = painter.fontMetrics().height() + 2;
+    const QRect strip(0, composed.height() - strip_h, composed.width(),
+                      strip_h);
+    painter.fillRect(strip, QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    painter.drawText(strip, Qt::AlignCenter, text);
+    painter.end();
+    preview->setPixmap(QPixmap::fromImage(composed));
+  }
+  preview->adjustSize();
+
+  const auto pos = mapToGlobal(
+      QPoint(hover_x - preview->width() / 2, -preview->height() - 4));
+  preview->move(pos);
+  preview->show();
+}
+
+void CSlider::hidePreview() {
+  if (preview) preview->hide();
+}
+
+void CSlider::setOverview(std::vector<WaveformOverview::Peak> peaks) {
+  overview = std::move(peaks);
+  overview_pixmap = {};
+  update();
+}
+
+void CSlider::paintEvent(QPaintEvent* evt) {
+  if (!overview.empty()) {
+    if (overview_pixmap.size() != size()) renderOverview();
+    QPainter(this).drawPixmap(0, 0, overview_pixmap);
+  }
+  QSlider::paintEvent(evt);
+}
+
+// One column per pixel: the min/max envelope, with the RMS over it
+void CSlider::renderOverview() {
+  overview_pixmap = QPixmap(size());
+  overview_pixmap.fill(Qt::transparent);
+  if (width() <= 0 || height() <= 0) return;
+
+  QPainter painter(&overview_pixmap);
+  const auto peak_color = palette().color(QPalette::Midlight);
+  const auto rms_color = palette().color(QPalette::Mid);
+  const auto mid = height() / 2.0, scale = height() / 2.0;
+  const auto count = (int64_t)overview.size();
+  for (auto x = 0; x < width(); ++x) {
+    const auto first = int64_t(x) * count / width();
+    const auto last = std::max(int64_t(x + 1) * count / width(), first + 1);
+    WaveformOverview::Peak col{1.0f, -1.0f, 0.0f};
+    for (auto i = first; i < last && i < count; ++i) {
+      col.min = std::min(col.min, overview[i].min);
+      col.max = std::max(col.max, overview[i].max);
+      col.rms = std::max(col.rms, overview[i].rms);
+    }
+    if (col.max < col.min) continue;
+
+    painter.setPen(peak_color);
+    painter.drawLine(QPointF(x, mid - col.max * scale),
+                     QPointF(x, mid - col.min * scale));
+    painter.setPen(rms_color);
+    painter.drawLine(QPointF(x, mid - col.rms * scale),
+                     QPointF(x, mid + col.rms * scale));
+  }
+}
+
 void CSlider::setPositionPercent(double pos) {
   blockSignals(true);
   setValue(std::clamp(int(pos * maximum()), minimum(), maximum()));
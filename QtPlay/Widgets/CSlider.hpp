@@ -1,6 +1,11 @@
 #pragma once
 
+#include "../Audio/WaveformOverview.hpp"
+
+#include <QImage>
+#include <QPixmap>
 #include <QSlider>
+#include <vector>
 
 class CSlider final : public QSlider {
   Q_OBJECT;
@@ -8,14 +13,36 @@ class CSlider final : public QSlider {
 
  private:
   bool event(QEvent*) override;
+  void paintEvent(QPaintEvent*) override;
 
   Q_SLOT void handleValChange(int val);
 
+  bool dragging = false, hover_preview = false;
+  int hover_x = 0;
+  class QLabel* preview = nullptr;  // Shown above the hovered position
+  std::vector<WaveformOverview::Peak> overview;
+  QPixmap overview_pixmap;  // Rendered again only on resize or new peaks
+
+  void renderOverview();
+
  public:
   CSlider(QWidget* parent);
   ~CSlider();
 
   Q_SIGNAL void sigValChanged(double new_val);
+  // The left button was released after pressing/dragging the slider
+  Q_SIGNAL void sigReleased(double val);
+  // The mouse moves over the slider without a button held
+  Q_SIGNAL void sigHovered(double val);
+  Q_SIGNAL void sigHoverLeft();
+
+  bool isDragging() const { return dragging; }
 
   Q_SLOT void setPositionPercent(double pos);
+  void setHoverPreview(bool enable);
+  // 'image' may be null, then only the text is shown
+  Q_SLOT void showPreview(const QImage& image, const QString& text);
+  Q_SLOT void hidePreview();
+  // Drawn behind the groove, cleared by an empty vector
+  void setOverview(std::vector<WaveformOverview::Peak> peaks);
 };
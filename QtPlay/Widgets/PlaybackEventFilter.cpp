@@ -17,6 +17,14 @@ bool PlaybackEventFilter::eventFilter(QObject* watched, QEvent* evt) {
             else if (key == Qt::Key_M) {
                 playerCore.toggleMute();
             }
+            else if (key == Qt::Key_Right &&
+                     (keyEvt->modifiers() & Qt::ShiftModifier)) {
+                playerCore.stepTrickSpeed(true);
+            }
+            else if (key == Qt::Key_Left &&
+                     (keyEvt->modifiers() & Qt::ShiftModifier)) {
+                playerCore.stepTrickSpeed(false);
+            }
             else if (key == Qt::Key_Right) {
                 playerCore.seekByIncr(5.0);
             }
@@ -24,7 +32,28 @@ bool PlaybackEventFilter::eventFilter(QObject* watched, QEvent* evt) {
                 playerCore.seekByIncr(-5.0);
             }
             else if (key == Qt::Key_A) {
-               // player_inst->request_stream_cycle(AVMEDIA_TYPE_AUDIO);
+                playerCore.cycleAudioStream();
+            }
+            else if (key == Qt::Key_V) {
+                playerCore.cycleVideoStream();
+            }
+            else if (key == Qt::Key_S) {
+                playerCore.cycleSubtitleStream();
+            }
+            else if (key == Qt::Key_P) {
+                playerCore.cycleProgram();
+            }
+            else if (key == Qt::Key_R) {
+                playerCore.toggleRecording();
+            }
+            else if (key == Qt::Key_Period) {
+                playerCore.stepFrame(false);
+            }
+            else if (key == Qt::Key_Comma) {
+                playerCore.stepFrame(true);
+            }
+            else if (key == Qt::Key_Less) {
+                playerCore.toggleReverse();
             }
         }
 	}
@@ -119,6 +119,15 @@ void PlaylistWidget::handleItemDoubleClick(QListWidgetItem* it) {
   
   entry->setPlayingState(true);
   current_item = entry;
+  updateNextURL();
+}
+
+void PlaylistWidget::updateNextURL() {
+    const auto next_row = cur_item_row + 1;
+    auto next_item = next_row < m_list->count()
+        ? static_cast<PlaylistItem*>(m_list->item(next_row))
+        : nullptr;
+    playerCore.setNextURL(next_item ? next_item->URL() : QUrl());
 }
 
 void PlaylistWidget::setCurrentIndexFromItem(PlaylistItem* it) {
@@ -132,7 +141,7 @@ void PlaylistWidget::setCurrentIndexFromItem(PlaylistItem* it) {
 }
 
 void  PlaylistWidget::playEntryByRow(int cur_row) {
-    if (cur_row < 0 || cur_row >= m_list->count() - 1) return;
+    if (cur_row < 0 || cur_row >= m_list->count()) return;
     cur_item_row = cur_row;
     auto cur_item = static_cast<PlaylistItem*>(m_list->item(cur_item_row));
     handleItemDoubleClick(cur_item);
@@ -160,6 +169,21 @@ void  PlaylistWidget::playNextImpl() {
     playNextItem();
 }
 
+void PlaylistWidget::advanceToNext() {
+    QMetaObject::invokeMethod(this, "advanceToNextImpl", Qt::QueuedConnection);
+}
+
+void PlaylistWidget::advanceToNextImpl() {
+    const auto next_row = cur_item_row + 1;
+    if (next_row < 0 || next_row >= m_list->count()) return;
+    unsetCurrentlyPlaying();
+    auto entry = static_cast<PlaylistItem*>(m_list->item(next_row));
+    setCurrentIndexFromItem(entry);
+    entry->setPlayingState(true);
+    current_item = entry;
+    updateNextURL();
+}
+
 
 PlaylistDock::PlaylistDock(QWidget* parent) : QDockWidget(parent) {
   setObjectName("playlistDock");
@@ -40,6 +40,8 @@ class PlaylistWidget final : public QWidget {
 
 private:
     Q_INVOKABLE void playNextImpl();
+    Q_INVOKABLE void advanceToNextImpl();
+    void updateNextURL();
 
  public:
   PlaylistWidget(QWidget* parent);
@@ -59,6 +61,9 @@ private:
 
   //This function is thread-safe
   void playNext();
+  //The player has already chained to the next item, just follow it.
+  //This function is thread-safe
+  void advanceToNext();
 
  private:
   QSettings getSettings() const;
@@ -88,7 +88,7 @@ void QtPlayGUI::init_for(MainWindow* wnd) {
     wnd->connect(mBar, &MenuBar::sigClearPlaylist, plW, &PlaylistWidget::clearList);
 
     wnd->connect(tBar, &ToolBar::sigNewVol, [](double vol) {playerCore.setVol(vol); });
-    wnd->connect(tBar, &ToolBar::sigReqSeek, [](double pcnt) {playerCore.reqSeek(pcnt); });
+    wnd->connect(tBar, &ToolBar::sigReqSeek, [](double pcnt, bool fast) {playerCore.reqSeek(pcnt, fast); });
 
     wnd->connect(wnd, &MainWindow::sigAddPlaylistEntry, plW,
         &PlaylistWidget::addEntry);
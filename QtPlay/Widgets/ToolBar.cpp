@@ -2,6 +2,7 @@
 
 #include "CSlider.hpp"
 #include "QtPlayGUI.hpp"
+#include "../Common/PlayerSettings.hpp"
 #include "../PlayerCore.hpp"
 #include "StatusBar.hpp"
 
@@ -32,7 +33,22 @@ ToolBar::ToolBar(QList<QAction*> acts) : QToolBar(nullptr), updateTimer(this) {
 
   connect(volSlider, &CSlider::sigValChanged, this,
           &ToolBar::handleSliderVolumeChange);
-  connect(playSlider, &CSlider::sigValChanged, this, &ToolBar::sigReqSeek);
+  /* Scrub with live keyframes or fast seeks, then land precisely where the
+   * slider is released */
+  connect(playSlider, &CSlider::sigValChanged, this, [this](double percent) {
+    emit sigReqSeek(percent, PlayerSettings::get().fast_scrubbing &&
+                                 playSlider->isDragging());
+  });
+  connect(playSlider, &CSlider::sigReleased, this, [this](double percent) {
+    if (PlayerSettings::get().fast_scrubbing) emit sigReqSeek(percent, false);
+  });
+  playSlider->setHoverPreview(true);
+  connect(playSlider, &CSlider::sigHovered, this,
+          &ToolBar::handleSliderHover);
+  connect(playSlider, &CSlider::sigHoverLeft, this, [this] {
+    hover_percent = NAN;
+    if (thumbnailer) thumbnailer->cancel();
+  });
   connect(&updateTimer, &QTimer::timeout, [this] {
       auto [pos, dur] = PlayerCore::instance().getPlaybackPos();
       updatePlaybackPos(pos, dur);
@@ -56,17 +72,79 @@ void ToolBar::handleSliderVolumeChange(double vol) {
   emit sigNewVol(vol);
 }
 
+void ToolBar::handleSliderHover(double percent) {
+  hover_percent = percent;
+  hover_duration = PlayerCore::instance().getPlaybackPos().second;
+  if (!(hover_duration > 0.0)) {
+    playSlider->hidePreview();
+    return;
+  }
+
+  QImage image;
+  const auto& sets = PlayerSettings::get();
+  if (sets.thumbnails) {
+    const auto url = PlayerCore::instance().currentURL();
+    if (!thumbnailer || thumbnailer->url() != url) {
+      thumbnailer = std::make_unique<Thumbnailer>(url, sets.thumbnail_width);
+      connect(thumbnailer.get(), &Thumbnailer::sigReady, this,
+              &ToolBar::handleThumbnail);
+    }
+    image = thumbnailer->request(percent);
+  }
+  playSlider->showPreview(image, hoverText(percent));
+}
+
+// Generated in the background, shown if the mouse is still over its bucket
+void ToolBar::handleThumbnail(double percent, QImage image) {
+  if (std::isnan(hover_percent) ||
+      Thumbnailer::bucket(percent) != Thumbnailer::bucket(hover_percent))
+    return;
+  playSlider->showPreview(image, hoverText(hover_percent));
+}
+
+QString ToolBar::hoverText(double percent) const {
+  const auto secs = int64_t(percent * hover_duration);
+  const auto h = secs / 3600, m = secs % 3600 / 60, s = secs % 60;
+  return h ? QString::asprintf("%lld:%02lld:%02lld", (long long)h,
+                               (long long)m, (long long)s)
+           : QString::asprintf("%02lld:%02lld", (long long)m, (long long)s);
+}
+
 void ToolBar::updatePlaybackPos(double elapsed, double duration) {
     QtPlayGUI::instance().statBar()->updatePlaybackPos(elapsed, duration);
   const auto percent = duration > 0.0 ? elapsed / duration : 0.0;
   if (!playSlider->isEnabled()) playSlider->setEnabled(true);
-  playSlider->setPositionPercent(percent);
+  if (!playSlider->isDragging()) playSlider->setPositionPercent(percent);
+  if (duration > 0.0 && PlayerSettings::get().waveform_overview)
+    updateWaveform();
+}
+
+/* Started once the input is known and the playback is buffered, so that the
+ * scan does not compete with start-up; the slider is filled in when ready */
+void ToolBar::updateWaveform() {
+  auto& core = PlayerCore::instance();
+  const auto url = core.currentURL();
+  if (url.empty() || (waveform && waveform->url() == url)) return;
+
+  if (waveform) {
+    waveform = nullptr;
+    playSlider->setOverview({});
+  }
+  if (!core.isBuffered()) return;
+  waveform = std::make_unique<WaveformOverview>(url);
+  connect(waveform.get(), &WaveformOverview::sigReady, this, [this] {
+    if (waveform) playSlider->setOverview(waveform->peaks());
+  });
 }
 
 void ToolBar::resetPlaybackPos() {
     QtPlayGUI::instance().statBar()->resetPlaybackPos();
   updatePlaybackPos(0.0, 0.0);
   if (playSlider->isEnabled()) playSlider->setEnabled(false);
+  playSlider->hidePreview();
+  thumbnailer = nullptr;
+  waveform = nullptr;
+  playSlider->setOverview({});
 }
 
 double ToolBar::getVolumePercent() const { return vol_percent; }
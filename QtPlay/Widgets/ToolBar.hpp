@@ -1,9 +1,13 @@
 #pragma once
 
 #include "CSlider.hpp"
+#include "../Audio/WaveformOverview.hpp"
+#include "../Video/Thumbnailer.hpp"
 
 #include <QToolBar>
 #include <QTimer>
+#include <cmath>
+#include <memory>
 
 class ToolBar final : public QToolBar {
   Q_OBJECT;
@@ -13,15 +17,25 @@ class ToolBar final : public QToolBar {
 	 QTimer updateTimer;
   CSlider *playSlider = nullptr, *volSlider = nullptr;
   double vol_percent = 1.0;
+  // Seek slider thumbnails, recreated for every input
+  std::unique_ptr<Thumbnailer> thumbnailer;
+  double hover_percent = NAN, hover_duration = NAN;
+  // Waveform overview behind the seek slider, also per input
+  std::unique_ptr<WaveformOverview> waveform;
 
   Q_SLOT void handleSliderVolumeChange(double vol);
+  Q_SLOT void handleSliderHover(double percent);
+  Q_SLOT void handleThumbnail(double percent, QImage image);
+  QString hoverText(double percent) const;
+  void updateWaveform();
 
  public:
   ToolBar(QList<QAction *> acts);
   ~ToolBar();
 
   Q_SIGNAL void sigNewVol(double vol);
-  Q_SIGNAL void sigReqSeek(double percent);
+  // 'fast' seeks are keyframe-only, used while the slider is being dragged
+  Q_SIGNAL void sigReqSeek(double percent, bool fast);
 
   Q_SLOT void updatePlaybackPos(double elapsed, double duration);
   Q_SLOT void resetPlaybackPos();